@@ -37,6 +37,7 @@
 #include "sso-auth-service.h"
 #include <gio/gio.h>
 #include <glib.h>
+#include <string.h>
 
 /**
  * SignonAuthServiceClass:
@@ -124,6 +125,8 @@ _signon_auth_service_finish_query_mechanisms (GObject *source_object,
     proxy = SSO_AUTH_SERVICE (source_object);
     if (sso_auth_service_call_query_mechanisms_finish (proxy, &mechanisms_array, res, &error))
     {
+        sso_auth_service_cache_mechanisms (g_task_get_task_data (task),
+                                           (const gchar * const *)mechanisms_array);
         g_task_return_pointer (task, mechanisms_array, NULL);
     } else {
         g_task_return_error (task, error);
@@ -240,6 +243,7 @@ signon_auth_service_get_mechanisms (SignonAuthService *auth_service,
     g_return_if_fail (SIGNON_IS_AUTH_SERVICE (auth_service));
 
     task = g_task_new (auth_service, cancellable, callback, user_data);
+    g_task_set_task_data (task, g_strdup (method), g_free);
     sso_auth_service_call_query_mechanisms (auth_service->proxy, method, cancellable, _signon_auth_service_finish_query_mechanisms, task);
 }
 
@@ -289,7 +293,884 @@ signon_auth_service_get_mechanisms_sync (SignonAuthService *auth_service,
 
     g_return_val_if_fail (SIGNON_IS_AUTH_SERVICE (auth_service), NULL);
 
-    sso_auth_service_call_query_mechanisms_sync (auth_service->proxy, method, &mechanisms_array, cancellable, error);
+    if (sso_auth_service_call_query_mechanisms_sync (auth_service->proxy, method, &mechanisms_array, cancellable, error))
+        sso_auth_service_cache_mechanisms (method,
+                                           (const gchar * const *)mechanisms_array);
 
     return mechanisms_array;
 }
+
+static GArray *
+auth_service_ids_new ()
+{
+    return g_array_new (FALSE, FALSE, sizeof (guint32));
+}
+
+/* Builds the realm index from the reply of queryIdentities */
+static SignonRealmIndex *
+auth_service_build_realm_index (GVariant *identities)
+{
+    SignonRealmIndex *realm_index = signon_realm_index_new ();
+    GVariantIter iter;
+    GVariant *identity;
+
+    g_variant_iter_init (&iter, identities);
+    while ((identity = g_variant_iter_next_value (&iter)))
+    {
+        const gchar **realms = NULL;
+        guint32 id;
+
+        if (g_variant_lookup (identity, "Id", "u", &id) &&
+            g_variant_lookup (identity, "Realms", "^a&s", &realms))
+        {
+            signon_realm_index_set (realm_index, id, realms);
+        }
+
+        g_free (realms);
+        g_variant_unref (identity);
+    }
+
+    return realm_index;
+}
+
+/* Installs the index loaded from @identities, and looks up @realm in it */
+static GArray *
+auth_service_load_realm_index (GVariant *identities, guint generation,
+                               const gchar *realm)
+{
+    SignonRealmIndex *realm_index = auth_service_build_realm_index (identities);
+    GArray *ids = auth_service_ids_new ();
+
+    signon_realm_index_lookup (realm_index, realm, ids);
+    sso_auth_service_set_realm_index (realm_index, generation);
+    return ids;
+}
+
+typedef struct {
+    gchar *realm;
+    guint generation;
+} AuthServiceRealmData;
+
+static void
+auth_service_realm_data_free (AuthServiceRealmData *data)
+{
+    g_free (data->realm);
+    g_slice_free (AuthServiceRealmData, data);
+}
+
+static void
+_signon_auth_service_finish_query_identities (GObject *source_object,
+                                              GAsyncResult *res,
+                                              gpointer user_data)
+{
+    GTask *task = (GTask *)user_data;
+    AuthServiceRealmData *data = g_task_get_task_data (task);
+    GVariant *identities = NULL;
+    GError *error = NULL;
+
+    g_return_if_fail (SSO_IS_AUTH_SERVICE (source_object));
+
+    if (sso_auth_service_call_query_identities_finish (SSO_AUTH_SERVICE (source_object),
+                                                       &identities, res, &error))
+    {
+        g_task_return_pointer (task,
+                               auth_service_load_realm_index (identities,
+                                                              data->generation,
+                                                              data->realm),
+                               (GDestroyNotify)g_array_unref);
+        g_variant_unref (identities);
+    }
+    else
+    {
+        g_task_return_error (task, error);
+    }
+
+    g_object_unref (task);
+}
+
+/**
+ * signon_auth_service_lookup_identities_for_realm:
+ * @auth_service: a #SignonAuthService
+ * @realm: the host name to be served, such as "www.example.com"
+ * @cancellable: (nullable): a #GCancellable or %NULL
+ * @callback: a callback to execute upon completion
+ * @user_data: closure data for @callback
+ *
+ * Finds the identities which can be used for @realm, according to their
+ * realms: "example.com" matches that host only, "*.example.com" matches its
+ * subdomains, and "*" matches any host. Host names are compared
+ * case-insensitively.
+ *
+ * The first call loads an index of the realms of all the identities from
+ * signond; the following ones are answered from memory, without any D-Bus
+ * traffic. The index follows the identities stored and removed by this
+ * process, and is reloaded when a #SignonIdentity of this process is told
+ * by signond that its data changed, and when signond is restarted.
+ *
+ * signond doesn't announce the identities created or removed by other
+ * processes, so they are not reflected in the results until one of the
+ * above happens: a match is a hint, and the identity could be gone when it
+ * is used.
+ *
+ * Since: 2.1
+ */
+void
+signon_auth_service_lookup_identities_for_realm (SignonAuthService *auth_service,
+                                                 const gchar *realm,
+                                                 GCancellable *cancellable,
+                                                 GAsyncReadyCallback callback,
+                                                 gpointer user_data)
+{
+    AuthServiceRealmData *data;
+    GTask *task = NULL;
+    GArray *ids;
+
+    g_return_if_fail (SIGNON_IS_AUTH_SERVICE (auth_service));
+    g_return_if_fail (realm != NULL);
+
+    task = g_task_new (auth_service, cancellable, callback, user_data);
+    g_task_set_source_tag (task, signon_auth_service_lookup_identities_for_realm);
+
+    ids = auth_service_ids_new ();
+    if (sso_auth_service_lookup_realm (realm, ids))
+    {
+        g_task_return_pointer (task, ids, (GDestroyNotify)g_array_unref);
+        g_object_unref (task);
+        return;
+    }
+    g_array_unref (ids);
+
+    data = g_slice_new (AuthServiceRealmData);
+    data->realm = g_strdup (realm);
+    data->generation = sso_auth_service_get_realm_index_generation ();
+    g_task_set_task_data (task, data,
+                          (GDestroyNotify)auth_service_realm_data_free);
+
+    sso_auth_service_call_query_identities (auth_service->proxy,
+                                            g_variant_new ("a{sv}", NULL),
+                                            "",
+                                            cancellable,
+                                            _signon_auth_service_finish_query_identities,
+                                            task);
+}
+
+/**
+ * signon_auth_service_lookup_identities_for_realm_finish:
+ * @auth_service: a #SignonAuthService
+ * @result: a #GAsyncResult
+ * @error: a location for a #GError, or %NULL
+ *
+ * Completes an asynchronous request to
+ * signon_auth_service_lookup_identities_for_realm().
+ *
+ * Returns: (element-type guint32) (transfer full): the IDs of the matching
+ * identities, the most specific matches first, or %NULL on error.
+ *
+ * Since: 2.1
+ */
+GArray *
+signon_auth_service_lookup_identities_for_realm_finish (SignonAuthService *auth_service,
+                                                        GAsyncResult *result,
+                                                        GError **error)
+{
+    g_return_val_if_fail (SIGNON_IS_AUTH_SERVICE (auth_service), NULL);
+    g_return_val_if_fail (g_task_is_valid (result, auth_service), NULL);
+
+    return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/**
+ * signon_auth_service_lookup_identities_for_realm_sync:
+ * @auth_service: a #SignonAuthService
+ * @realm: the host name to be served, such as "www.example.com"
+ * @cancellable: (nullable): a #GCancellable or %NULL
+ * @error: a location for a #GError, or %NULL
+ *
+ * Finds the identities which can be used for @realm.
+ * This is a blocking version of
+ * signon_auth_service_lookup_identities_for_realm(); once the realm index
+ * is loaded it doesn't block at all, and doesn't touch the main context.
+ *
+ * Returns: (element-type guint32) (transfer full): the IDs of the matching
+ * identities, the most specific matches first, or %NULL on error.
+ *
+ * Since: 2.1
+ */
+GArray *
+signon_auth_service_lookup_identities_for_realm_sync (SignonAuthService *auth_service,
+                                                      const gchar *realm,
+                                                      GCancellable *cancellable,
+                                                      GError **error)
+{
+    GVariant *identities = NULL;
+    GArray *ids;
+    guint generation;
+
+    g_return_val_if_fail (SIGNON_IS_AUTH_SERVICE (auth_service), NULL);
+    g_return_val_if_fail (realm != NULL, NULL);
+
+    ids = auth_service_ids_new ();
+    if (sso_auth_service_lookup_realm (realm, ids))
+        return ids;
+    g_array_unref (ids);
+
+    generation = sso_auth_service_get_realm_index_generation ();
+    if (!sso_auth_service_call_query_identities_sync (auth_service->proxy,
+                                                      g_variant_new ("a{sv}", NULL),
+                                                      "",
+                                                      &identities,
+                                                      cancellable,
+                                                      error))
+        return NULL;
+
+    ids = auth_service_load_realm_index (identities, generation, realm);
+    g_variant_unref (identities);
+    return ids;
+}
+
+/* The default number of identities being processed at the same time */
+#define BULK_WINDOW 16
+
+typedef struct _BulkItem BulkItem;
+
+/* Bulk operations run the same D-Bus conversation for each identity,
+ * keeping up to max_in_flight of them going at the same time */
+typedef struct {
+    guint n_items;
+    guint next;
+    guint n_done;
+    guint in_flight;
+    guint max_in_flight;
+    void (*start_item) (BulkItem *item);
+    GArray *ids;
+    GPtrArray *errors;
+    /* Only for storing identities */
+    GPtrArray *infos;
+    SignonStoreProgressCallback progress_callback;
+    gpointer progress_data;
+    GDestroyNotify progress_notify;
+    /* Only for removing and signing out identities */
+    const gchar *method;
+} BulkData;
+
+struct _BulkItem {
+    GTask *task;
+    guint index;
+};
+
+static void
+bulk_error_free (GError *error)
+{
+    if (error != NULL) g_error_free (error);
+}
+
+static void
+bulk_data_free (BulkData *data)
+{
+    if (data->progress_notify != NULL)
+        data->progress_notify (data->progress_data);
+    g_clear_pointer (&data->infos, g_ptr_array_unref);
+    g_array_unref (data->ids);
+    g_ptr_array_unref (data->errors);
+    g_slice_free (BulkData, data);
+}
+
+static BulkData *
+bulk_data_new (guint n_items, guint max_in_flight,
+               void (*start_item) (BulkItem *item))
+{
+    BulkData *data = g_slice_new0 (BulkData);
+
+    data->n_items = n_items;
+    data->max_in_flight = max_in_flight > 0 ? max_in_flight : BULK_WINDOW;
+    data->start_item = start_item;
+    data->ids = g_array_sized_new (FALSE, TRUE, sizeof (guint32), n_items);
+    g_array_set_size (data->ids, n_items);
+    data->errors = g_ptr_array_new_full (n_items,
+                                         (GDestroyNotify)bulk_error_free);
+    g_ptr_array_set_size (data->errors, n_items);
+    return data;
+}
+
+/* Starts more items, or completes the task once all of them are done */
+static void
+bulk_continue (GTask *task)
+{
+    BulkData *data = g_task_get_task_data (task);
+
+    /* Once cancelled, the items not started yet fail right away */
+    if (g_cancellable_is_cancelled (g_task_get_cancellable (task)))
+    {
+        while (data->next < data->n_items)
+        {
+            g_ptr_array_index (data->errors, data->next++) =
+                g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                                     "Operation was cancelled");
+            data->n_done++;
+        }
+    }
+
+    if (data->n_done == data->n_items)
+    {
+        g_task_return_boolean (task, TRUE);
+        return;
+    }
+
+    while (data->in_flight < data->max_in_flight &&
+           data->next < data->n_items)
+    {
+        BulkItem *item = g_slice_new (BulkItem);
+
+        item->task = g_object_ref (task);
+        item->index = data->next++;
+        data->in_flight++;
+        data->start_item (item);
+    }
+}
+
+/* Takes ownership of @task */
+static void
+bulk_run (GTask *task)
+{
+    bulk_continue (task);
+    g_object_unref (task);
+}
+
+static void
+bulk_item_done (BulkItem *item, GError *error)
+{
+    GTask *task = item->task;
+    BulkData *data = g_task_get_task_data (task);
+
+    g_ptr_array_index (data->errors, item->index) = error;
+    g_slice_free (BulkItem, item);
+
+    data->in_flight--;
+    data->n_done++;
+    if (data->progress_callback != NULL)
+        data->progress_callback (data->n_done, data->n_items,
+                                 data->progress_data);
+
+    bulk_continue (task);
+    g_object_unref (task);
+}
+
+/* The remote objects would only be used once: call them directly, rather
+ * than through a proxy */
+static void
+bulk_item_call (BulkItem *item, const gchar *object_path,
+                const gchar *method, GVariant *parameters,
+                const GVariantType *reply_type,
+                GAsyncReadyCallback callback)
+{
+    SignonAuthService *auth_service = g_task_get_source_object (item->task);
+    GDBusProxy *proxy = G_DBUS_PROXY (auth_service->proxy);
+
+    g_dbus_connection_call (g_dbus_proxy_get_connection (proxy),
+                            g_dbus_proxy_get_name (proxy),
+                            object_path,
+                            SIGNOND_IDENTITY_INTERFACE,
+                            method,
+                            parameters,
+                            reply_type,
+                            G_DBUS_CALL_FLAGS_NONE,
+                            -1,
+                            g_task_get_cancellable (item->task),
+                            callback,
+                            item);
+}
+
+static void
+store_identities_stored_cb (GObject *source_object,
+                            GAsyncResult *res,
+                            gpointer user_data)
+{
+    BulkItem *item = user_data;
+    BulkData *data = g_task_get_task_data (item->task);
+    GError *error = NULL;
+    GVariant *reply;
+
+    reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object),
+                                           res, &error);
+    if (reply != NULL)
+    {
+        SignonIdentityInfo *info;
+        guint32 id;
+
+        g_variant_get (reply, "(u)", &id);
+        g_variant_unref (reply);
+        g_array_index (data->ids, guint32, item->index) = id;
+
+        info = g_ptr_array_index (data->infos, item->index);
+        sso_auth_service_update_realm_index (id,
+                                             signon_identity_info_get_realms (info));
+    }
+
+    bulk_item_done (item, error);
+}
+
+static void
+store_identities_registered_cb (GObject *source_object,
+                                GAsyncResult *res,
+                                gpointer user_data)
+{
+    SsoAuthService *proxy = SSO_AUTH_SERVICE (source_object);
+    BulkItem *item = user_data;
+    BulkData *data = g_task_get_task_data (item->task);
+    gchar *object_path = NULL;
+    GError *error = NULL;
+    GVariant *info_variant;
+
+    if (!sso_auth_service_call_register_new_identity_finish (proxy,
+                                                             &object_path,
+                                                             res, &error))
+    {
+        bulk_item_done (item, error);
+        return;
+    }
+
+    info_variant =
+        signon_identity_info_to_variant (g_ptr_array_index (data->infos,
+                                                            item->index));
+    bulk_item_call (item, object_path, "store",
+                    g_variant_new ("(@a{sv})", info_variant),
+                    G_VARIANT_TYPE ("(u)"),
+                    store_identities_stored_cb);
+    g_variant_unref (info_variant);
+    g_free (object_path);
+}
+
+static void
+store_identities_start_item (BulkItem *item)
+{
+    SignonAuthService *auth_service = g_task_get_source_object (item->task);
+
+    sso_auth_service_call_register_new_identity (auth_service->proxy,
+                                                 "*",
+                                                 g_task_get_cancellable (item->task),
+                                                 store_identities_registered_cb,
+                                                 item);
+}
+
+/**
+ * signon_auth_service_store_identities:
+ * @auth_service: a #SignonAuthService
+ * @infos: (element-type SignonIdentityInfo): the identities to be stored.
+ * @max_in_flight: the maximum number of identities being stored at the same
+ * time, or 0 for a default value.
+ * @progress_callback: (scope notified) (nullable): a function to be called
+ * each time an identity has been processed, or %NULL.
+ * @progress_data: (closure progress_callback): user data for
+ * @progress_callback.
+ * @progress_notify: (destroy progress_data) (nullable): a function to free
+ * @progress_data when the operation is over, or %NULL.
+ * @cancellable: (nullable): a #GCancellable or %NULL
+ * @callback: a callback to execute upon completion
+ * @user_data: closure data for @callback
+ *
+ * Stores a batch of new identities. This is the same as creating a
+ * #SignonIdentity and calling signon_identity_store_info() for each item of
+ * @infos, but without the per-identity objects: up to @max_in_flight
+ * identities are registered and stored in a pipeline, so that the
+ * throughput is limited by signond rather than by the round trips.
+ *
+ * Many similar identities can be built by copying a template with
+ * signon_identity_info_copy(), which is cheap, and then setting the fields
+ * which differ, such as the username and the secret.
+ *
+ * Since: 2.1
+ */
+void
+signon_auth_service_store_identities (SignonAuthService *auth_service,
+                                      GPtrArray *infos,
+                                      guint max_in_flight,
+                                      SignonStoreProgressCallback progress_callback,
+                                      gpointer progress_data,
+                                      GDestroyNotify progress_notify,
+                                      GCancellable *cancellable,
+                                      GAsyncReadyCallback callback,
+                                      gpointer user_data)
+{
+    BulkData *data;
+    GTask *task;
+    guint i;
+
+    g_return_if_fail (SIGNON_IS_AUTH_SERVICE (auth_service));
+    g_return_if_fail (infos != NULL);
+
+    task = g_task_new (auth_service, cancellable, callback, user_data);
+    g_task_set_source_tag (task, signon_auth_service_store_identities);
+
+    data = bulk_data_new (infos->len, max_in_flight,
+                          store_identities_start_item);
+    data->infos = g_ptr_array_new_full (infos->len,
+                                        (GDestroyNotify)signon_identity_info_free);
+    for (i = 0; i < infos->len; i++)
+        g_ptr_array_add (data->infos,
+                         signon_identity_info_copy (g_ptr_array_index (infos, i)));
+    data->progress_callback = progress_callback;
+    data->progress_data = progress_data;
+    data->progress_notify = progress_notify;
+    g_task_set_task_data (task, data, (GDestroyNotify)bulk_data_free);
+
+    bulk_run (task);
+}
+
+/**
+ * signon_auth_service_store_identities_finish:
+ * @auth_service: a #SignonAuthService
+ * @result: a #GAsyncResult
+ * @ids: (out) (optional) (element-type guint32) (transfer full): location
+ * for the IDs of the stored identities, in the same order as the infos; the
+ * ID is 0 for the identities which could not be stored.
+ * @errors: (out) (optional) (element-type GError) (transfer full): location
+ * for the errors, in the same order as the infos; the error is %NULL for the
+ * identities which were stored.
+ * @error: a location for a #GError, or %NULL
+ *
+ * Completes an asynchronous request to
+ * signon_auth_service_store_identities(). The failure to store some of the
+ * identities doesn't make the whole operation fail: check @errors.
+ *
+ * @ids and @errors are set even if the operation was cancelled, since some
+ * of the identities might have been stored already; the identities which
+ * were not stored have the %G_IO_ERROR_CANCELLED error.
+ *
+ * Returns: %TRUE if all the identities were processed, %FALSE if the
+ * operation was cancelled.
+ *
+ * Since: 2.1
+ */
+gboolean
+signon_auth_service_store_identities_finish (SignonAuthService *auth_service,
+                                             GAsyncResult *result,
+                                             GArray **ids,
+                                             GPtrArray **errors,
+                                             GError **error)
+{
+    BulkData *data;
+
+    g_return_val_if_fail (SIGNON_IS_AUTH_SERVICE (auth_service), FALSE);
+    g_return_val_if_fail (g_task_is_valid (result, auth_service), FALSE);
+
+    data = g_task_get_task_data (G_TASK (result));
+    if (ids != NULL)
+        *ids = g_array_ref (data->ids);
+    if (errors != NULL)
+        *errors = g_ptr_array_ref (data->errors);
+    return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+static void
+identities_call_cb (GObject *source_object,
+                    GAsyncResult *res,
+                    gpointer user_data)
+{
+    BulkItem *item = user_data;
+    BulkData *data = g_task_get_task_data (item->task);
+    GError *error = NULL;
+    GVariant *reply;
+
+    reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object),
+                                           res, &error);
+    if (reply != NULL)
+    {
+        if (g_strcmp0 (data->method, "remove") == 0)
+            sso_auth_service_update_realm_index (g_array_index (data->ids,
+                                                                guint32,
+                                                                item->index),
+                                                 NULL);
+        g_variant_unref (reply);
+    }
+
+    bulk_item_done (item, error);
+}
+
+static void
+identities_get_identity_cb (GObject *source_object,
+                            GAsyncResult *res,
+                            gpointer user_data)
+{
+    SsoAuthService *proxy = SSO_AUTH_SERVICE (source_object);
+    BulkItem *item = user_data;
+    BulkData *data = g_task_get_task_data (item->task);
+    gchar *object_path = NULL;
+    GVariant *identity_data = NULL;
+    GError *error = NULL;
+
+    if (!sso_auth_service_call_get_identity_finish (proxy, &object_path,
+                                                    &identity_data,
+                                                    res, &error))
+    {
+        bulk_item_done (item, error);
+        return;
+    }
+
+    bulk_item_call (item, object_path, data->method, NULL, NULL,
+                    identities_call_cb);
+    g_variant_unref (identity_data);
+    g_free (object_path);
+}
+
+static void
+identities_start_item (BulkItem *item)
+{
+    SignonAuthService *auth_service = g_task_get_source_object (item->task);
+    BulkData *data = g_task_get_task_data (item->task);
+
+    sso_auth_service_call_get_identity (auth_service->proxy,
+                                        g_array_index (data->ids, guint32,
+                                                       item->index),
+                                        "*",
+                                        g_task_get_cancellable (item->task),
+                                        identities_get_identity_cb,
+                                        item);
+}
+
+static void
+identities_run_bulk (SignonAuthService *auth_service,
+                     GArray *ids,
+                     guint max_in_flight,
+                     const gchar *method,
+                     GCancellable *cancellable,
+                     GAsyncReadyCallback callback,
+                     gpointer user_data,
+                     gpointer source_tag)
+{
+    BulkData *data;
+    GTask *task;
+
+    task = g_task_new (auth_service, cancellable, callback, user_data);
+    g_task_set_source_tag (task, source_tag);
+
+    data = bulk_data_new (ids->len, max_in_flight, identities_start_item);
+    memcpy (data->ids->data, ids->data, ids->len * sizeof (guint32));
+    data->method = method;
+    g_task_set_task_data (task, data, (GDestroyNotify)bulk_data_free);
+
+    bulk_run (task);
+}
+
+static gboolean
+identities_bulk_finish (SignonAuthService *auth_service,
+                        GAsyncResult *result,
+                        GPtrArray **errors,
+                        GError **error)
+{
+    BulkData *data;
+
+    g_return_val_if_fail (SIGNON_IS_AUTH_SERVICE (auth_service), FALSE);
+    g_return_val_if_fail (g_task_is_valid (result, auth_service), FALSE);
+
+    data = g_task_get_task_data (G_TASK (result));
+    if (errors != NULL)
+        *errors = g_ptr_array_ref (data->errors);
+    return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/**
+ * signon_auth_service_remove_identities:
+ * @auth_service: a #SignonAuthService
+ * @ids: (element-type guint32): the IDs of the identities to be removed.
+ * @max_in_flight: the maximum number of identities being removed at the
+ * same time, or 0 for a default value.
+ * @cancellable: (nullable): a #GCancellable or %NULL
+ * @callback: a callback to execute upon completion
+ * @user_data: closure data for @callback
+ *
+ * Removes a batch of identities. This is the same as calling
+ * signon_identity_remove() on a #SignonIdentity for each of @ids, but
+ * without creating the objects, and with up to @max_in_flight removals
+ * running at the same time.
+ *
+ * Since: 2.1
+ */
+void
+signon_auth_service_remove_identities (SignonAuthService *auth_service,
+                                       GArray *ids,
+                                       guint max_in_flight,
+                                       GCancellable *cancellable,
+                                       GAsyncReadyCallback callback,
+                                       gpointer user_data)
+{
+    g_return_if_fail (SIGNON_IS_AUTH_SERVICE (auth_service));
+    g_return_if_fail (ids != NULL);
+
+    identities_run_bulk (auth_service, ids, max_in_flight, "remove",
+                         cancellable, callback, user_data,
+                         signon_auth_service_remove_identities);
+}
+
+/**
+ * signon_auth_service_remove_identities_finish:
+ * @auth_service: a #SignonAuthService
+ * @result: a #GAsyncResult
+ * @errors: (out) (optional) (element-type GError) (transfer full): location
+ * for the errors, in the same order as the IDs; the error is %NULL for the
+ * identities which were removed, %G_IO_ERROR_CANCELLED for those which were
+ * not processed because the operation was cancelled.
+ * @error: a location for a #GError, or %NULL
+ *
+ * Completes an asynchronous request to
+ * signon_auth_service_remove_identities().
+ *
+ * Returns: %TRUE if all the identities were processed, %FALSE if the
+ * operation was cancelled.
+ *
+ * Since: 2.1
+ */
+gboolean
+signon_auth_service_remove_identities_finish (SignonAuthService *auth_service,
+                                              GAsyncResult *result,
+                                              GPtrArray **errors,
+                                              GError **error)
+{
+    return identities_bulk_finish (auth_service, result, errors, error);
+}
+
+/**
+ * signon_auth_service_sign_out_identities:
+ * @auth_service: a #SignonAuthService
+ * @ids: (element-type guint32): the IDs of the identities to be signed out.
+ * @max_in_flight: the maximum number of identities being signed out at the
+ * same time, or 0 for a default value.
+ * @cancellable: (nullable): a #GCancellable or %NULL
+ * @callback: a callback to execute upon completion
+ * @user_data: closure data for @callback
+ *
+ * Signs out a batch of identities. This is the same as calling
+ * signon_identity_sign_out() on a #SignonIdentity for each of @ids, but
+ * without creating the objects, and with up to @max_in_flight sign-outs
+ * running at the same time.
+ *
+ * Since: 2.1
+ */
+void
+signon_auth_service_sign_out_identities (SignonAuthService *auth_service,
+                                         GArray *ids,
+                                         guint max_in_flight,
+                                         GCancellable *cancellable,
+                                         GAsyncReadyCallback callback,
+                                         gpointer user_data)
+{
+    g_return_if_fail (SIGNON_IS_AUTH_SERVICE (auth_service));
+    g_return_if_fail (ids != NULL);
+
+    identities_run_bulk (auth_service, ids, max_in_flight, "signOut",
+                         cancellable, callback, user_data,
+                         signon_auth_service_sign_out_identities);
+}
+
+/**
+ * signon_auth_service_sign_out_identities_finish:
+ * @auth_service: a #SignonAuthService
+ * @result: a #GAsyncResult
+ * @errors: (out) (optional) (element-type GError) (transfer full): location
+ * for the errors, in the same order as the IDs; the error is %NULL for the
+ * identities which were signed out, %G_IO_ERROR_CANCELLED for those which were
+ * not processed because the operation was cancelled.
+ * @error: a location for a #GError, or %NULL
+ *
+ * Completes an asynchronous request to
+ * signon_auth_service_sign_out_identities().
+ *
+ * Returns: %TRUE if all the identities were processed, %FALSE if the
+ * operation was cancelled.
+ *
+ * Since: 2.1
+ */
+gboolean
+signon_auth_service_sign_out_identities_finish (SignonAuthService *auth_service,
+                                                GAsyncResult *result,
+                                                GPtrArray **errors,
+                                                GError **error)
+{
+    return identities_bulk_finish (auth_service, result, errors, error);
+}
+
+static void
+_signon_auth_service_finish_clear (GObject *source_object,
+                                   GAsyncResult *res,
+                                   gpointer user_data)
+{
+    GTask *task = (GTask *)user_data;
+    GError *error = NULL;
+    gboolean success = FALSE;
+
+    g_return_if_fail (SSO_IS_AUTH_SERVICE (source_object));
+
+    if (!sso_auth_service_call_clear_finish (SSO_AUTH_SERVICE (source_object),
+                                             &success, res, &error))
+    {
+        g_task_return_error (task, error);
+    }
+    else if (!success)
+    {
+        g_task_return_new_error (task,
+                                 signon_error_quark (),
+                                 SIGNON_ERROR_REMOVE_FAILED,
+                                 "The credentials database could not be "
+                                 "cleared.");
+    }
+    else
+    {
+        sso_auth_service_invalidate_realm_index ();
+        g_task_return_boolean (task, TRUE);
+    }
+
+    g_object_unref (task);
+}
+
+/**
+ * signon_auth_service_clear:
+ * @auth_service: a #SignonAuthService
+ * @cancellable: (nullable): a #GCancellable or %NULL
+ * @callback: a callback to execute upon completion
+ * @user_data: closure data for @callback
+ *
+ * Removes all the identities from the credentials database, in a single
+ * call. signond only allows privileged clients to do this.
+ *
+ * Since: 2.1
+ */
+void
+signon_auth_service_clear (SignonAuthService *auth_service,
+                           GCancellable *cancellable,
+                           GAsyncReadyCallback callback,
+                           gpointer user_data)
+{
+    GTask *task;
+
+    g_return_if_fail (SIGNON_IS_AUTH_SERVICE (auth_service));
+
+    task = g_task_new (auth_service, cancellable, callback, user_data);
+    g_task_set_source_tag (task, signon_auth_service_clear);
+
+    sso_auth_service_call_clear (auth_service->proxy,
+                                 cancellable,
+                                 _signon_auth_service_finish_clear,
+                                 task);
+}
+
+/**
+ * signon_auth_service_clear_finish:
+ * @auth_service: a #SignonAuthService
+ * @result: a #GAsyncResult
+ * @error: a location for a #GError, or %NULL
+ *
+ * Completes an asynchronous request to signon_auth_service_clear().
+ *
+ * Returns: %TRUE if the database was cleared, %FALSE otherwise.
+ *
+ * Since: 2.1
+ */
+gboolean
+signon_auth_service_clear_finish (SignonAuthService *auth_service,
+                                  GAsyncResult *result,
+                                  GError **error)
+{
+    g_return_val_if_fail (SIGNON_IS_AUTH_SERVICE (auth_service), FALSE);
+    g_return_val_if_fail (g_task_is_valid (result, auth_service), FALSE);
+
+    return g_task_propagate_boolean (G_TASK (result), error);
+}
@@ -26,11 +26,26 @@
 #ifndef _SIGNON_AUTH_SERVICE_H_
 #define _SIGNON_AUTH_SERVICE_H_
 
+#include <libsignon-glib/signon-identity-info.h>
 #include <glib-object.h>
 #include <gio/gio.h>
 
 G_BEGIN_DECLS
 
+/**
+ * SignonStoreProgressCallback:
+ * @n_done: the number of identities processed so far.
+ * @n_total: the number of identities to be processed.
+ * @user_data: the user data passed to signon_auth_service_store_identities().
+ *
+ * Reports the progress of signon_auth_service_store_identities().
+ *
+ * Since: 2.1
+ */
+typedef void (*SignonStoreProgressCallback) (guint n_done,
+                                             guint n_total,
+                                             gpointer user_data);
+
 #define SIGNON_TYPE_AUTH_SERVICE signon_auth_service_get_type ()
 G_DECLARE_FINAL_TYPE (SignonAuthService, signon_auth_service, SIGNON, AUTH_SERVICE, GObject)
 
@@ -59,6 +74,64 @@ gchar **signon_auth_service_get_mechanisms_sync (SignonAuthService *auth_service
                                                  const gchar *method,
                                                  GCancellable *cancellable,
                                                  GError **error);
+
+void signon_auth_service_lookup_identities_for_realm (SignonAuthService *auth_service,
+                                                      const gchar *realm,
+                                                      GCancellable *cancellable,
+                                                      GAsyncReadyCallback callback,
+                                                      gpointer user_data);
+GArray *signon_auth_service_lookup_identities_for_realm_finish (SignonAuthService *auth_service,
+                                                                GAsyncResult *result,
+                                                                GError **error);
+GArray *signon_auth_service_lookup_identities_for_realm_sync (SignonAuthService *auth_service,
+                                                              const gchar *realm,
+                                                              GCancellable *cancellable,
+                                                              GError **error);
+
+void signon_auth_service_store_identities (SignonAuthService *auth_service,
+                                           GPtrArray *infos,
+                                           guint max_in_flight,
+                                           SignonStoreProgressCallback progress_callback,
+                                           gpointer progress_data,
+                                           GDestroyNotify progress_notify,
+                                           GCancellable *cancellable,
+                                           GAsyncReadyCallback callback,
+                                           gpointer user_data);
+gboolean signon_auth_service_store_identities_finish (SignonAuthService *auth_service,
+                                                      GAsyncResult *result,
+                                                      GArray **ids,
+                                                      GPtrArray **errors,
+                                                      GError **error);
+
+void signon_auth_service_remove_identities (SignonAuthService *auth_service,
+                                            GArray *ids,
+                                            guint max_in_flight,
+                                            GCancellable *cancellable,
+                                            GAsyncReadyCallback callback,
+                                            gpointer user_data);
+gboolean signon_auth_service_remove_identities_finish (SignonAuthService *auth_service,
+                                                       GAsyncResult *result,
+                                                       GPtrArray **errors,
+                                                       GError **error);
+
+void signon_auth_service_sign_out_identities (SignonAuthService *auth_service,
+                                              GArray *ids,
+                                              guint max_in_flight,
+                                              GCancellable *cancellable,
+                                              GAsyncReadyCallback callback,
+                                              gpointer user_data);
+gboolean signon_auth_service_sign_out_identities_finish (SignonAuthService *auth_service,
+                                                         GAsyncResult *result,
+                                                         GPtrArray **errors,
+                                                         GError **error);
+
+void signon_auth_service_clear (SignonAuthService *auth_service,
+                                GCancellable *cancellable,
+                                GAsyncReadyCallback callback,
+                                gpointer user_data);
+gboolean signon_auth_service_clear_finish (SignonAuthService *auth_service,
+                                           GAsyncResult *result,
+                                           GError **error);
 G_END_DECLS
 
 #endif /* _SIGNON_AUTH_SERVICE_H_ */
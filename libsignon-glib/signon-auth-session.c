@@ -36,6 +36,13 @@
  * can be created with no existing identity bound to them, in which case all
  * the authentication data must be filled in by the client when
  * signon_auth_session_process() is called.
+ *
+ * #SignonAuthSession implements #GAsyncInitable: g_async_initable_init_async()
+ * waits for the session to be registered with signond, without issuing any
+ * operation. Initializing it is optional.
+ *
+ * Like a #SignonIdentity, a #SignonAuthSession must only be used by the
+ * thread which created it.
  */
 
 #include "signon-internals.h"
@@ -47,6 +54,7 @@
 #include "sso-auth-session-gen.h"
 
 static void signon_auth_session_proxy_if_init (SignonProxyInterface *iface);
+static void signon_auth_session_async_initable_if_init (GAsyncInitableIface *iface);
 
 /**
  * SignonAuthSession:
@@ -66,22 +74,45 @@ struct _SignonAuthSession
   SsoAuthSession *proxy;
   SsoAuthService *auth_service_proxy;
   GCancellable *cancellable;
+  /* Cancels the pending registration only, which can be restarted without
+   * affecting the other calls */
+  GCancellable *registration_cancellable;
+  /* The thread which created the session, and which must use it */
+  GThread *owner_thread;
 
   gint id;
   gchar *method_name;
+  gchar **available_mechanisms;
+  gchar **allowed_mechanisms;
 
   gboolean registering;
+  /* The context where the pending registration reply will be dispatched */
+  GMainContext *registration_context;
   gboolean busy;
   gboolean canceled;
   gboolean dispose_has_run;
 
-  guint signal_state_changed;
-  guint signal_unregistered;
+  gboolean coalesce_states;
+  GSource *state_idle_source;
+  gint pending_state;
+  gchar *pending_message;
+  guint dropped_states;
+
+  /* The timings of the requests sent to signond, oldest first: signond
+   * serves the requests of a session one at a time, in order, so the state
+   * changes belong to the first one */
+  GQueue sent_timings;
+
+  gsize fd_threshold;
+
+  SsoSignalWatch *signal_watch;
 };
 
 G_DEFINE_TYPE_WITH_CODE (SignonAuthSession, signon_auth_session, G_TYPE_OBJECT,
                          G_IMPLEMENT_INTERFACE (SIGNON_TYPE_PROXY,
-                                                signon_auth_session_proxy_if_init))
+                                                signon_auth_session_proxy_if_init)
+                         G_IMPLEMENT_INTERFACE (G_TYPE_ASYNC_INITABLE,
+                                                signon_auth_session_async_initable_if_init))
 
 /* Signals */
 enum
@@ -95,55 +126,150 @@ static guint auth_session_signals[LAST_SIGNAL] = { 0 };
 static const gchar auth_session_process_pending_message[] =
     "The request is added to queue.";
 
-enum SignonAuthSessionState {
-    SIGNON_AUTH_SESSION_STATE_NOT_STARTED = 0,   /* No message. */
-    SIGNON_AUTH_SESSION_STATE_RESOLVING_HOST,    /* Resolving remote server
-                                                   host name. */
-    SIGNON_AUTH_SESSION_STATE_CONNECTING,        /* Connecting to remote
-                                                   server. */
-    SIGNON_AUTH_SESSION_STATE_SENDING_DATA,      /* Sending data to remote
-                                                   server. */
-    SIGNON_AUTH_SESSION_STATE_WAITING_REPLY,     /* Waiting reply from remote
-                                                   server. */
-    SIGNON_AUTH_SESSION_STATE_USER_PENDING,      /* Waiting response from
-                                                   user. */
-    SIGNON_AUTH_SESSION_STATE_UI_REFRESHING,     /* Refreshing ui request. */
-    SIGNON_AUTH_SESSION_STATE_PROCESS_PENDING,   /* Waiting another process
-                                                   to start. */
-    SIGNON_AUTH_SESSION_STATE_STARTED,           /* Authentication session is
-                                                   started. */
-    SIGNON_AUTH_SESSION_STATE_PROCESS_CANCELING, /* Canceling.current
-                                                   process. */
-    SIGNON_AUTH_SESSION_STATE_PROCESS_DONE,      /* Authentication
-                                                   completed. */
-    SIGNON_AUTH_SESSION_STATE_CUSTOM,            /* Custom message. */
-    SIGNON_AUTH_SESSION_STATE_LAST
+typedef struct {
+    SignonAuthSessionState state;
+    gint64 time;
+} AuthSessionTransition;
+
+/**
+ * SignonAuthSessionTimings:
+ *
+ * Opaque structure holding the monotonic timestamps (as returned by
+ * g_get_monotonic_time()) recorded while a signon_auth_session_process()
+ * request was being served. Use the accessor functions below.
+ */
+struct _SignonAuthSessionTimings
+{
+    volatile gint ref_count;
+    gint64 start_time;
+    gint64 ready_time;
+    gint64 sent_time;
+    gint64 reply_time;
+    GArray *transitions;
 };
 
+G_DEFINE_BOXED_TYPE (SignonAuthSessionTimings, signon_auth_session_timings,
+                     signon_auth_session_timings_ref,
+                     signon_auth_session_timings_unref);
+
 typedef struct _AuthSessionProcessData
 {
     GVariant *session_data;
     gchar *mechanism;
+    gchar **mechanisms;
+    SignonAuthSessionTimings *timings;
+    /* Whether the request asked signond for fd passing */
+    gboolean fd_passing_offered;
 } AuthSessionProcessData;
 
-static void auth_session_state_changed_cb (GDBusProxy *proxy, gint state, gchar *message, gpointer user_data);
-static void auth_session_remote_object_destroyed_cb (GDBusProxy *proxy, gpointer user_data);
+static void auth_session_signal_cb (const gchar *signal_name, GVariant *parameters, gpointer user_data);
 
 static gboolean auth_session_priv_init (SignonAuthSession *self, guint id, const gchar *method_name, GError **err);
 
 static void auth_session_set_id_ready_cb (gpointer object, const GError *error, gpointer user_data);
 static void auth_session_cancel_ready_cb (gpointer object, const GError *error, gpointer user_data);
+static void auth_session_prepare_ready_cb (gpointer object, const GError *error, gpointer user_data);
 
 static void auth_session_check_remote_object(SignonAuthSession *self);
+static void auth_session_flush_pending_state (SignonAuthSession *self);
+static void auth_session_notify_state (SignonAuthSession *self, gint state, const gchar *message);
+
+static SignonAuthSessionTimings *
+auth_session_timings_new ()
+{
+    SignonAuthSessionTimings *timings;
+
+    timings = g_slice_new0 (SignonAuthSessionTimings);
+    timings->ref_count = 1;
+    timings->start_time = g_get_monotonic_time ();
+    timings->transitions = g_array_new (FALSE, FALSE,
+                                        sizeof (AuthSessionTransition));
+    return timings;
+}
+
+static void
+auth_session_timings_add_transition (SignonAuthSessionTimings *timings,
+                                     gint state)
+{
+    AuthSessionTransition transition;
+
+    transition.state = state;
+    transition.time = g_get_monotonic_time ();
+    g_array_append_val (timings->transitions, transition);
+}
 
 static void
 auth_session_process_data_free (AuthSessionProcessData *process_data)
 {
     g_free (process_data->mechanism);
+    g_strfreev (process_data->mechanisms);
+    signon_auth_session_timings_unref (process_data->timings);
     g_variant_unref (process_data->session_data);
     g_slice_free (AuthSessionProcessData, process_data);
 }
 
+/* Returns the mechanisms supported by the session's plugin, as far as they are
+ * known without asking signond, or %NULL. */
+static const gchar * const *
+auth_session_get_supported_mechanisms (SignonAuthSession *self)
+{
+    if (self->available_mechanisms == NULL)
+    {
+        self->available_mechanisms =
+            sso_auth_service_get_cached_mechanisms (self->method_name);
+    }
+
+    return (const gchar * const *)self->available_mechanisms;
+}
+
+/* @mechanism can be a space-separated list, which signond reduces to the
+ * allowed ones: reject it only if signond would too */
+static gboolean
+auth_session_mechanism_is_allowed (SignonAuthSession *self,
+                                   const gchar *mechanism)
+{
+    return self->allowed_mechanisms == NULL ||
+        signon_identity_info_mechanism_matches ((const gchar * const *)
+                                                self->allowed_mechanisms,
+                                                mechanism);
+}
+
+static gboolean
+auth_session_mechanism_is_usable (SignonAuthSession *self,
+                                  const gchar * const *supported,
+                                  const gchar *mechanism)
+{
+    if (supported != NULL &&
+        !signon_identity_info_mechanism_matches (supported, mechanism))
+        return FALSE;
+
+    return auth_session_mechanism_is_allowed (self, mechanism);
+}
+
+/* Intersects @wanted (or all the supported mechanisms, if @wanted is %NULL)
+ * with the mechanisms supported by the plugin and allowed by the identity. */
+static gchar **
+auth_session_filter_mechanisms (SignonAuthSession *self,
+                                const gchar * const *supported,
+                                const gchar * const *wanted)
+{
+    GPtrArray *mechanisms;
+    gint i;
+
+    if (wanted == NULL)
+        wanted = supported;
+
+    mechanisms = g_ptr_array_new ();
+    for (i = 0; wanted != NULL && wanted[i] != NULL; i++)
+    {
+        if (auth_session_mechanism_is_usable (self, supported, wanted[i]))
+            g_ptr_array_add (mechanisms, g_strdup (wanted[i]));
+    }
+    g_ptr_array_add (mechanisms, NULL);
+
+    return (gchar **)g_ptr_array_free (mechanisms, FALSE);
+}
+
 static void
 auth_session_process_reply (GObject *object, GAsyncResult *res,
                             gpointer userdata)
@@ -151,15 +277,41 @@ auth_session_process_reply (GObject *object, GAsyncResult *res,
     SignonAuthSession *self;
     SsoAuthSession *proxy = SSO_AUTH_SESSION (object);
     GTask *res_process = userdata;
+    AuthSessionProcessData *process_data;
     GVariant *reply;
+    GUnixFDList *fd_list = NULL;
     GError *error = NULL;
 
     g_return_if_fail (res_process != NULL);
 
-    sso_auth_session_call_process_finish (proxy, &reply, res, &error);
+    sso_auth_session_call_process_finish (proxy, &reply, &fd_list,
+                                          res, &error);
 
     self = SIGNON_AUTH_SESSION (g_task_get_source_object (res_process));
     self->busy = FALSE;
+    process_data = g_task_get_task_data (res_process);
+
+    if (error == NULL && self->fd_threshold > 0)
+    {
+        GVariant *decoded;
+        gboolean fd_passing_supported;
+
+        decoded = signon_session_data_decode_fds (reply, fd_list,
+                                                  &fd_passing_supported,
+                                                  &error);
+        g_variant_unref (reply);
+        reply = decoded;
+        if (error == NULL && process_data->fd_passing_offered)
+            sso_auth_service_set_fd_passing (fd_passing_supported);
+    }
+    g_clear_object (&fd_list);
+
+    process_data->timings->reply_time = g_get_monotonic_time ();
+    if (g_queue_remove (&self->sent_timings, process_data->timings))
+        signon_auth_session_timings_unref (process_data->timings);
+
+    /* Deliver the last state before the reply */
+    auth_session_flush_pending_state (self);
 
     if (G_LIKELY (error == NULL))
     {
@@ -180,9 +332,16 @@ auth_session_process_ready_cb (gpointer object, const GError *error, gpointer us
     SignonAuthSession *self = SIGNON_AUTH_SESSION (object);
     GTask *res = G_TASK (user_data);
     AuthSessionProcessData *process_data;
+    GVariant *session_data;
+    SsoFdPassing fd_passing;
 
     g_return_if_fail (self != NULL);
 
+    process_data = g_task_get_task_data (res);
+    g_return_if_fail (process_data != NULL);
+
+    process_data->timings->ready_time = g_get_monotonic_time ();
+
     if (error != NULL)
     {
         DEBUG ("AuthSessionError: %s", error->message);
@@ -203,30 +362,110 @@ auth_session_process_ready_cb (gpointer object, const GError *error, gpointer us
         return;
     }
 
-    process_data = g_task_get_task_data (res);
-    g_return_if_fail (process_data != NULL);
+    if (process_data->mechanism == NULL)
+    {
+        const gchar * const *supported;
+        gint i;
+
+        /* Pick the first of the candidate mechanisms which we know to be
+         * usable; if we know nothing about the plugin or the identity, let
+         * signond decide on the first one. */
+        supported = auth_session_get_supported_mechanisms (self);
+        for (i = 0; process_data->mechanisms[i] != NULL; i++)
+        {
+            if (auth_session_mechanism_is_usable (self, supported,
+                                                  process_data->mechanisms[i]))
+            {
+                process_data->mechanism = g_strdup (process_data->mechanisms[i]);
+                break;
+            }
+        }
+
+        if (process_data->mechanism == NULL)
+        {
+            self->busy = FALSE;
+            g_task_return_new_error (res,
+                                     signon_error_quark (),
+                                     SIGNON_ERROR_MECHANISM_NOT_AVAILABLE,
+                                     "None of the requested mechanisms is available");
+            g_object_unref (res);
+            return;
+        }
+        DEBUG ("Chosen mechanism: %s", process_data->mechanism);
+    }
+    else if (!auth_session_mechanism_is_allowed (self,
+                                                 process_data->mechanism))
+    {
+        /* No need to ask signond: the identity doesn't allow it */
+        self->busy = FALSE;
+        g_task_return_new_error (res,
+                                 signon_error_quark (),
+                                 SIGNON_ERROR_METHOD_OR_MECHANISM_NOT_ALLOWED,
+                                 "The identity does not allow mechanism `%s`",
+                                 process_data->mechanism);
+        g_object_unref (res);
+        return;
+    }
 
-    sso_auth_session_call_process (self->proxy,
-                                   process_data->session_data,
-                                   process_data->mechanism,
-                                   g_task_get_cancellable (res),
-                                   auth_session_process_reply,
-                                   res);
+    g_queue_push_tail (&self->sent_timings,
+                       signon_auth_session_timings_ref (process_data->timings));
+    process_data->timings->sent_time = g_get_monotonic_time ();
 
-    g_signal_emit (self,
-                   auth_session_signals[STATE_CHANGED],
-                   0,
-                   SIGNON_AUTH_SESSION_STATE_PROCESS_PENDING,
-                   auth_session_process_pending_message);
+    fd_passing = self->fd_threshold > 0 ?
+        sso_auth_service_get_fd_passing () : SSO_FD_PASSING_UNSUPPORTED;
+    if (fd_passing != SSO_FD_PASSING_UNSUPPORTED)
+    {
+        GUnixFDList *fd_list = NULL;
+
+        /* Until signond has confirmed that it understands them, only
+         * offer to receive file descriptors; once it's known not to, the
+         * request is not sent anymore, since signond would forward it to
+         * the plugin */
+        if (fd_passing == SSO_FD_PASSING_SUPPORTED)
+            fd_list = g_unix_fd_list_new ();
+        process_data->fd_passing_offered = TRUE;
+
+        session_data =
+            signon_session_data_encode_fds (process_data->session_data,
+                                            self->fd_threshold,
+                                            fd_list);
+        if (fd_list != NULL && g_unix_fd_list_get_length (fd_list) == 0)
+            g_clear_object (&fd_list);
+
+        sso_auth_session_call_process (self->proxy,
+                                       session_data,
+                                       process_data->mechanism,
+                                       fd_list,
+                                       g_task_get_cancellable (res),
+                                       auth_session_process_reply,
+                                       res);
+        g_clear_object (&fd_list);
+    }
+    else
+    {
+        sso_auth_session_call_process (self->proxy,
+                                       process_data->session_data,
+                                       process_data->mechanism,
+                                       NULL,
+                                       g_task_get_cancellable (res),
+                                       auth_session_process_reply,
+                                       res);
+    }
+
+    auth_session_notify_state (self,
+                               SIGNON_AUTH_SESSION_STATE_PROCESS_PENDING,
+                               auth_session_process_pending_message);
 }
 
 static void
 destroy_proxy (SignonAuthSession *self)
 {
-    g_signal_handler_disconnect (self->proxy, self->signal_state_changed);
-    self->signal_state_changed = 0;
-    g_signal_handler_disconnect (self->proxy, self->signal_unregistered);
-    self->signal_unregistered = 0;
+    if (self->signal_watch != NULL)
+    {
+        sso_auth_service_unwatch_object (self->auth_service_proxy,
+                                         self->signal_watch);
+        self->signal_watch = NULL;
+    }
 
     g_clear_object (&self->proxy);
 }
@@ -254,11 +493,45 @@ signon_auth_session_proxy_if_init (SignonProxyInterface *iface)
     iface->setup = signon_auth_session_proxy_setup;
 }
 
+static void
+signon_auth_session_init_async (GAsyncInitable *initable, int io_priority,
+                                GCancellable *cancellable,
+                                GAsyncReadyCallback callback,
+                                gpointer user_data)
+{
+    SignonAuthSession *self = SIGNON_AUTH_SESSION (initable);
+
+    /* The session must have been created by signon_auth_session_new() */
+    g_return_if_fail (self->method_name != NULL);
+
+    auth_session_check_remote_object (self);
+
+    signon_proxy_init_async (self, auth_session_object_quark (), cancellable,
+                             callback, user_data);
+}
+
+static gboolean
+signon_auth_session_init_finish (GAsyncInitable *initable, GAsyncResult *res,
+                                 GError **error)
+{
+    return signon_proxy_init_finish (initable, res, error);
+}
+
+static void
+signon_auth_session_async_initable_if_init (GAsyncInitableIface *iface)
+{
+    iface->init_async = signon_auth_session_init_async;
+    iface->init_finish = signon_auth_session_init_finish;
+}
+
 static void
 signon_auth_session_init (SignonAuthSession *self)
 {
     self->auth_service_proxy = sso_auth_service_get_instance ();
     self->cancellable = g_cancellable_new ();
+    self->registration_cancellable = g_cancellable_new ();
+    self->owner_thread = g_thread_self ();
+    g_queue_init (&self->sent_timings);
 }
 
 static void
@@ -277,10 +550,26 @@ signon_auth_session_dispose (GObject *object)
         g_cancellable_cancel (self->cancellable);
         g_clear_object (&self->cancellable);
     }
+    if (self->registration_cancellable)
+    {
+        g_cancellable_cancel (self->registration_cancellable);
+        g_clear_object (&self->registration_cancellable);
+    }
+    g_clear_pointer (&self->registration_context, g_main_context_unref);
 
     if (self->proxy)
         destroy_proxy (self);
 
+    if (self->state_idle_source)
+    {
+        g_source_destroy (self->state_idle_source);
+        g_clear_pointer (&self->state_idle_source, g_source_unref);
+    }
+
+    g_queue_foreach (&self->sent_timings,
+                     (GFunc)signon_auth_session_timings_unref, NULL);
+    g_queue_clear (&self->sent_timings);
+
     if (self->auth_service_proxy)
     {
         g_clear_object (&self->auth_service_proxy);
@@ -300,6 +589,9 @@ signon_auth_session_finalize (GObject *object)
 
     self = SIGNON_AUTH_SESSION(object);
     g_clear_pointer (&self->method_name, g_free);
+    g_clear_pointer (&self->available_mechanisms, g_strfreev);
+    g_clear_pointer (&self->allowed_mechanisms, g_strfreev);
+    g_clear_pointer (&self->pending_message, g_free);
 
     G_OBJECT_CLASS (signon_auth_session_parent_class)->finalize (object);
 }
@@ -409,6 +701,129 @@ signon_auth_session_set_id(SignonAuthSession* self,
                                   GINT_TO_POINTER(id));
 }
 
+/**
+ * signon_auth_session_set_coalesce_state_changes:
+ * @self: the #SignonAuthSession.
+ * @coalesce: whether state changes should be coalesced.
+ *
+ * By default, #SignonAuthSession::state-changed is emitted once for every
+ * state change notified by signond. If @coalesce is %TRUE, state changes
+ * which arrive in the same main loop iteration are merged, and only the
+ * latest of them is emitted; the number of discarded states can be read
+ * with signon_auth_session_get_dropped_state_changes(). The last state is
+ * always emitted before the reply to signon_auth_session_process() is
+ * delivered.
+ *
+ * Since: 2.1
+ */
+void
+signon_auth_session_set_coalesce_state_changes (SignonAuthSession *self,
+                                                gboolean coalesce)
+{
+    g_return_if_fail (SIGNON_IS_AUTH_SESSION (self));
+
+    self->coalesce_states = coalesce;
+    if (!coalesce)
+        auth_session_flush_pending_state (self);
+}
+
+/**
+ * signon_auth_session_get_coalesce_state_changes:
+ * @self: the #SignonAuthSession.
+ *
+ * Get whether state changes are coalesced; see
+ * signon_auth_session_set_coalesce_state_changes().
+ *
+ * Returns: %TRUE if state changes are coalesced, %FALSE otherwise.
+ *
+ * Since: 2.1
+ */
+gboolean
+signon_auth_session_get_coalesce_state_changes (SignonAuthSession *self)
+{
+    g_return_val_if_fail (SIGNON_IS_AUTH_SESSION (self), FALSE);
+
+    return self->coalesce_states;
+}
+
+/**
+ * signon_auth_session_get_dropped_state_changes:
+ * @self: the #SignonAuthSession.
+ *
+ * Get the number of intermediate state changes which were not emitted
+ * because they were superseded by a later state, while state changes were
+ * being coalesced.
+ *
+ * Returns: the number of state changes dropped so far.
+ *
+ * Since: 2.1
+ */
+guint
+signon_auth_session_get_dropped_state_changes (SignonAuthSession *self)
+{
+    g_return_val_if_fail (SIGNON_IS_AUTH_SESSION (self), 0);
+
+    return self->dropped_states;
+}
+
+/**
+ * signon_auth_session_set_fd_passing_threshold:
+ * @self: the #SignonAuthSession.
+ * @threshold: the size in bytes from which session data values are passed
+ * as file descriptors, or 0 to disable file descriptor passing.
+ *
+ * Session data values are normally copied into the D-Bus messages
+ * exchanged with signond. When @threshold is not 0, the session offers
+ * signond to exchange large values as sealed memory files instead: if
+ * signond accepts, values whose serialized size is at least @threshold
+ * are passed as file descriptors, and values received this way in the
+ * reply of signon_auth_session_process() are mapped in memory without
+ * being copied. If signond does not support this, or file descriptors
+ * cannot be created, values are transferred inline.
+ *
+ * File descriptor passing is disabled by default.
+ *
+ * Since: 2.1
+ */
+void
+signon_auth_session_set_fd_passing_threshold (SignonAuthSession *self,
+                                              gsize threshold)
+{
+    g_return_if_fail (SIGNON_IS_AUTH_SESSION (self));
+
+    self->fd_threshold = threshold;
+}
+
+/**
+ * signon_auth_session_get_fd_passing_threshold:
+ * @self: the #SignonAuthSession.
+ *
+ * Get the size from which session data values are passed as file
+ * descriptors; see signon_auth_session_set_fd_passing_threshold().
+ *
+ * Returns: the threshold in bytes, or 0 if file descriptor passing is
+ * disabled.
+ *
+ * Since: 2.1
+ */
+gsize
+signon_auth_session_get_fd_passing_threshold (SignonAuthSession *self)
+{
+    g_return_val_if_fail (SIGNON_IS_AUTH_SESSION (self), 0);
+
+    return self->fd_threshold;
+}
+
+void
+signon_auth_session_set_allowed_mechanisms (SignonAuthSession *self,
+                                            const gchar * const *mechanisms)
+{
+    g_return_if_fail (SIGNON_IS_AUTH_SESSION (self));
+
+    g_strfreev (self->allowed_mechanisms);
+    self->allowed_mechanisms = g_strdupv ((gchar **)mechanisms);
+}
+
 /**
  * signon_auth_session_get_method:
  * @self: the #SignonAuthSession.
@@ -442,6 +857,9 @@ signon_auth_session_get_method (SignonAuthSession *self)
  * @session_data can be used to add additional authentication parameters to the
  * session, or to override the parameters otherwise taken from the identity.
  *
+ * If the identity is known not to allow @mechanism, the operation fails with
+ * %SIGNON_ERROR_METHOD_OR_MECHANISM_NOT_ALLOWED without contacting signond.
+ *
  * Since: 1.8
  */
 void
@@ -459,8 +877,10 @@ signon_auth_session_process (SignonAuthSession *self,
     g_return_if_fail (session_data != NULL);
 
     task = g_task_new (self, cancellable, callback, user_data);
+    g_task_set_source_tag (task, signon_auth_session_process);
 
     process_data = g_slice_new0 (AuthSessionProcessData);
+    process_data->timings = auth_session_timings_new ();
     process_data->session_data = g_variant_ref_sink (session_data);
     process_data->mechanism = g_strdup (mechanism);
     g_task_set_task_data (task, process_data, (GDestroyNotify)auth_session_process_data_free);
@@ -473,6 +893,59 @@ signon_auth_session_process (SignonAuthSession *self,
                                   task);
 }
 
+/**
+ * signon_auth_session_process_with_mechanisms:
+ * @self: the #SignonAuthSession.
+ * @session_data: (transfer floating): a dictionary of parameters.
+ * @mechanisms: (array zero-terminated=1): the candidate authentication
+ * mechanisms, in order of preference.
+ * @cancellable: (allow-none): optional #GCancellable object, %NULL to ignore.
+ * @callback: a callback which will be called when the
+ * authentication reply is available.
+ * @user_data: user data to be passed to the callback.
+ *
+ * Like signon_auth_session_process(), but lets the library choose the
+ * mechanism: the first of @mechanisms which is known to be supported by the
+ * plugin and allowed by the identity is used. The choice is made without
+ * contacting signond; if nothing is known about the session's mechanisms, the
+ * first candidate is used.
+ *
+ * The result must be collected with signon_auth_session_process_finish().
+ *
+ * Since: 2.1
+ */
+void
+signon_auth_session_process_with_mechanisms (SignonAuthSession *self,
+                                             GVariant *session_data,
+                                             const gchar * const *mechanisms,
+                                             GCancellable *cancellable,
+                                             GAsyncReadyCallback callback,
+                                             gpointer user_data)
+{
+    AuthSessionProcessData *process_data;
+    GTask *task = NULL;
+
+    g_return_if_fail (SIGNON_IS_AUTH_SESSION (self));
+    g_return_if_fail (session_data != NULL);
+    g_return_if_fail (mechanisms != NULL && mechanisms[0] != NULL);
+
+    task = g_task_new (self, cancellable, callback, user_data);
+    g_task_set_source_tag (task, signon_auth_session_process);
+
+    process_data = g_slice_new0 (AuthSessionProcessData);
+    process_data->timings = auth_session_timings_new ();
+    process_data->session_data = g_variant_ref_sink (session_data);
+    process_data->mechanisms = g_strdupv ((gchar **)mechanisms);
+    g_task_set_task_data (task, process_data, (GDestroyNotify)auth_session_process_data_free);
+
+    self->busy = TRUE;
+
+    signon_proxy_call_when_ready (self,
+                                  auth_session_object_quark(),
+                                  auth_session_process_ready_cb,
+                                  task);
+}
+
 /**
  * signon_auth_session_process_finish:
  * @self: the #SignonAuthSession.
@@ -496,6 +969,537 @@ signon_auth_session_process_finish (SignonAuthSession *self, GAsyncResult *res,
     return g_task_propagate_pointer (G_TASK (res), error);
 }
 
+/**
+ * signon_auth_session_process_sync:
+ * @self: the #SignonAuthSession.
+ * @session_data: (transfer floating): a dictionary of parameters.
+ * @mechanism: the authentication mechanism to be used.
+ * @cancellable: (allow-none): optional #GCancellable object, %NULL to ignore.
+ * @error: return location for error, or %NULL.
+ *
+ * Synchronous version of signon_auth_session_process(). It doesn't need a
+ * main loop to be running, so it can be called from worker threads, as long
+ * as @self was created by the calling thread. The
+ * #SignonAuthSession::state-changed signal is emitted from within this call.
+ *
+ * Returns: a #GVariant of type %G_VARIANT_TYPE_VARDICT containing the
+ * authentication reply.
+ *
+ * Since: 2.1
+ */
+GVariant *
+signon_auth_session_process_sync (SignonAuthSession *self,
+                                  GVariant *session_data,
+                                  const gchar *mechanism,
+                                  GCancellable *cancellable,
+                                  GError **error)
+{
+    SignonSyncCall call;
+    GAsyncResult *res;
+    GVariant *reply;
+
+    g_return_val_if_fail (SIGNON_IS_AUTH_SESSION (self), NULL);
+    g_return_val_if_fail (self->owner_thread == g_thread_self (), NULL);
+    g_return_val_if_fail (session_data != NULL, NULL);
+
+    signon_sync_call_init (&call);
+    signon_auth_session_process (self, session_data, mechanism, cancellable,
+                                 signon_sync_call_done_cb, &call);
+    res = signon_sync_call_wait (&call);
+
+    reply = signon_auth_session_process_finish (self, res, error);
+    g_object_unref (res);
+    return reply;
+}
+
+/**
+ * signon_auth_session_process_get_timings:
+ * @self: the #SignonAuthSession.
+ * @res: A #GAsyncResult obtained from the #GAsyncReadyCallback passed to
+ * signon_auth_session_process() or
+ * signon_auth_session_process_with_mechanisms().
+ *
+ * Get the timing breakdown of a process request. This can be called before
+ * or after signon_auth_session_process_finish(), as long as @res is alive.
+ *
+ * Returns: (transfer full): a #SignonAuthSessionTimings; release it with
+ * signon_auth_session_timings_unref().
+ *
+ * Since: 2.1
+ */
+SignonAuthSessionTimings *
+signon_auth_session_process_get_timings (SignonAuthSession *self,
+                                         GAsyncResult *res)
+{
+    AuthSessionProcessData *process_data;
+
+    g_return_val_if_fail (SIGNON_IS_AUTH_SESSION (self), NULL);
+    g_return_val_if_fail (g_task_is_valid (res, self), NULL);
+    g_return_val_if_fail (g_task_get_source_tag (G_TASK (res)) ==
+                          signon_auth_session_process, NULL);
+
+    process_data = g_task_get_task_data (G_TASK (res));
+    return signon_auth_session_timings_ref (process_data->timings);
+}
+
+/**
+ * signon_auth_session_timings_ref:
+ * @timings: the #SignonAuthSessionTimings.
+ *
+ * Increment the reference count of @timings.
+ *
+ * Returns: (transfer full): @timings.
+ *
+ * Since: 2.1
+ */
+SignonAuthSessionTimings *
+signon_auth_session_timings_ref (SignonAuthSessionTimings *timings)
+{
+    g_return_val_if_fail (timings != NULL, NULL);
+
+    g_atomic_int_inc (&timings->ref_count);
+    return timings;
+}
+
+/**
+ * signon_auth_session_timings_unref:
+ * @timings: the #SignonAuthSessionTimings.
+ *
+ * Decrement the reference count of @timings; when it reaches zero, @timings
+ * is freed.
+ *
+ * Since: 2.1
+ */
+void
+signon_auth_session_timings_unref (SignonAuthSessionTimings *timings)
+{
+    g_return_if_fail (timings != NULL);
+
+    if (g_atomic_int_dec_and_test (&timings->ref_count))
+    {
+        g_array_unref (timings->transitions);
+        g_slice_free (SignonAuthSessionTimings, timings);
+    }
+}
+
+/**
+ * signon_auth_session_timings_get_start_time:
+ * @timings: the #SignonAuthSessionTimings.
+ *
+ * Returns: the monotonic time at which the request was issued.
+ *
+ * Since: 2.1
+ */
+gint64
+signon_auth_session_timings_get_start_time (SignonAuthSessionTimings *timings)
+{
+    g_return_val_if_fail (timings != NULL, 0);
+    return timings->start_time;
+}
+
+/**
+ * signon_auth_session_timings_get_ready_time:
+ * @timings: the #SignonAuthSessionTimings.
+ *
+ * The time elapsed between the start time and the ready time is spent
+ * waiting for the remote session object to be available.
+ *
+ * Returns: the monotonic time at which the session became ready to send
+ * the request, or 0 if that never happened.
+ *
+ * Since: 2.1
+ */
+gint64
+signon_auth_session_timings_get_ready_time (SignonAuthSessionTimings *timings)
+{
+    g_return_val_if_fail (timings != NULL, 0);
+    return timings->ready_time;
+}
+
+/**
+ * signon_auth_session_timings_get_sent_time:
+ * @timings: the #SignonAuthSessionTimings.
+ *
+ * Returns: the monotonic time at which the request was sent to signond, or
+ * 0 if it was never sent.
+ *
+ * Since: 2.1
+ */
+gint64
+signon_auth_session_timings_get_sent_time (SignonAuthSessionTimings *timings)
+{
+    g_return_val_if_fail (timings != NULL, 0);
+    return timings->sent_time;
+}
+
+/**
+ * signon_auth_session_timings_get_reply_time:
+ * @timings: the #SignonAuthSessionTimings.
+ *
+ * Returns: the monotonic time at which the reply from signond was received,
+ * or 0 if no reply was received.
+ *
+ * Since: 2.1
+ */
+gint64
+signon_auth_session_timings_get_reply_time (SignonAuthSessionTimings *timings)
+{
+    g_return_val_if_fail (timings != NULL, 0);
+    return timings->reply_time;
+}
+
+/**
+ * signon_auth_session_timings_get_n_transitions:
+ * @timings: the #SignonAuthSessionTimings.
+ *
+ * Get the number of state transitions notified by signond while serving the
+ * request. Transitions are recorded even if the
+ * #SignonAuthSession::state-changed signal was coalesced.
+ *
+ * Returns: the number of recorded state transitions.
+ *
+ * Since: 2.1
+ */
+guint
+signon_auth_session_timings_get_n_transitions (SignonAuthSessionTimings *timings)
+{
+    g_return_val_if_fail (timings != NULL, 0);
+    return timings->transitions->len;
+}
+
+/**
+ * signon_auth_session_timings_get_transition:
+ * @timings: the #SignonAuthSessionTimings.
+ * @index: the index of the transition, lower than
+ * signon_auth_session_timings_get_n_transitions().
+ * @time: (out) (allow-none): location for the monotonic time of the
+ * transition.
+ *
+ * Get the @index-th state transition.
+ *
+ * Returns: the state entered with the transition.
+ *
+ * Since: 2.1
+ */
+SignonAuthSessionState
+signon_auth_session_timings_get_transition (SignonAuthSessionTimings *timings,
+                                            guint index,
+                                            gint64 *time)
+{
+    AuthSessionTransition *transition;
+
+    g_return_val_if_fail (timings != NULL,
+                          SIGNON_AUTH_SESSION_STATE_NOT_STARTED);
+    g_return_val_if_fail (index < timings->transitions->len,
+                          SIGNON_AUTH_SESSION_STATE_NOT_STARTED);
+
+    transition = &g_array_index (timings->transitions,
+                                 AuthSessionTransition, index);
+    if (time != NULL)
+        *time = transition->time;
+    return transition->state;
+}
+
+/**
+ * signon_auth_session_timings_get_state_duration:
+ * @timings: the #SignonAuthSessionTimings.
+ * @state: a #SignonAuthSessionState.
+ *
+ * Get the total time spent in @state, that is the sum of the intervals
+ * between each transition to @state and the following transition (or the
+ * reply, for the last one).
+ *
+ * Returns: the time spent in @state, in microseconds.
+ *
+ * Since: 2.1
+ */
+gint64
+signon_auth_session_timings_get_state_duration (SignonAuthSessionTimings *timings,
+                                                SignonAuthSessionState state)
+{
+    AuthSessionTransition *transitions;
+    gint64 duration = 0;
+    gint64 end;
+    guint i;
+
+    g_return_val_if_fail (timings != NULL, 0);
+
+    transitions = (AuthSessionTransition *)timings->transitions->data;
+    for (i = 0; i < timings->transitions->len; i++)
+    {
+        if (transitions[i].state != state) continue;
+
+        end = (i + 1 < timings->transitions->len) ?
+            transitions[i + 1].time : timings->reply_time;
+        if (end != 0)
+            duration += end - transitions[i].time;
+    }
+
+    return duration;
+}
+
+static void
+auth_session_query_available_mechanisms_reply (GObject *object,
+                                               GAsyncResult *res,
+                                               gpointer userdata)
+{
+    SignonAuthSession *self;
+    SsoAuthSession *proxy = SSO_AUTH_SESSION (object);
+    GTask *task = userdata;
+    gchar **mechanisms = NULL;
+    GError *error = NULL;
+
+    g_return_if_fail (task != NULL);
+
+    self = SIGNON_AUTH_SESSION (g_task_get_source_object (task));
+
+    if (sso_auth_session_call_query_available_mechanisms_finish (proxy,
+                                                                 &mechanisms,
+                                                                 res,
+                                                                 &error))
+    {
+        g_strfreev (self->available_mechanisms);
+        self->available_mechanisms = mechanisms;
+        sso_auth_service_cache_mechanisms (self->method_name,
+                                           (const gchar * const *)mechanisms);
+
+        if (g_task_get_source_tag (task) == signon_auth_session_prepare)
+        {
+            g_task_return_boolean (task, TRUE);
+        }
+        else
+        {
+            g_task_return_pointer (task,
+                                   auth_session_filter_mechanisms (self,
+                                       (const gchar * const *)mechanisms,
+                                       g_task_get_task_data (task)),
+                                   (GDestroyNotify) g_strfreev);
+        }
+    }
+    else
+    {
+        g_task_return_error (task, error);
+    }
+
+    g_object_unref (task);
+}
+
+static void
+auth_session_prepare_ready_cb (gpointer object, const GError *error,
+                               gpointer user_data)
+{
+    SignonAuthSession *self = SIGNON_AUTH_SESSION (object);
+    GTask *task = G_TASK (user_data);
+    const gchar *all_mechanisms[] = { NULL };
+
+    g_return_if_fail (self != NULL);
+
+    if (error != NULL)
+    {
+        DEBUG ("AuthSessionError: %s", error->message);
+        g_task_return_error (task, g_error_copy (error));
+        g_object_unref (task);
+        return;
+    }
+
+    if (g_task_return_error_if_cancelled (task))
+    {
+        g_object_unref (task);
+        return;
+    }
+
+    /* The mechanisms might be known from the cache, but only the remote call
+     * makes signond load the plugin */
+    if (!GPOINTER_TO_INT (g_task_get_task_data (task)))
+    {
+        g_task_return_boolean (task, TRUE);
+        g_object_unref (task);
+        return;
+    }
+
+    /* An empty list of wanted mechanisms makes signond return all the
+     * mechanisms supported by the plugin, which it must load to answer. */
+    sso_auth_session_call_query_available_mechanisms (self->proxy,
+                                                      all_mechanisms,
+                                                      g_task_get_cancellable (task),
+                                                      auth_session_query_available_mechanisms_reply,
+                                                      task);
+}
+
+/**
+ * signon_auth_session_prepare:
+ * @self: the #SignonAuthSession.
+ * @load_plugin: whether signond should also load the authentication plugin.
+ * @cancellable: (allow-none): optional #GCancellable object, %NULL to ignore.
+ * @callback: a callback which will be called when the session is ready.
+ * @user_data: user data to be passed to the callback.
+ *
+ * Prepares the session for authentication ahead of time: the remote
+ * AuthSession object is created and the D-Bus proxy for it is set up, so that
+ * the first call to signon_auth_session_process() does not have to pay for
+ * them. If @load_plugin is %TRUE, signond is also asked for the mechanisms
+ * supported by the session, which causes the authentication plugin to be
+ * loaded.
+ *
+ * Since: 2.1
+ */
+void
+signon_auth_session_prepare (SignonAuthSession *self,
+                             gboolean load_plugin,
+                             GCancellable *cancellable,
+                             GAsyncReadyCallback callback,
+                             gpointer user_data)
+{
+    GTask *task = NULL;
+
+    g_return_if_fail (SIGNON_IS_AUTH_SESSION (self));
+
+    task = g_task_new (self, cancellable, callback, user_data);
+    g_task_set_source_tag (task, signon_auth_session_prepare);
+    g_task_set_task_data (task, GINT_TO_POINTER (load_plugin), NULL);
+
+    signon_proxy_call_when_ready (self,
+                                  auth_session_object_quark(),
+                                  auth_session_prepare_ready_cb,
+                                  task);
+}
+
+/**
+ * signon_auth_session_prepare_finish:
+ * @self: the #SignonAuthSession.
+ * @res: A #GAsyncResult obtained from the #GAsyncReadyCallback passed to
+ * signon_auth_session_prepare().
+ * @error: return location for error, or %NULL.
+ *
+ * Collect the result of the signon_auth_session_prepare() operation.
+ *
+ * Returns: %TRUE if the session is ready to process requests, %FALSE
+ * otherwise.
+ *
+ * Since: 2.1
+ */
+gboolean
+signon_auth_session_prepare_finish (SignonAuthSession *self,
+                                    GAsyncResult *res,
+                                    GError **error)
+{
+    g_return_val_if_fail (SIGNON_IS_AUTH_SESSION (self), FALSE);
+    g_return_val_if_fail (g_task_is_valid (res, self), FALSE);
+
+    return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+static void
+auth_session_query_ready_cb (gpointer object, const GError *error,
+                             gpointer user_data)
+{
+    SignonAuthSession *self = SIGNON_AUTH_SESSION (object);
+    GTask *task = G_TASK (user_data);
+    const gchar *all_mechanisms[] = { NULL };
+
+    g_return_if_fail (self != NULL);
+
+    if (error != NULL)
+    {
+        DEBUG ("AuthSessionError: %s", error->message);
+        g_task_return_error (task, g_error_copy (error));
+        g_object_unref (task);
+        return;
+    }
+
+    if (g_task_return_error_if_cancelled (task))
+    {
+        g_object_unref (task);
+        return;
+    }
+
+    sso_auth_session_call_query_available_mechanisms (self->proxy,
+                                                      all_mechanisms,
+                                                      g_task_get_cancellable (task),
+                                                      auth_session_query_available_mechanisms_reply,
+                                                      task);
+}
+
+/**
+ * signon_auth_session_query_available_mechanisms:
+ * @self: the #SignonAuthSession.
+ * @wanted_mechanisms: (array zero-terminated=1) (allow-none): the mechanisms
+ * the client is interested in, or %NULL for all of them.
+ * @cancellable: (allow-none): optional #GCancellable object, %NULL to ignore.
+ * @callback: a callback which will be called when the mechanisms are known.
+ * @user_data: user data to be passed to the callback.
+ *
+ * Finds out which of @wanted_mechanisms can be used with this session: that
+ * is, the mechanisms which are supported by the authentication plugin and
+ * allowed by the identity the session was created from.
+ *
+ * Whenever possible, the result is computed locally, from the information
+ * cached by the identity and from the mechanisms previously returned by
+ * signon_auth_service_get_mechanisms() or signon_auth_session_prepare();
+ * otherwise signond is asked once, and its reply is cached.
+ *
+ * Since: 2.1
+ */
+void
+signon_auth_session_query_available_mechanisms (SignonAuthSession *self,
+                                                const gchar * const *wanted_mechanisms,
+                                                GCancellable *cancellable,
+                                                GAsyncReadyCallback callback,
+                                                gpointer user_data)
+{
+    const gchar * const *supported;
+    GTask *task = NULL;
+
+    g_return_if_fail (SIGNON_IS_AUTH_SESSION (self));
+
+    task = g_task_new (self, cancellable, callback, user_data);
+    g_task_set_source_tag (task, signon_auth_session_query_available_mechanisms);
+
+    supported = auth_session_get_supported_mechanisms (self);
+    if (supported != NULL)
+    {
+        g_task_return_pointer (task,
+                               auth_session_filter_mechanisms (self, supported,
+                                                               wanted_mechanisms),
+                               (GDestroyNotify) g_strfreev);
+        g_object_unref (task);
+        return;
+    }
+
+    g_task_set_task_data (task, g_strdupv ((gchar **)wanted_mechanisms),
+                          (GDestroyNotify) g_strfreev);
+    signon_proxy_call_when_ready (self,
+                                  auth_session_object_quark(),
+                                  auth_session_query_ready_cb,
+                                  task);
+}
+
+/**
+ * signon_auth_session_query_available_mechanisms_finish:
+ * @self: the #SignonAuthSession.
+ * @res: A #GAsyncResult obtained from the #GAsyncReadyCallback passed to
+ * signon_auth_session_query_available_mechanisms().
+ * @error: return location for error, or %NULL.
+ *
+ * Collect the result of the signon_auth_session_query_available_mechanisms()
+ * operation.
+ *
+ * Returns: (array zero-terminated=1) (transfer full): the usable mechanisms,
+ * in the order in which they were requested.
+ *
+ * Since: 2.1
+ */
+gchar **
+signon_auth_session_query_available_mechanisms_finish (SignonAuthSession *self,
+                                                       GAsyncResult *res,
+                                                       GError **error)
+{
+    g_return_val_if_fail (SIGNON_IS_AUTH_SESSION (self), NULL);
+    g_return_val_if_fail (g_task_is_valid (res, self), NULL);
+
+    return g_task_propagate_pointer (G_TASK (res), error);
+}
+
 /**
  * signon_auth_session_cancel:
  * @self: the #SignonAuthSession.
@@ -542,6 +1546,7 @@ auth_session_get_object_path_reply (GObject *object, GAsyncResult *res,
     self = SIGNON_AUTH_SESSION (userdata);
 
     self->registering = FALSE;
+    g_clear_pointer (&self->registration_context, g_main_context_unref);
     if (!g_strcmp0(object_path, "") || error)
     {
         if (error)
@@ -560,9 +1565,13 @@ auth_session_get_object_path_reply (GObject *object, GAsyncResult *res,
         connection = g_dbus_proxy_get_connection ((GDBusProxy *)proxy);
         bus_name = g_dbus_proxy_get_name ((GDBusProxy *)proxy);
 
+        /* The AuthSession interface has no properties: don't spend a
+         * round trip fetching them. The signals come from the auth
+         * service's dispatcher. */
         self->proxy =
             sso_auth_session_proxy_new_sync (connection,
-                                             G_DBUS_PROXY_FLAGS_NONE,
+                                             G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                             G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
                                              bus_name,
                                              object_path,
                                              self->cancellable,
@@ -571,23 +1580,19 @@ auth_session_get_object_path_reply (GObject *object, GAsyncResult *res,
         {
             g_warning ("Failed to initialize AuthSession proxy: %s",
                        proxy_error->message);
-            g_clear_error (&proxy_error);
+            error = proxy_error;
+        }
+        else
+        {
+            g_dbus_proxy_set_default_timeout ((GDBusProxy *)self->proxy,
+                                              G_MAXINT);
+
+            self->signal_watch =
+                sso_auth_service_watch_object (self->auth_service_proxy,
+                                               object_path,
+                                               auth_session_signal_cb,
+                                               self);
         }
-
-        g_dbus_proxy_set_default_timeout ((GDBusProxy *)self->proxy,
-                                          G_MAXINT);
-
-        self->signal_state_changed =
-            g_signal_connect (self->proxy,
-                              "state-changed",
-                              G_CALLBACK (auth_session_state_changed_cb),
-                              self);
-
-        self->signal_unregistered =
-           g_signal_connect (self->proxy,
-                             "unregistered",
-                             G_CALLBACK (auth_session_remote_object_destroyed_cb),
-                             self);
     }
 
     DEBUG ("Object path received: %s", object_path);
@@ -595,32 +1600,91 @@ auth_session_get_object_path_reply (GObject *object, GAsyncResult *res,
     signon_proxy_set_ready (self, auth_session_object_quark (), error);
 }
 
-static void
-auth_session_state_changed_cb (GDBusProxy *proxy,
-                               gint state,
-                               gchar *message,
-                               gpointer user_data)
+static gboolean
+auth_session_emit_pending_state (gpointer user_data)
 {
-    SignonAuthSession *self;
+    SignonAuthSession *self = SIGNON_AUTH_SESSION (user_data);
+    gchar *message;
 
-    g_return_if_fail (SIGNON_IS_AUTH_SESSION (user_data));
+    g_clear_pointer (&self->state_idle_source, g_source_unref);
 
-    self = SIGNON_AUTH_SESSION (user_data);
+    message = self->pending_message;
+    self->pending_message = NULL;
     g_signal_emit (self,
                    auth_session_signals[STATE_CHANGED],
                    0,
-                   state,
+                   self->pending_state,
                    message);
+    g_free (message);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+auth_session_flush_pending_state (SignonAuthSession *self)
+{
+    if (self->state_idle_source == NULL)
+        return;
+
+    g_source_destroy (self->state_idle_source);
+    auth_session_emit_pending_state (self);
 }
 
-static void auth_session_remote_object_destroyed_cb (GDBusProxy *proxy,
-                                                     gpointer user_data)
+static void
+auth_session_notify_state (SignonAuthSession *self,
+                           gint state,
+                           const gchar *message)
 {
-    SignonAuthSession *self;
+    GMainContext *context;
 
-    g_return_if_fail (SIGNON_IS_AUTH_SESSION (user_data));
+    if (!self->coalesce_states)
+    {
+        g_signal_emit (self,
+                       auth_session_signals[STATE_CHANGED],
+                       0,
+                       state,
+                       message);
+        return;
+    }
 
-    self = SIGNON_AUTH_SESSION (user_data);
+    if (self->state_idle_source != NULL)
+    {
+        /* A state is already waiting to be delivered: replace it */
+        self->dropped_states++;
+        g_free (self->pending_message);
+    }
+    else
+    {
+        self->state_idle_source = g_idle_source_new ();
+        g_source_set_priority (self->state_idle_source, G_PRIORITY_DEFAULT);
+        g_source_set_callback (self->state_idle_source,
+                               auth_session_emit_pending_state,
+                               self, NULL);
+        context = g_main_context_ref_thread_default ();
+        g_source_attach (self->state_idle_source, context);
+        g_main_context_unref (context);
+    }
+
+    self->pending_state = state;
+    self->pending_message = g_strdup (message);
+}
+
+static void
+auth_session_state_changed (SignonAuthSession *self,
+                            gint state,
+                            const gchar *message)
+{
+    SignonAuthSessionTimings *timings = g_queue_peek_head (&self->sent_timings);
+
+    if (timings != NULL)
+        auth_session_timings_add_transition (timings, state);
+
+    auth_session_notify_state (self, state, message);
+}
+
+static void
+auth_session_remote_object_destroyed (SignonAuthSession *self)
+{
     DEBUG ("remote object unregistered");
     if (self->proxy)
         destroy_proxy (self);
@@ -628,6 +1692,31 @@ static void auth_session_remote_object_destroyed_cb (GDBusProxy *proxy,
     signon_proxy_set_not_ready (self);
 }
 
+static void
+auth_session_signal_cb (const gchar *signal_name,
+                        GVariant *parameters,
+                        gpointer user_data)
+{
+    SignonAuthSession *self;
+
+    g_return_if_fail (SIGNON_IS_AUTH_SESSION (user_data));
+
+    self = SIGNON_AUTH_SESSION (user_data);
+    if (g_strcmp0 (signal_name, "stateChanged") == 0 &&
+        g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(is)")))
+    {
+        const gchar *message;
+        gint state;
+
+        g_variant_get (parameters, "(i&s)", &state, &message);
+        auth_session_state_changed (self, state, message);
+    }
+    else if (g_strcmp0 (signal_name, "unregistered") == 0)
+    {
+        auth_session_remote_object_destroyed (self);
+    }
+}
+
 static gboolean
 auth_session_priv_init (SignonAuthSession *self, guint id,
                         const gchar *method_name, GError **err)
@@ -678,17 +1767,35 @@ auth_session_check_remote_object(SignonAuthSession *self)
 
     g_return_if_fail (SSO_IS_AUTH_SERVICE (self->auth_service_proxy));
 
+    if (self->registering && signon_sync_call_in_progress () &&
+        self->registration_context != g_main_context_get_thread_default ())
+    {
+        /* The reply would be dispatched to a context which this thread is
+         * not running: register again on the context of the call. */
+        DEBUG ("Restarting the registration");
+        g_cancellable_cancel (self->registration_cancellable);
+        g_object_unref (self->registration_cancellable);
+        self->registration_cancellable = g_cancellable_new ();
+        self->registering = FALSE;
+    }
+
     if (!self->registering)
     {
+        GMainContext *context = signon_registration_context_push ();
+
         self->registering = TRUE;
+        g_clear_pointer (&self->registration_context, g_main_context_unref);
+        self->registration_context = g_main_context_ref_thread_default ();
         sso_auth_service_call_get_auth_session_object_path (
             self->auth_service_proxy,
             self->id,
             "*",
             self->method_name,
-            self->cancellable,
+            self->registration_cancellable,
             auth_session_get_object_path_reply,
             self);
+
+        signon_registration_context_pop (context);
     }
 }
 
@@ -108,6 +108,62 @@ typedef enum {
  */
 #define SIGNON_SESSION_DATA_RENEW_TOKEN   "RenewToken"
 
+/**
+ * SignonAuthSessionState:
+ * @SIGNON_AUTH_SESSION_STATE_NOT_STARTED: No message.
+ * @SIGNON_AUTH_SESSION_STATE_RESOLVING_HOST: Resolving remote server host
+ * name.
+ * @SIGNON_AUTH_SESSION_STATE_CONNECTING: Connecting to remote server.
+ * @SIGNON_AUTH_SESSION_STATE_SENDING_DATA: Sending data to remote server.
+ * @SIGNON_AUTH_SESSION_STATE_WAITING_REPLY: Waiting reply from remote server.
+ * @SIGNON_AUTH_SESSION_STATE_USER_PENDING: Waiting response from user.
+ * @SIGNON_AUTH_SESSION_STATE_UI_REFRESHING: Refreshing UI request.
+ * @SIGNON_AUTH_SESSION_STATE_PROCESS_PENDING: Waiting another process to
+ * start.
+ * @SIGNON_AUTH_SESSION_STATE_STARTED: Authentication session is started.
+ * @SIGNON_AUTH_SESSION_STATE_PROCESS_CANCELING: Canceling current process.
+ * @SIGNON_AUTH_SESSION_STATE_PROCESS_DONE: Authentication completed.
+ * @SIGNON_AUTH_SESSION_STATE_CUSTOM: Custom message.
+ * @SIGNON_AUTH_SESSION_STATE_LAST: Placeholder, not a valid state.
+ *
+ * The states reported by the #SignonAuthSession::state-changed signal.
+ *
+ * Since: 2.1
+ */
+typedef enum {
+    SIGNON_AUTH_SESSION_STATE_NOT_STARTED = 0,
+    SIGNON_AUTH_SESSION_STATE_RESOLVING_HOST,
+    SIGNON_AUTH_SESSION_STATE_CONNECTING,
+    SIGNON_AUTH_SESSION_STATE_SENDING_DATA,
+    SIGNON_AUTH_SESSION_STATE_WAITING_REPLY,
+    SIGNON_AUTH_SESSION_STATE_USER_PENDING,
+    SIGNON_AUTH_SESSION_STATE_UI_REFRESHING,
+    SIGNON_AUTH_SESSION_STATE_PROCESS_PENDING,
+    SIGNON_AUTH_SESSION_STATE_STARTED,
+    SIGNON_AUTH_SESSION_STATE_PROCESS_CANCELING,
+    SIGNON_AUTH_SESSION_STATE_PROCESS_DONE,
+    SIGNON_AUTH_SESSION_STATE_CUSTOM,
+    SIGNON_AUTH_SESSION_STATE_LAST
+} SignonAuthSessionState;
+
+typedef struct _SignonAuthSessionTimings SignonAuthSessionTimings;
+
+#define SIGNON_TYPE_AUTH_SESSION_TIMINGS signon_auth_session_timings_get_type ()
+GType signon_auth_session_timings_get_type (void) G_GNUC_CONST;
+
+SignonAuthSessionTimings *signon_auth_session_timings_ref (SignonAuthSessionTimings *timings);
+void signon_auth_session_timings_unref (SignonAuthSessionTimings *timings);
+
+gint64 signon_auth_session_timings_get_start_time (SignonAuthSessionTimings *timings);
+gint64 signon_auth_session_timings_get_ready_time (SignonAuthSessionTimings *timings);
+gint64 signon_auth_session_timings_get_sent_time (SignonAuthSessionTimings *timings);
+gint64 signon_auth_session_timings_get_reply_time (SignonAuthSessionTimings *timings);
+guint signon_auth_session_timings_get_n_transitions (SignonAuthSessionTimings *timings);
+SignonAuthSessionState signon_auth_session_timings_get_transition (SignonAuthSessionTimings *timings,
+                                                                   guint index,
+                                                                   gint64 *time);
+gint64 signon_auth_session_timings_get_state_duration (SignonAuthSessionTimings *timings,
+                                                       SignonAuthSessionState state);
 
 #define SIGNON_TYPE_AUTH_SESSION signon_auth_session_get_type ()
 G_DECLARE_FINAL_TYPE (SignonAuthSession, signon_auth_session, SIGNON, AUTH_SESSION, GObject)
@@ -124,12 +180,52 @@ void signon_auth_session_process (SignonAuthSession *self,
                                   GCancellable *cancellable,
                                   GAsyncReadyCallback callback,
                                   gpointer user_data);
+void signon_auth_session_process_with_mechanisms (SignonAuthSession *self,
+                                                  GVariant *session_data,
+                                                  const gchar * const *mechanisms,
+                                                  GCancellable *cancellable,
+                                                  GAsyncReadyCallback callback,
+                                                  gpointer user_data);
 GVariant *signon_auth_session_process_finish (SignonAuthSession *self,
                                               GAsyncResult *res,
                                               GError **error);
+GVariant *signon_auth_session_process_sync (SignonAuthSession *self,
+                                            GVariant *session_data,
+                                            const gchar *mechanism,
+                                            GCancellable *cancellable,
+                                            GError **error);
+SignonAuthSessionTimings *signon_auth_session_process_get_timings (SignonAuthSession *self,
+                                                                   GAsyncResult *res);
+
+void signon_auth_session_query_available_mechanisms (SignonAuthSession *self,
+                                                     const gchar * const *wanted_mechanisms,
+                                                     GCancellable *cancellable,
+                                                     GAsyncReadyCallback callback,
+                                                     gpointer user_data);
+gchar **signon_auth_session_query_available_mechanisms_finish (SignonAuthSession *self,
+                                                               GAsyncResult *res,
+                                                               GError **error);
 
 void signon_auth_session_cancel(SignonAuthSession *self);
 
+void signon_auth_session_set_coalesce_state_changes (SignonAuthSession *self,
+                                                     gboolean coalesce);
+gboolean signon_auth_session_get_coalesce_state_changes (SignonAuthSession *self);
+guint signon_auth_session_get_dropped_state_changes (SignonAuthSession *self);
+
+void signon_auth_session_set_fd_passing_threshold (SignonAuthSession *self,
+                                                   gsize threshold);
+gsize signon_auth_session_get_fd_passing_threshold (SignonAuthSession *self);
+
+void signon_auth_session_prepare (SignonAuthSession *self,
+                                  gboolean load_plugin,
+                                  GCancellable *cancellable,
+                                  GAsyncReadyCallback callback,
+                                  gpointer user_data);
+gboolean signon_auth_session_prepare_finish (SignonAuthSession *self,
+                                             GAsyncResult *res,
+                                             GError **error);
+
 G_END_DECLS
 
 #endif //SIGNONAUTHSESSIONIMPL_H_
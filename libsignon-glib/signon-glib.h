@@ -31,6 +31,8 @@
 #include <libsignon-glib/signon-errors.h>
 #include <libsignon-glib/signon-identity-info.h>
 #include <libsignon-glib/signon-identity.h>
+#include <libsignon-glib/signon-identity-monitor.h>
 #include <libsignon-glib/signon-security-context.h>
+#include <libsignon-glib/signon-session-data.h>
 
 #endif /* SIGNON_GLIB_H */
@@ -43,25 +43,264 @@ G_DEFINE_BOXED_TYPE (SignonIdentityInfo, signon_identity_info,
 static GVariant *
 signon_variant_new_string (const gchar *string)
 {
-    if (string == NULL || !g_utf8_validate (string, -1, NULL))
-        return g_variant_new_string ("");
+    /* The setters only accept valid UTF-8 */
+    return g_variant_new_string (string != NULL ? string : "");
+}
 
-    return g_variant_new_string (string);
+static gchar *
+identity_info_dup_utf8 (const gchar *field, const gchar *string)
+{
+    if (string != NULL && !g_utf8_validate (string, -1, NULL))
+    {
+        g_warning ("Ignoring invalid UTF-8 %s", field);
+        return NULL;
+    }
+
+    return g_strdup (string);
 }
 
-static const gchar *identity_info_get_secret (const SignonIdentityInfo *info)
+/*
+ * Marks @fields as changed, and drops the cached serialization of @part (if
+ * not %NULL) and of the whole dictionary: the other parts are still valid
+ * and will be reused by signon_identity_info_to_variant().
+ */
+static void
+identity_info_changed (SignonIdentityInfo *info, guint fields,
+                       GVariant **part)
 {
-    g_return_val_if_fail (info != NULL, NULL);
+    g_atomic_int_or (&info->data->changed_fields, fields);
+    if (part != NULL)
+        g_clear_pointer (part, g_variant_unref);
+    g_clear_pointer (&info->data->variant, g_variant_unref);
+}
 
-    return info->secret;
+/*
+ * The caches below are filled lazily, also on data shared by several copies
+ * which other threads may be serializing at the same time: whoever builds a
+ * cache first publishes it, and the others drop their own.
+ */
+static GVariant *
+identity_info_publish_variant (GVariant **cache, GVariant *variant)
+{
+    if (!g_atomic_pointer_compare_and_exchange (cache, NULL, variant))
+        g_variant_unref (variant);
+    return g_atomic_pointer_get (cache);
 }
 
-static void identity_info_set_id (SignonIdentityInfo *info, gint id)
+/*
+ * Method names and mechanisms come from signond and from the callers, and
+ * can be anything: they are copied rather than interned, since interned
+ * strings are never freed.
+ */
+typedef struct {
+    gchar *method;
+    gchar **mechanisms;
+} IdentityInfoMethod;
+
+static void
+identity_info_method_clear (IdentityInfoMethod *entry)
 {
-    g_return_if_fail (info != NULL);
-    g_return_if_fail (id >= 0);
+    g_free (entry->method);
+    g_strfreev (entry->mechanisms);
+}
+
+/* Binary search in the sorted methods array: returns whether @method is
+ * there, and its position or the one where it should be inserted. */
+static gboolean
+identity_info_find_method (const SignonIdentityInfoData *data,
+                           const gchar *method,
+                           guint *position)
+{
+    guint low = 0, high = data->methods != NULL ? data->methods->len : 0;
+
+    while (low < high)
+    {
+        guint middle = low + (high - low) / 2;
+        gint cmp = strcmp (method, g_array_index (data->methods,
+                                                  IdentityInfoMethod,
+                                                  middle).method);
+        if (cmp == 0)
+        {
+            *position = middle;
+            return TRUE;
+        }
+        else if (cmp < 0)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+
+    *position = low;
+    return FALSE;
+}
+
+static const IdentityInfoMethod *
+identity_info_lookup_method (const SignonIdentityInfoData *data,
+                             const gchar *method)
+{
+    guint position;
+
+    if (!identity_info_find_method (data, method, &position))
+        return NULL;
+
+    return &g_array_index (data->methods, IdentityInfoMethod, position);
+}
+
+/* Takes ownership of @mechanisms */
+static const IdentityInfoMethod *
+identity_info_insert_method (SignonIdentityInfoData *data,
+                             const gchar *method,
+                             gchar **mechanisms)
+{
+    IdentityInfoMethod entry;
+    guint position;
+
+    if (data->methods == NULL)
+    {
+        data->methods = g_array_new (FALSE, FALSE,
+                                     sizeof (IdentityInfoMethod));
+        g_array_set_clear_func (data->methods,
+                                (GDestroyNotify)identity_info_method_clear);
+    }
+
+    entry.method = g_strdup (method);
+    entry.mechanisms = mechanisms;
+
+    if (identity_info_find_method (data, method, &position))
+    {
+        IdentityInfoMethod *old = &g_array_index (data->methods,
+                                                  IdentityInfoMethod,
+                                                  position);
+        identity_info_method_clear (old);
+        *old = entry;
+    }
+    else
+    {
+        g_array_insert_val (data->methods, position, entry);
+    }
+
+    return &g_array_index (data->methods, IdentityInfoMethod, position);
+}
+
+static void
+identity_info_clear_methods (SignonIdentityInfoData *data)
+{
+    g_clear_pointer (&data->methods, g_array_unref);
+}
+
+static void
+identity_info_fill_methods_table (SignonIdentityInfo *info)
+{
+    GArray *methods = info->data->methods;
+    guint i;
+
+    g_hash_table_remove_all (info->methods_table);
+    for (i = 0; methods != NULL && i < methods->len; i++)
+    {
+        const IdentityInfoMethod *entry =
+            &g_array_index (methods, IdentityInfoMethod, i);
+        g_hash_table_insert (info->methods_table,
+                             (gpointer)entry->method, entry->mechanisms);
+    }
+}
+
+static SignonIdentityInfoData *
+identity_info_data_new ()
+{
+    SignonIdentityInfoData *data = g_slice_new0 (SignonIdentityInfoData);
+
+    data->ref_count = 1;
+    data->store_secret = FALSE;
+    /* Nothing of it is known to signond yet */
+    data->changed_fields = SIGNON_IDENTITY_INFO_FIELD_ALL;
+
+    return data;
+}
+
+static void
+identity_info_data_unref (SignonIdentityInfoData *data)
+{
+    if (!g_atomic_int_dec_and_test (&data->ref_count))
+        return;
+
+    g_free (data->username);
+    g_free (data->secret);
+    g_free (data->caption);
+
+    if (data->methods != NULL)
+        g_array_unref (data->methods);
+
+    g_strfreev (data->realms);
+
+    g_list_free_full (data->access_control_list, (GDestroyNotify)signon_security_context_free);
+
+    g_clear_pointer (&data->methods_variant, g_variant_unref);
+    g_clear_pointer (&data->acl_variant, g_variant_unref);
+    g_clear_pointer (&data->variant, g_variant_unref);
 
-    info->id = id;
+    g_slice_free (SignonIdentityInfoData, data);
+}
+
+static SignonIdentityInfoData *
+identity_info_data_dup (SignonIdentityInfoData *other)
+{
+    SignonIdentityInfoData *data = identity_info_data_new ();
+    GVariant *cache;
+    guint i;
+
+    data->id = other->id;
+    data->username = g_strdup (other->username);
+    data->secret = g_strdup (other->secret);
+    data->caption = g_strdup (other->caption);
+    data->store_secret = other->store_secret;
+
+    for (i = 0; other->methods != NULL && i < other->methods->len; i++)
+    {
+        const IdentityInfoMethod *entry =
+            &g_array_index (other->methods, IdentityInfoMethod, i);
+        identity_info_insert_method (data, entry->method,
+                                     g_strdupv (entry->mechanisms));
+    }
+
+    data->realms = g_strdupv (other->realms);
+    data->access_control_list =
+        g_list_copy_deep (other->access_control_list,
+                          (GCopyFunc)signon_security_context_copy, NULL);
+    data->type = other->type;
+
+    /* Same contents, same serialization; the caches of @other can be
+     * published by another thread meanwhile */
+    cache = g_atomic_pointer_get (&other->methods_variant);
+    if (cache != NULL)
+        data->methods_variant = g_variant_ref (cache);
+    cache = g_atomic_pointer_get (&other->acl_variant);
+    if (cache != NULL)
+        data->acl_variant = g_variant_ref (cache);
+    cache = g_atomic_pointer_get (&other->variant);
+    if (cache != NULL)
+        data->variant = g_variant_ref (cache);
+    data->changed_fields = g_atomic_int_get (&other->changed_fields);
+
+    return data;
+}
+
+/* To be called by the setters, before changing the contents of @info */
+static void
+identity_info_make_writable (SignonIdentityInfo *info)
+{
+    SignonIdentityInfoData *data;
+
+    if (g_atomic_int_get (&info->data->ref_count) == 1)
+        return;
+
+    data = identity_info_data_dup (info->data);
+    identity_info_data_unref (info->data);
+    info->data = data;
+
+    /* The table must not refer to the old data, which the other copies
+     * may free; the caller may still hold it, so refill it in place */
+    if (info->methods_table != NULL)
+        identity_info_fill_methods_table (info);
 }
 
 static void identity_methods_copy (gpointer key, gpointer value, gpointer user_data)
@@ -76,194 +315,438 @@ void signon_identity_info_set_methods (SignonIdentityInfo *info,
 {
     g_return_if_fail (info != NULL);
     g_return_if_fail (methods != NULL);
+    identity_info_make_writable (info);
 
     DEBUG("%s", G_STRFUNC);
 
-    if (info->methods)
-        g_hash_table_remove_all (info->methods);
-    else
-        info->methods = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                               g_free, (GDestroyNotify)g_strfreev);
+    identity_info_changed (info, SIGNON_IDENTITY_INFO_FIELD_METHODS,
+                           &info->data->methods_variant);
+    identity_info_clear_methods (info->data);
+    if (info->methods_table != NULL)
+        g_hash_table_remove_all (info->methods_table);
 
     g_hash_table_foreach ((GHashTable *)methods, identity_methods_copy, info);
 }
 
+static void
+identity_info_decode_methods (SignonIdentityInfo *info, GVariant *method_map)
+{
+    GVariantIter iter;
+    const gchar *method = NULL;
+    gchar **mechanisms = NULL;
+
+    g_variant_iter_init (&iter, method_map);
+    while (g_variant_iter_next (&iter, "{&s^as}", &method, &mechanisms))
+        identity_info_insert_method (info->data, method, mechanisms);
+}
+
+static GList *
+identity_info_decode_acl (GVariant *acl_var)
+{
+    GVariantIter iter;
+    GVariant *child;
+    GList *acl_list = NULL;
+
+    g_variant_iter_init (&iter, acl_var);
+    while ((child = g_variant_iter_next_value (&iter)))
+    {
+        SignonSecurityContext *ctx = signon_security_context_new_from_variant (child);
+        if (ctx != NULL)
+            acl_list = g_list_prepend (acl_list, ctx);
+
+        g_variant_unref (child);
+    }
+
+    return g_list_reverse (acl_list);
+}
+
 SignonIdentityInfo *
 signon_identity_info_new_from_variant (GVariant *variant)
 {
-    GVariant *method_map = NULL;
-    GVariant *acl_var = NULL;
+    SignonIdentityInfo *info;
+    GVariantIter iter;
+    const gchar *key;
+    GVariant *value;
+    gboolean has_secret = FALSE;
+    gboolean store_secret = FALSE;
 
     if (!variant)
         return NULL;
 
-    SignonIdentityInfo *info = signon_identity_info_new ();
-    GVariantDict dict;
-    g_variant_dict_init (&dict, variant);
+    info = signon_identity_info_new ();
 
     DEBUG("%s: ", G_STRFUNC);
 
-    g_variant_dict_lookup (&dict,
-                           "Id",
-                           "u",
-                           &info->id);
+    /* Walk the dictionary once; the keys are borrowed from @variant. As in
+     * a dictionary lookup, the last occurrence of a key wins. */
+    g_variant_iter_init (&iter, variant);
+    while (g_variant_iter_next (&iter, "{&sv}", &key, &value))
+    {
+        if (g_strcmp0 (key, "Id") == 0)
+        {
+            if (g_variant_is_of_type (value, G_VARIANT_TYPE_UINT32))
+                info->data->id = g_variant_get_uint32 (value);
+        }
+        else if (g_strcmp0 (key, "UserName") == 0)
+        {
+            if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING))
+            {
+                g_free (info->data->username);
+                info->data->username = g_variant_dup_string (value, NULL);
+            }
+        }
+        else if (g_strcmp0 (key, "Secret") == 0)
+        {
+            if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING))
+            {
+                g_free (info->data->secret);
+                info->data->secret = g_variant_dup_string (value, NULL);
+                has_secret = TRUE;
+            }
+        }
+        else if (g_strcmp0 (key, "StoreSecret") == 0)
+        {
+            if (g_variant_is_of_type (value, G_VARIANT_TYPE_BOOLEAN))
+                store_secret = g_variant_get_boolean (value);
+        }
+        else if (g_strcmp0 (key, "Caption") == 0)
+        {
+            if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING))
+            {
+                g_free (info->data->caption);
+                info->data->caption = g_variant_dup_string (value, NULL);
+            }
+        }
+        else if (g_strcmp0 (key, "Realms") == 0)
+        {
+            if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING_ARRAY))
+            {
+                g_strfreev (info->data->realms);
+                info->data->realms = g_variant_dup_strv (value, NULL);
+            }
+        }
+        else if (g_strcmp0 (key, "AuthMethods") == 0)
+        {
+            if (g_variant_is_of_type (value, (const GVariantType *) "a{sas}"))
+            {
+                identity_info_clear_methods (info->data);
+                identity_info_decode_methods (info, value);
+                /* Reused as is if the methods are stored back unchanged */
+                g_clear_pointer (&info->data->methods_variant, g_variant_unref);
+                info->data->methods_variant = g_variant_ref (value);
+            }
+        }
+        else if (g_strcmp0 (key, "ACL") == 0)
+        {
+            if (g_variant_is_of_type (value, (const GVariantType *) "a(ss)"))
+            {
+                g_list_free_full (info->data->access_control_list,
+                                  (GDestroyNotify)signon_security_context_free);
+                info->data->access_control_list = identity_info_decode_acl (value);
+                g_clear_pointer (&info->data->acl_variant, g_variant_unref);
+                if (info->data->access_control_list != NULL)
+                    info->data->acl_variant = g_variant_ref (value);
+            }
+        }
+        else if (g_strcmp0 (key, "Type") == 0)
+        {
+            if (g_variant_is_of_type (value, G_VARIANT_TYPE_UINT32))
+                info->data->type = g_variant_get_uint32 (value);
+        }
 
-    g_variant_dict_lookup (&dict,
-                           "UserName",
-                           "s",
-                           &info->username);
+        g_variant_unref (value);
+    }
 
-    if (g_variant_dict_lookup (&dict,
-                               "Secret",
-                               "s",
-                               &info->secret))
+    if (has_secret)
+        info->data->store_secret = store_secret;
+
+    info->data->changed_fields = 0;
+
+    return info;
+}
+
+/*
+ * signon_identity_info_mechanism_matches:
+ * @mechanisms: a %NULL-terminated array of mechanisms.
+ * @mechanism: a mechanism, or a space-separated list of mechanisms.
+ *
+ * Checks @mechanism against @mechanisms like signond does: either it's one
+ * of them, or it's a list (as in SASL) of which at least one is; signond
+ * then uses only that subset of the list.
+ *
+ * Returns: %TRUE if @mechanism matches @mechanisms.
+ */
+gboolean
+signon_identity_info_mechanism_matches (const gchar * const *mechanisms,
+                                        const gchar *mechanism)
+{
+    gchar **list;
+    gboolean matches = FALSE;
+    gint i;
+
+    g_return_val_if_fail (mechanisms != NULL, FALSE);
+    g_return_val_if_fail (mechanism != NULL, FALSE);
+
+    if (g_strv_contains (mechanisms, mechanism))
+        return TRUE;
+
+    if (strchr (mechanism, ' ') == NULL)
+        return FALSE;
+
+    list = g_strsplit (mechanism, " ", -1);
+    for (i = 0; list[i] != NULL && !matches; i++)
     {
-        g_variant_dict_lookup (&dict,
-                               "StoreSecret",
-                               "b",
-                               &info->store_secret);
+        if (list[i][0] != '\0' &&
+            g_strv_contains (mechanisms, list[i]))
+            matches = TRUE;
     }
+    g_strfreev (list);
 
-    g_variant_dict_lookup (&dict,
-                           "Caption",
-                           "s",
-                           &info->caption);
-
-    g_variant_dict_lookup (&dict,
-                           "Realms",
-                           "^as",
-                           &info->realms);
-
-    /* get the methods */
-    method_map = g_variant_dict_lookup_value (&dict,
-                                              "AuthMethods",
-                                              (const GVariantType *) "a{sas}");
-    if (method_map != NULL)
-    {
-        GVariantIter iter;
-        gchar *method = NULL;
-        gchar **mechanisms = NULL;
+    return matches;
+}
 
-        g_variant_iter_init (&iter, method_map);
-        while (g_variant_iter_next (&iter, "{s^as}", &method, &mechanisms))
-        {
-            g_hash_table_insert (info->methods, method, mechanisms);
-        }
-        g_variant_unref (method_map);
-    }
+/*
+ * signon_identity_info_variant_get_allowed_mechanisms:
+ * @variant: the identity data, as received from signond.
+ * @method: an authentication method.
+ *
+ * Reads the mechanisms allowed for @method straight from @variant, without
+ * decoding the whole #SignonIdentityInfo. The rules are those of signond:
+ * an identity with no methods allows every mechanism, and so does a method
+ * with an empty list of mechanisms; a method which is not listed allows
+ * none. Check mechanisms against the result with
+ * signon_identity_info_mechanism_matches().
+ *
+ * Returns: (transfer container): the allowed mechanisms (possibly none),
+ * or %NULL if all mechanisms are allowed. The strings are owned by
+ * @variant.
+ */
+const gchar **
+signon_identity_info_variant_get_allowed_mechanisms (GVariant *variant,
+                                                     const gchar *method)
+{
+    GVariant *method_map;
+    const gchar **mechanisms = NULL;
+
+    g_return_val_if_fail (variant != NULL, NULL);
 
-    acl_var = g_variant_dict_lookup_value (&dict,
-                                           "ACL",
-                                           (const GVariantType *) "a(ss)");
-    if (acl_var != NULL)
+    method_map = g_variant_lookup_value (variant, "AuthMethods",
+                                         (const GVariantType *) "a{sas}");
+    if (method_map == NULL)
+        return NULL;
+
+    if (g_variant_n_children (method_map) > 0)
     {
-        GVariantIter iter;
-        GVariant *child = NULL;
-        GList *acl_list = NULL;
+        if (!g_variant_lookup (method_map, method, "^a&s", &mechanisms))
+            mechanisms = g_new0 (const gchar *, 1);
+        else if (mechanisms[0] == NULL)
+            g_clear_pointer (&mechanisms, g_free);
+    }
 
-        g_variant_iter_init (&iter, acl_var);
-        while ((child = g_variant_iter_next_value (&iter)))
-        {
-            SignonSecurityContext *ctx = signon_security_context_new_from_variant (child);
-            if (ctx != NULL)
-                acl_list = g_list_append (acl_list, ctx);
+    g_variant_unref (method_map);
+    return mechanisms;
+}
 
-            g_variant_unref (child);
-        }
+static GVariant *
+identity_info_build_methods (const SignonIdentityInfo *self)
+{
+    GVariantBuilder method_builder;
+    GArray *methods = self->data->methods;
+    guint i;
 
-        info->access_control_list = acl_list;
-        g_variant_unref (acl_var);
+    g_variant_builder_init (&method_builder,
+                            (const GVariantType *)"a{sas}");
+    for (i = 0; methods != NULL && i < methods->len; i++)
+    {
+        const IdentityInfoMethod *entry =
+            &g_array_index (methods, IdentityInfoMethod, i);
+        g_variant_builder_add (&method_builder, "{s^as}",
+                               entry->method,
+                               entry->mechanisms);
     }
 
-    g_variant_dict_lookup (&dict,
-                           "Type",
-                           "u",
-                           &info->type);
+    return g_variant_builder_end (&method_builder);
+}
 
-    return info;
+static GVariant *
+identity_info_build_acl (const SignonIdentityInfo *self)
+{
+    GVariantBuilder acl_builder;
+    GList *l;
+
+    g_variant_builder_init (&acl_builder, (const GVariantType *)"a(ss)");
+    for (l = self->data->access_control_list; l != NULL; l = l->next)
+    {
+        GVariant* acl_var = signon_security_context_to_variant (l->data);
+        if (acl_var != NULL)
+            g_variant_builder_add_value (&acl_builder, acl_var);
+    }
+
+    return g_variant_builder_end (&acl_builder);
 }
 
-GVariant *
-signon_identity_info_to_variant (const SignonIdentityInfo *self)
+/*
+ * Builds the dictionary holding the Id and @fields of @info; in a full
+ * dictionary unset realms and ACL are omitted, in a partial one they are
+ * sent empty, to clear them.
+ */
+static GVariant *
+identity_info_build (SignonIdentityInfo *info, guint fields)
 {
+    gboolean partial = (fields != SIGNON_IDENTITY_INFO_FIELD_ALL);
     GVariantBuilder builder;
-    GVariantBuilder method_builder;
-    GVariant *method_map;
-    GHashTableIter iter;
-    const gchar *method;
-    const gchar **mechanisms;
 
     g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
 
     g_variant_builder_add (&builder, "{sv}",
                            "Id",
-                           g_variant_new_uint32 (self->id));
+                           g_variant_new_uint32 (info->data->id));
 
-    g_variant_builder_add (&builder, "{sv}",
-                           "UserName",
-                           signon_variant_new_string (self->username));
-
-    g_variant_builder_add (&builder, "{sv}",
-                           "Secret",
-                           signon_variant_new_string (self->secret));
+    if (fields & SIGNON_IDENTITY_INFO_FIELD_USERNAME)
+    {
+        g_variant_builder_add (&builder, "{sv}",
+                               "UserName",
+                               signon_variant_new_string (info->data->username));
+    }
 
-    g_variant_builder_add (&builder, "{sv}",
-                           "Caption",
-                           signon_variant_new_string (self->caption));
+    if (fields & SIGNON_IDENTITY_INFO_FIELD_SECRET)
+    {
+        g_variant_builder_add (&builder, "{sv}",
+                               "Secret",
+                               signon_variant_new_string (info->data->secret));
+    }
 
-    g_variant_builder_add (&builder, "{sv}",
-                           "StoreSecret",
-                           g_variant_new_boolean (self->store_secret));
+    if (fields & SIGNON_IDENTITY_INFO_FIELD_CAPTION)
+    {
+        g_variant_builder_add (&builder, "{sv}",
+                               "Caption",
+                               signon_variant_new_string (info->data->caption));
+    }
 
-    g_variant_builder_init (&method_builder,
-                            (const GVariantType *)"a{sas}");
-    g_hash_table_iter_init (&iter, self->methods);
-    while (g_hash_table_iter_next (&iter,
-                                   (gpointer)&method,
-                                   (gpointer)&mechanisms))
+    if (fields & SIGNON_IDENTITY_INFO_FIELD_SECRET)
     {
-        g_variant_builder_add (&method_builder, "{s^as}",
-                               method,
-                               mechanisms);
+        g_variant_builder_add (&builder, "{sv}",
+                               "StoreSecret",
+                               g_variant_new_boolean (info->data->store_secret));
     }
-    method_map = g_variant_builder_end (&method_builder);
 
-    g_variant_builder_add (&builder, "{sv}",
-                           "AuthMethods",
-                           method_map);
+    if (fields & SIGNON_IDENTITY_INFO_FIELD_METHODS)
+    {
+        GVariant *methods = g_atomic_pointer_get (&info->data->methods_variant);
 
-    if (self->realms != NULL)
+        if (methods == NULL)
+            methods = identity_info_publish_variant (
+                &info->data->methods_variant,
+                g_variant_ref_sink (identity_info_build_methods (info)));
+
+        g_variant_builder_add (&builder, "{sv}", "AuthMethods", methods);
+    }
+
+    if ((fields & SIGNON_IDENTITY_INFO_FIELD_REALMS) &&
+        (info->data->realms != NULL || partial))
     {
+        const gchar *no_realms[] = { NULL };
+
         g_variant_builder_add (&builder, "{sv}",
                                "Realms",
-                               g_variant_new_strv ((const gchar * const *)
-                                                   self->realms,
+                               g_variant_new_strv (info->data->realms != NULL ?
+                                                   (const gchar * const *)
+                                                   info->data->realms : no_realms,
                                                    -1));
     }
 
-    if (self->access_control_list != NULL)
+    if ((fields & SIGNON_IDENTITY_INFO_FIELD_ACL) &&
+        (info->data->access_control_list != NULL || partial))
     {
-        GVariantBuilder acl_builder;
+        GVariant *acl = g_atomic_pointer_get (&info->data->acl_variant);
 
-        g_variant_builder_init (&acl_builder, (const GVariantType *)"a(ss)");
-        GList *l;
-        for (l = self->access_control_list; l != NULL; l = l->next)
-        {
-            GVariant* acl_var = signon_security_context_to_variant (l->data);
-            if (acl_var != NULL)
-                g_variant_builder_add_value (&acl_builder, acl_var);
-        }
+        if (acl == NULL)
+            acl = identity_info_publish_variant (
+                &info->data->acl_variant,
+                g_variant_ref_sink (identity_info_build_acl (info)));
 
+        g_variant_builder_add (&builder, "{sv}", "ACL", acl);
+    }
+
+    if (fields & SIGNON_IDENTITY_INFO_FIELD_TYPE)
+    {
         g_variant_builder_add (&builder, "{sv}",
-                               "ACL",
-                               g_variant_builder_end (&acl_builder));
+                               "Type",
+                               g_variant_new_uint32 (info->data->type));
     }
 
-    g_variant_builder_add (&builder, "{sv}",
-                           "Type",
-                           g_variant_new_uint32 (self->type));
+    return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+/*
+ * signon_identity_info_to_variant:
+ * @self: the #SignonIdentityInfo.
+ *
+ * Serializes @self for signond. The result is cached in @self until one of
+ * the setters changes it, so storing the same info again is free.
+ *
+ * Returns: (transfer full): a non-floating a{sv} #GVariant.
+ */
+GVariant *
+signon_identity_info_to_variant (const SignonIdentityInfo *self)
+{
+    /* The cache is not part of the observable state of @self */
+    SignonIdentityInfo *info = (SignonIdentityInfo *)self;
+    GVariant *variant = g_atomic_pointer_get (&info->data->variant);
+
+    if (variant == NULL)
+    {
+        variant = identity_info_build (info, SIGNON_IDENTITY_INFO_FIELD_ALL);
+        /* Flatten it now: sending it again will then be a plain copy */
+        g_variant_get_data (variant);
+        variant = identity_info_publish_variant (&info->data->variant,
+                                                 variant);
+    }
+
+    return g_variant_ref (variant);
+}
+
+/*
+ * signon_identity_info_to_variant_delta:
+ * @self: the #SignonIdentityInfo.
+ *
+ * Serializes the Id of @self and the fields which have been changed since
+ * it was received from signond, for the "update" D-Bus method.
+ *
+ * Returns: (transfer full): a non-floating a{sv} #GVariant, or %NULL if
+ * @self must be stored in full: when it doesn't come from signond, or when
+ * all its fields have changed.
+ */
+GVariant *
+signon_identity_info_to_variant_delta (const SignonIdentityInfo *self)
+{
+    guint changed_fields;
+
+    g_return_val_if_fail (self != NULL, NULL);
 
-    return g_variant_builder_end (&builder);
+    changed_fields = g_atomic_int_get (&self->data->changed_fields);
+    if (self->data->id == 0 ||
+        changed_fields == SIGNON_IDENTITY_INFO_FIELD_ALL)
+        return NULL;
+
+    return identity_info_build ((SignonIdentityInfo *)self, changed_fields);
+}
+
+/*
+ * signon_identity_info_mark_stored:
+ * @self: the #SignonIdentityInfo.
+ *
+ * Records that signond has stored the contents of @self: the next delta will
+ * only contain the fields changed from now on. The copies sharing the data
+ * of @self have the same contents, so they are marked as well; a copy which
+ * was modified meanwhile has data of its own, and is not affected.
+ */
+void
+signon_identity_info_mark_stored (SignonIdentityInfo *self)
+{
+    g_return_if_fail (self != NULL);
+
+    g_atomic_int_set (&self->data->changed_fields, 0);
 }
 
 /*
@@ -280,9 +763,7 @@ signon_identity_info_to_variant (const SignonIdentityInfo *self)
 SignonIdentityInfo *signon_identity_info_new ()
 {
     SignonIdentityInfo *info = g_slice_new0 (SignonIdentityInfo);
-    info->methods = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                            g_free, (GDestroyNotify)g_strfreev);
-    info->store_secret = FALSE;
+    info->data = identity_info_data_new ();
 
     return info;
 }
@@ -297,15 +778,9 @@ void signon_identity_info_free (SignonIdentityInfo *info)
 {
     if (info == NULL) return;
 
-    g_free (info->username);
-    g_free (info->secret);
-    g_free (info->caption);
-
-    g_hash_table_destroy (info->methods);
-
-    g_strfreev (info->realms);
-
-    g_list_free_full (info->access_control_list, (GDestroyNotify)signon_security_context_free);
+    identity_info_data_unref (info->data);
+    if (info->methods_table != NULL)
+        g_hash_table_unref (info->methods_table);
 
     g_slice_free (SignonIdentityInfo, info);
 }
@@ -314,33 +789,18 @@ void signon_identity_info_free (SignonIdentityInfo *info)
  * signon_identity_info_copy:
  * @other: the #SignonIdentityInfo.
  *
- * Get a newly-allocated copy of @info.
+ * Get a copy of @info. The contents are shared until either copy is
+ * modified, so this is cheap.
  *
  * Returns: a copy of the given #SignonIdentityInfo, or %NULL on failure.
  */
 SignonIdentityInfo *signon_identity_info_copy (const SignonIdentityInfo *other)
 {
     g_return_val_if_fail (other != NULL, NULL);
-    SignonIdentityInfo *info = signon_identity_info_new ();
-
-    identity_info_set_id (info, signon_identity_info_get_id (other));
-
-    signon_identity_info_set_username (info, signon_identity_info_get_username (other));
-
-    signon_identity_info_set_secret (info, identity_info_get_secret(other),
-                                     signon_identity_info_get_storing_secret (other));
-
-    signon_identity_info_set_caption (info, signon_identity_info_get_caption(other));
-
-    signon_identity_info_set_methods (info, signon_identity_info_get_methods (other));
-
-    signon_identity_info_set_realms (info, signon_identity_info_get_realms (other));
-
-    signon_identity_info_set_access_control_list (info,
-        signon_identity_info_get_access_control_list (other));
+    SignonIdentityInfo *info = g_slice_new0 (SignonIdentityInfo);
 
-    signon_identity_info_set_identity_type (info,
-        signon_identity_info_get_identity_type (other));
+    g_atomic_int_inc (&other->data->ref_count);
+    info->data = other->data;
 
     return info;
 }
@@ -356,7 +816,7 @@ SignonIdentityInfo *signon_identity_info_copy (const SignonIdentityInfo *other)
 gint signon_identity_info_get_id (const SignonIdentityInfo *info)
 {
     g_return_val_if_fail (info != NULL, -1);
-    return info->id;
+    return info->data->id;
 }
 
 /**
@@ -370,7 +830,7 @@ gint signon_identity_info_get_id (const SignonIdentityInfo *info)
 const gchar *signon_identity_info_get_username (const SignonIdentityInfo *info)
 {
     g_return_val_if_fail (info != NULL, NULL);
-    return info->username;
+    return info->data->username;
 }
 
 /**
@@ -384,7 +844,7 @@ const gchar *signon_identity_info_get_username (const SignonIdentityInfo *info)
 gboolean signon_identity_info_get_storing_secret (const SignonIdentityInfo *info)
 {
     g_return_val_if_fail (info != NULL, FALSE);
-    return info->store_secret;
+    return info->data->store_secret;
 }
 
 /**
@@ -398,7 +858,7 @@ gboolean signon_identity_info_get_storing_secret (const SignonIdentityInfo *info
 const gchar *signon_identity_info_get_caption (const SignonIdentityInfo *info)
 {
     g_return_val_if_fail (info != NULL, NULL);
-    return info->caption;
+    return info->data->caption;
 }
 
 /**
@@ -412,8 +872,61 @@ const gchar *signon_identity_info_get_caption (const SignonIdentityInfo *info)
  */
 const GHashTable *signon_identity_info_get_methods (const SignonIdentityInfo *info)
 {
+    /* The table is not part of the observable state of @info */
+    SignonIdentityInfo *self = (SignonIdentityInfo *)info;
+
     g_return_val_if_fail (info != NULL, NULL);
-    return info->methods;
+
+    /* The table borrows the contents of the methods array, and is kept in
+     * sync with it from now on */
+    if (self->methods_table == NULL)
+    {
+        self->methods_table = g_hash_table_new (g_str_hash, g_str_equal);
+        identity_info_fill_methods_table (self);
+    }
+
+    return self->methods_table;
+}
+
+/**
+ * signon_identity_info_allows_mechanism:
+ * @info: the #SignonIdentityInfo.
+ * @method: an authentication method.
+ * @mechanism: (allow-none): a mechanism of @method, or %NULL to only check
+ * @method.
+ *
+ * Checks whether @info allows using @mechanism of @method, with the same
+ * rules as signond: an identity with no methods allows everything, a method
+ * which is not listed is not allowed, and a method with no mechanisms
+ * allows all of its mechanisms. @mechanism can also be a space-separated
+ * list of mechanisms, as used by SASL: it's allowed if any of them is.
+ *
+ * Returns: %TRUE if @mechanism is allowed, %FALSE otherwise.
+ *
+ * Since: 2.1
+ */
+gboolean signon_identity_info_allows_mechanism (const SignonIdentityInfo *info,
+                                                const gchar *method,
+                                                const gchar *mechanism)
+{
+    const IdentityInfoMethod *entry;
+
+    g_return_val_if_fail (info != NULL, FALSE);
+    g_return_val_if_fail (method != NULL, FALSE);
+
+    if (info->data->methods == NULL || info->data->methods->len == 0)
+        return TRUE;
+
+    entry = identity_info_lookup_method (info->data, method);
+    if (entry == NULL)
+        return FALSE;
+
+    if (mechanism == NULL || entry->mechanisms[0] == NULL)
+        return TRUE;
+
+    return signon_identity_info_mechanism_matches ((const gchar * const *)
+                                                   entry->mechanisms,
+                                                   mechanism);
 }
 
 /**
@@ -427,7 +940,7 @@ const GHashTable *signon_identity_info_get_methods (const SignonIdentityInfo *in
 const gchar* const *signon_identity_info_get_realms (const SignonIdentityInfo *info)
 {
     g_return_val_if_fail (info != NULL, NULL);
-    return (const gchar* const *)info->realms;
+    return (const gchar* const *)info->data->realms;
 }
 
 /**
@@ -443,7 +956,7 @@ const gchar* const *signon_identity_info_get_realms (const SignonIdentityInfo *i
 GList *signon_identity_info_get_access_control_list (const SignonIdentityInfo *info)
 {
     g_return_val_if_fail (info != NULL, NULL);
-    return g_list_copy_deep (info->access_control_list, (GCopyFunc)signon_security_context_copy, NULL);
+    return g_list_copy_deep (info->data->access_control_list, (GCopyFunc)signon_security_context_copy, NULL);
 }
 
 /**
@@ -457,7 +970,7 @@ GList *signon_identity_info_get_access_control_list (const SignonIdentityInfo *i
 SignonIdentityType signon_identity_info_get_identity_type (const SignonIdentityInfo *info)
 {
     g_return_val_if_fail (info != NULL, -1);
-    return info->type;
+    return info->data->type;
 }
 
 /**
@@ -465,15 +978,18 @@ SignonIdentityType signon_identity_info_get_identity_type (const SignonIdentityI
  * @info: the #SignonIdentityInfo.
  * @username: the username.
  *
- * Sets the username for the identity.
+ * Sets the username for the identity. An invalid UTF-8 string is treated as
+ * %NULL.
  */
 void signon_identity_info_set_username (SignonIdentityInfo *info, const gchar *username)
 {
     g_return_if_fail (info != NULL);
+    identity_info_make_writable (info);
 
-    if (info->username) g_free (info->username);
+    if (info->data->username) g_free (info->data->username);
 
-    info->username = g_strdup (username);
+    info->data->username = identity_info_dup_utf8 ("username", username);
+    identity_info_changed (info, SIGNON_IDENTITY_INFO_FIELD_USERNAME, NULL);
 }
 
 /**
@@ -483,17 +999,19 @@ void signon_identity_info_set_username (SignonIdentityInfo *info, const gchar *u
  * @store_secret: whether signond should store the secret in its DB.
  *
  * Sets the secret (password) for the identity, and whether the signon daemon
- * should remember it.
+ * should remember it. An invalid UTF-8 secret is treated as %NULL.
  */
 void signon_identity_info_set_secret (SignonIdentityInfo *info, const gchar *secret,
                                       gboolean store_secret)
 {
     g_return_if_fail (info != NULL);
+    identity_info_make_writable (info);
 
-    if (info->secret) g_free (info->secret);
+    if (info->data->secret) g_free (info->data->secret);
 
-    info->secret = g_strdup (secret);
-    info->store_secret = store_secret;
+    info->data->secret = identity_info_dup_utf8 ("secret", secret);
+    info->data->store_secret = store_secret;
+    identity_info_changed (info, SIGNON_IDENTITY_INFO_FIELD_SECRET, NULL);
 }
 
 /**
@@ -501,15 +1019,18 @@ void signon_identity_info_set_secret (SignonIdentityInfo *info, const gchar *sec
  * @info: the #SignonIdentityInfo.
  * @caption: the caption.
  *
- * Sets the caption (display name) for the identity.
+ * Sets the caption (display name) for the identity. An invalid UTF-8 string
+ * is treated as %NULL.
  */
 void signon_identity_info_set_caption (SignonIdentityInfo *info, const gchar *caption)
 {
     g_return_if_fail (info != NULL);
+    identity_info_make_writable (info);
 
-    if (info->caption) g_free (info->caption);
+    if (info->data->caption) g_free (info->data->caption);
 
-    info->caption = g_strdup (caption);
+    info->data->caption = identity_info_dup_utf8 ("caption", caption);
+    identity_info_changed (info, SIGNON_IDENTITY_INFO_FIELD_CAPTION, NULL);
 }
 
 /**
@@ -525,14 +1046,24 @@ void signon_identity_info_set_caption (SignonIdentityInfo *info, const gchar *ca
 void signon_identity_info_set_method (SignonIdentityInfo *info, const gchar *method,
                                       const gchar* const *mechanisms)
 {
+    const IdentityInfoMethod *entry;
+
     g_return_if_fail (info != NULL);
 
-    g_return_if_fail (info->methods != NULL);
     g_return_if_fail (method != NULL);
     g_return_if_fail (mechanisms != NULL);
-
-    g_hash_table_replace (info->methods,
-                          g_strdup(method), g_strdupv((gchar **)mechanisms));
+    identity_info_make_writable (info);
+
+    /* The table borrows the key of the entry being replaced */
+    if (info->methods_table != NULL)
+        g_hash_table_remove (info->methods_table, method);
+    entry = identity_info_insert_method (info->data, method,
+                                         g_strdupv ((gchar **)mechanisms));
+    if (info->methods_table != NULL)
+        g_hash_table_insert (info->methods_table,
+                             entry->method, entry->mechanisms);
+    identity_info_changed (info, SIGNON_IDENTITY_INFO_FIELD_METHODS,
+                           &info->data->methods_variant);
 }
 
 /**
@@ -545,10 +1076,20 @@ void signon_identity_info_set_method (SignonIdentityInfo *info, const gchar *met
  */
 void signon_identity_info_remove_method (SignonIdentityInfo *info, const gchar *method)
 {
+    guint position;
+
     g_return_if_fail (info != NULL);
-    g_return_if_fail (info->methods != NULL);
+    g_return_if_fail (method != NULL);
+
+    if (!identity_info_find_method (info->data, method, &position))
+        return;
 
-    g_hash_table_remove (info->methods, method);
+    identity_info_make_writable (info);
+    if (info->methods_table != NULL)
+        g_hash_table_remove (info->methods_table, method);
+    g_array_remove_index (info->data->methods, position);
+    identity_info_changed (info, SIGNON_IDENTITY_INFO_FIELD_METHODS,
+                           &info->data->methods_variant);
 }
 
 /**
@@ -562,10 +1103,12 @@ void signon_identity_info_set_realms (SignonIdentityInfo *info,
                                       const gchar* const *realms)
 {
     g_return_if_fail (info != NULL);
+    identity_info_make_writable (info);
 
-    if (info->realms) g_strfreev (info->realms);
+    if (info->data->realms) g_strfreev (info->data->realms);
 
-    info->realms = g_strdupv ((gchar **)realms);
+    info->data->realms = g_strdupv ((gchar **)realms);
+    identity_info_changed (info, SIGNON_IDENTITY_INFO_FIELD_REALMS, NULL);
 }
 
 /**
@@ -581,10 +1124,13 @@ void signon_identity_info_set_access_control_list (SignonIdentityInfo *info,
                                                    GList *access_control_list)
 {
     g_return_if_fail (info != NULL);
+    identity_info_make_writable (info);
 
-    if (info->access_control_list) g_list_free_full (info->access_control_list, (GDestroyNotify)signon_security_context_free);
+    if (info->data->access_control_list) g_list_free_full (info->data->access_control_list, (GDestroyNotify)signon_security_context_free);
 
-    info->access_control_list = g_list_copy_deep (access_control_list, (GCopyFunc)signon_security_context_copy, NULL);
+    info->data->access_control_list = g_list_copy_deep (access_control_list, (GCopyFunc)signon_security_context_copy, NULL);
+    identity_info_changed (info, SIGNON_IDENTITY_INFO_FIELD_ACL,
+                           &info->data->acl_variant);
 }
 
 /**
@@ -604,9 +1150,12 @@ void signon_identity_info_add_access_control (SignonIdentityInfo *info,
     g_return_if_fail (info != NULL);
     g_return_if_fail (system_context != NULL);
     g_return_if_fail (application_context != NULL);
+    identity_info_make_writable (info);
 
     ctx = signon_security_context_new_from_values (system_context, application_context);
-    info->access_control_list = g_list_append (info->access_control_list, ctx);
+    info->data->access_control_list = g_list_append (info->data->access_control_list, ctx);
+    identity_info_changed (info, SIGNON_IDENTITY_INFO_FIELD_ACL,
+                           &info->data->acl_variant);
 }
 
 /**
@@ -620,5 +1169,7 @@ void signon_identity_info_set_identity_type (SignonIdentityInfo *info,
                                              SignonIdentityType type)
 {
     g_return_if_fail (info != NULL);
-    info->type = type;
+    identity_info_make_writable (info);
+    info->data->type = type;
+    identity_info_changed (info, SIGNON_IDENTITY_INFO_FIELD_TYPE, NULL);
 }
@@ -68,6 +68,9 @@ const GHashTable *signon_identity_info_get_methods (const SignonIdentityInfo *in
 const gchar* const *signon_identity_info_get_realms (const SignonIdentityInfo *info);
 GList *signon_identity_info_get_access_control_list (const SignonIdentityInfo *info);
 SignonIdentityType signon_identity_info_get_identity_type (const SignonIdentityInfo *info);
+gboolean signon_identity_info_allows_mechanism (const SignonIdentityInfo *info,
+                                                const gchar *method,
+                                                const gchar *mechanism);
 
 void signon_identity_info_set_username (SignonIdentityInfo *info, const gchar *username);
 void signon_identity_info_set_secret (SignonIdentityInfo *info,
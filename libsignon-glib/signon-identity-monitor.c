@@ -0,0 +1,508 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of libsignon-glib
+ *
+ * Copyright (C) 2012-2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+/**
+ * SECTION:signon-identity-monitor
+ * @title: SignonIdentityMonitor
+ * @short_description: Change notifications for many identities.
+ *
+ * A #SignonIdentityMonitor reports the changes of a set of identities,
+ * without the need of creating a #SignonIdentity for each of them. This is
+ * meant for keeping a local mirror of the credentials, or a user interface,
+ * consistent with the database of signond.
+ *
+ * The changes are delivered in batches by the
+ * #SignonIdentityMonitor::changed signal, once per main loop iteration.
+ * When signond is restarted, the changes made meanwhile cannot be known: the
+ * monitor then reports %SIGNON_IDENTITY_CHANGE_RESYNC for all of its
+ * identities, which must be read again.
+ */
+
+#include "signon-identity-monitor.h"
+#include "signon-errors.h"
+#include "signon-internals.h"
+#include "signon-marshal.h"
+#include "sso-auth-service.h"
+
+typedef struct {
+    SignonIdentityMonitor *monitor;
+    guint32 id;
+    /* Cancels the registration of the remote object */
+    GCancellable *cancellable;
+    SsoSignalWatch *signal_watch;
+    gboolean removed;
+} MonitoredIdentity;
+
+/**
+ * SignonIdentityMonitor:
+ *
+ * Opaque struct. Use the accessor functions below.
+ */
+struct _SignonIdentityMonitor
+{
+    GObject parent_instance;
+
+    SsoAuthService *auth_service_proxy;
+    gulong name_owner_handler;
+    /* Identity ID -> MonitoredIdentity */
+    GHashTable *identities;
+
+    GMainContext *context;
+    GSource *idle_source;
+    /* The events not delivered yet */
+    GArray *pending_events;
+};
+
+G_DEFINE_TYPE (SignonIdentityMonitor, signon_identity_monitor, G_TYPE_OBJECT)
+
+enum
+{
+    CHANGED_SIGNAL,
+    FAILED_SIGNAL,
+    LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL];
+
+static void monitored_identity_register (MonitoredIdentity *identity);
+
+static void
+monitored_identity_unwatch (MonitoredIdentity *identity)
+{
+    if (identity->signal_watch != NULL)
+    {
+        sso_auth_service_unwatch_object (identity->monitor->auth_service_proxy,
+                                         identity->signal_watch);
+        identity->signal_watch = NULL;
+    }
+}
+
+static void
+monitored_identity_cancel (MonitoredIdentity *identity)
+{
+    if (identity->cancellable != NULL)
+    {
+        g_cancellable_cancel (identity->cancellable);
+        g_clear_object (&identity->cancellable);
+    }
+}
+
+static void
+monitored_identity_free (MonitoredIdentity *identity)
+{
+    monitored_identity_cancel (identity);
+    monitored_identity_unwatch (identity);
+    g_slice_free (MonitoredIdentity, identity);
+}
+
+static gboolean
+monitor_emit_events (gpointer user_data)
+{
+    SignonIdentityMonitor *self = SIGNON_IDENTITY_MONITOR (user_data);
+    GArray *events;
+
+    g_clear_pointer (&self->idle_source, g_source_unref);
+
+    events = self->pending_events;
+    self->pending_events = NULL;
+
+    if (events != NULL)
+    {
+        g_signal_emit (self, signals[CHANGED_SIGNAL], 0, events);
+        g_array_unref (events);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+monitor_add_event (SignonIdentityMonitor *self, guint32 id,
+                   SignonIdentityChange change)
+{
+    SignonIdentityEvent event;
+    guint i;
+
+    if (self->pending_events == NULL)
+        self->pending_events = g_array_new (FALSE, FALSE,
+                                            sizeof (SignonIdentityEvent));
+
+    /* The same change is reported only once per batch */
+    for (i = 0; i < self->pending_events->len; i++)
+    {
+        SignonIdentityEvent *pending =
+            &g_array_index (self->pending_events, SignonIdentityEvent, i);
+        if (pending->id == id && pending->change == change)
+            return;
+    }
+
+    event.id = id;
+    event.change = change;
+    g_array_append_val (self->pending_events, event);
+
+    if (self->idle_source == NULL)
+    {
+        /* At idle priority, so that the signals received in the same main
+         * loop iteration end up in the same batch */
+        self->idle_source = g_idle_source_new ();
+        g_source_set_callback (self->idle_source, monitor_emit_events,
+                               self, NULL);
+        g_source_attach (self->idle_source, self->context);
+    }
+}
+
+static void
+monitored_identity_signal_cb (const gchar *signal_name,
+                              GVariant *parameters,
+                              gpointer user_data)
+{
+    MonitoredIdentity *identity = user_data;
+    SignonIdentityMonitor *self = identity->monitor;
+
+    if (g_strcmp0 (signal_name, "infoUpdated") == 0 &&
+        g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(i)")))
+    {
+        gint change;
+
+        g_variant_get (parameters, "(i)", &change);
+        if (change < SIGNON_IDENTITY_CHANGE_UPDATED ||
+            change > SIGNON_IDENTITY_CHANGE_SIGNED_OUT)
+        {
+            g_critical ("wrong state value obtained from signon daemon");
+            return;
+        }
+
+        if (change == SIGNON_IDENTITY_CHANGE_REMOVED)
+            identity->removed = TRUE;
+        monitor_add_event (self, identity->id, change);
+    }
+    else if (g_strcmp0 (signal_name, "unregistered") == 0)
+    {
+        /* signond drops the objects which are not used for a while: ask
+         * for a new one, unless the identity is gone */
+        monitored_identity_unwatch (identity);
+        if (identity->removed)
+            g_hash_table_remove (self->identities,
+                                 GUINT_TO_POINTER (identity->id));
+        else
+            monitored_identity_register (identity);
+    }
+}
+
+static void
+monitored_identity_registered_cb (GObject *object, GAsyncResult *res,
+                                  gpointer user_data)
+{
+    SsoAuthService *proxy = SSO_AUTH_SERVICE (object);
+    MonitoredIdentity *identity = user_data;
+    SignonIdentityMonitor *self;
+    gchar *object_path = NULL;
+    GVariant *identity_data = NULL;
+    GError *error = NULL;
+    guint32 id;
+
+    if (!sso_auth_service_call_get_identity_finish (proxy, &object_path,
+                                                    &identity_data,
+                                                    res, &error))
+    {
+        if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+            g_error_free (error);
+            return;
+        }
+
+        self = identity->monitor;
+        id = identity->id;
+        g_clear_object (&identity->cancellable);
+
+        /* signond went away before replying: the identity is registered
+         * again when signond is back */
+        if (g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_NO_REPLY) ||
+            g_error_matches (error, G_DBUS_ERROR,
+                             G_DBUS_ERROR_NAME_HAS_NO_OWNER))
+        {
+            DEBUG ("Identity %u not registered: %s", id, error->message);
+            g_error_free (error);
+            return;
+        }
+
+        g_hash_table_remove (self->identities, GUINT_TO_POINTER (id));
+        if (g_error_matches (error, SIGNON_ERROR,
+                             SIGNON_ERROR_IDENTITY_NOT_FOUND))
+        {
+            monitor_add_event (self, id, SIGNON_IDENTITY_CHANGE_REMOVED);
+        }
+        else
+        {
+            DEBUG ("Cannot monitor identity %u: %s", id, error->message);
+            g_object_ref (self);
+            g_signal_emit (self, signals[FAILED_SIGNAL], 0, id, error);
+            g_object_unref (self);
+        }
+        g_error_free (error);
+        return;
+    }
+
+    g_clear_object (&identity->cancellable);
+    identity->signal_watch =
+        sso_auth_service_watch_object (identity->monitor->auth_service_proxy,
+                                       object_path,
+                                       monitored_identity_signal_cb,
+                                       identity);
+
+    g_variant_unref (identity_data);
+    g_free (object_path);
+}
+
+static void
+monitored_identity_register (MonitoredIdentity *identity)
+{
+    g_return_if_fail (identity->cancellable == NULL);
+
+    identity->cancellable = g_cancellable_new ();
+    sso_auth_service_call_get_identity (identity->monitor->auth_service_proxy,
+                                        identity->id,
+                                        "*",
+                                        identity->cancellable,
+                                        monitored_identity_registered_cb,
+                                        identity);
+}
+
+static void
+monitor_name_owner_changed_cb (GObject *object, GParamSpec *pspec,
+                               gpointer user_data)
+{
+    SignonIdentityMonitor *self = SIGNON_IDENTITY_MONITOR (user_data);
+    GHashTableIter iter;
+    gpointer value;
+    gchar *owner;
+
+    /* The remote objects died with signond without being unregistered, and
+     * the changes made while signond was away went unnoticed: once it's
+     * back, register the identities again and have them read again */
+    owner = g_dbus_proxy_get_name_owner (G_DBUS_PROXY (object));
+    DEBUG ("signond owner changed to %s", owner);
+
+    g_hash_table_iter_init (&iter, self->identities);
+    while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+        MonitoredIdentity *identity = value;
+
+        monitored_identity_cancel (identity);
+        monitored_identity_unwatch (identity);
+        if (owner != NULL)
+        {
+            monitored_identity_register (identity);
+            monitor_add_event (self, identity->id,
+                               SIGNON_IDENTITY_CHANGE_RESYNC);
+        }
+    }
+
+    g_free (owner);
+}
+
+static void
+signon_identity_monitor_init (SignonIdentityMonitor *self)
+{
+    self->auth_service_proxy = sso_auth_service_get_instance ();
+    if (self->auth_service_proxy != NULL)
+        self->name_owner_handler =
+            g_signal_connect (self->auth_service_proxy,
+                              "notify::g-name-owner",
+                              G_CALLBACK (monitor_name_owner_changed_cb),
+                              self);
+    self->identities =
+        g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                               (GDestroyNotify)monitored_identity_free);
+    self->context = g_main_context_ref_thread_default ();
+}
+
+static void
+signon_identity_monitor_dispose (GObject *object)
+{
+    SignonIdentityMonitor *self = SIGNON_IDENTITY_MONITOR (object);
+
+    if (self->identities != NULL)
+    {
+        g_hash_table_remove_all (self->identities);
+        g_clear_pointer (&self->identities, g_hash_table_unref);
+    }
+
+    if (self->idle_source)
+    {
+        g_source_destroy (self->idle_source);
+        g_clear_pointer (&self->idle_source, g_source_unref);
+    }
+
+    g_clear_pointer (&self->pending_events, g_array_unref);
+    if (self->name_owner_handler != 0)
+    {
+        g_signal_handler_disconnect (self->auth_service_proxy,
+                                     self->name_owner_handler);
+        self->name_owner_handler = 0;
+    }
+    g_clear_object (&self->auth_service_proxy);
+
+    G_OBJECT_CLASS (signon_identity_monitor_parent_class)->dispose (object);
+}
+
+static void
+signon_identity_monitor_finalize (GObject *object)
+{
+    SignonIdentityMonitor *self = SIGNON_IDENTITY_MONITOR (object);
+
+    g_main_context_unref (self->context);
+
+    G_OBJECT_CLASS (signon_identity_monitor_parent_class)->finalize (object);
+}
+
+static void
+signon_identity_monitor_class_init (SignonIdentityMonitorClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->dispose = signon_identity_monitor_dispose;
+    object_class->finalize = signon_identity_monitor_finalize;
+
+    /**
+     * SignonIdentityMonitor::changed:
+     * @monitor: the #SignonIdentityMonitor.
+     * @events: (element-type SignonIdentityEvent): the changes, in the
+     * order they happened.
+     *
+     * Emitted once per main loop iteration, with all the changes which were
+     * reported during it; a change which is reported more than once for the
+     * same identity appears only once.
+     *
+     * Since: 2.1
+     */
+    signals[CHANGED_SIGNAL] =
+        g_signal_new ("changed",
+                      G_TYPE_FROM_CLASS (klass),
+                      G_SIGNAL_RUN_LAST | G_SIGNAL_NO_RECURSE | G_SIGNAL_NO_HOOKS,
+                      0 /* class closure */,
+                      NULL /* accumulator */,
+                      NULL /* accu_data */,
+                      g_cclosure_marshal_VOID__BOXED,
+                      G_TYPE_NONE /* return_type */,
+                      1, G_TYPE_ARRAY);
+
+    /**
+     * SignonIdentityMonitor::failed:
+     * @monitor: the #SignonIdentityMonitor.
+     * @id: the ID of the identity.
+     * @error: the reason of the failure.
+     *
+     * Emitted when the identity @id cannot be monitored, because signond
+     * refused to register it; the identity is not monitored anymore. An
+     * identity which doesn't exist is reported by the
+     * #SignonIdentityMonitor::changed signal instead, as removed.
+     *
+     * Since: 2.1
+     */
+    signals[FAILED_SIGNAL] =
+        g_signal_new ("failed",
+                      G_TYPE_FROM_CLASS (klass),
+                      G_SIGNAL_RUN_LAST | G_SIGNAL_NO_RECURSE | G_SIGNAL_NO_HOOKS,
+                      0 /* class closure */,
+                      NULL /* accumulator */,
+                      NULL /* accu_data */,
+                      _signon_marshal_VOID__UINT_BOXED,
+                      G_TYPE_NONE /* return_type */,
+                      2, G_TYPE_UINT, G_TYPE_ERROR);
+}
+
+/**
+ * signon_identity_monitor_new:
+ *
+ * Creates a monitor which doesn't watch any identity yet. The
+ * #SignonIdentityMonitor::changed signal is emitted in the thread-default
+ * main context of the caller.
+ *
+ * Returns: an instance of a #SignonIdentityMonitor.
+ *
+ * Since: 2.1
+ */
+SignonIdentityMonitor *
+signon_identity_monitor_new ()
+{
+    return g_object_new (SIGNON_TYPE_IDENTITY_MONITOR, NULL);
+}
+
+/**
+ * signon_identity_monitor_add:
+ * @self: the #SignonIdentityMonitor.
+ * @id: the ID of an identity.
+ *
+ * Starts reporting the changes of the identity @id. If the identity doesn't
+ * exist, a %SIGNON_IDENTITY_CHANGE_REMOVED change is reported for it.
+ *
+ * Monitoring an identity costs no #GDBusProxy nor D-Bus match rule: the
+ * signals of all the identities come through a single subscription. It
+ * still holds a remote object in signond, though, which signond releases
+ * after its inactivity timeout (SSO_IDENTITY_TIMEOUT, 300 seconds by
+ * default) and the monitor registers again: monitoring N identities costs
+ * N registration calls per timeout.
+ *
+ * If signond refuses to register the identity, the
+ * #SignonIdentityMonitor::failed signal is emitted.
+ *
+ * Since: 2.1
+ */
+void
+signon_identity_monitor_add (SignonIdentityMonitor *self, guint32 id)
+{
+    MonitoredIdentity *identity;
+
+    g_return_if_fail (SIGNON_IS_IDENTITY_MONITOR (self));
+    g_return_if_fail (id != 0);
+    g_return_if_fail (self->auth_service_proxy != NULL);
+
+    if (g_hash_table_contains (self->identities, GUINT_TO_POINTER (id)))
+        return;
+
+    identity = g_slice_new0 (MonitoredIdentity);
+    identity->monitor = self;
+    identity->id = id;
+    g_hash_table_insert (self->identities, GUINT_TO_POINTER (id), identity);
+
+    monitored_identity_register (identity);
+}
+
+/**
+ * signon_identity_monitor_remove:
+ * @self: the #SignonIdentityMonitor.
+ * @id: the ID of an identity.
+ *
+ * Stops reporting the changes of the identity @id.
+ *
+ * Since: 2.1
+ */
+void
+signon_identity_monitor_remove (SignonIdentityMonitor *self, guint32 id)
+{
+    g_return_if_fail (SIGNON_IS_IDENTITY_MONITOR (self));
+
+    g_hash_table_remove (self->identities, GUINT_TO_POINTER (id));
+}
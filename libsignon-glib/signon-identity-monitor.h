@@ -0,0 +1,78 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of libsignon-glib
+ *
+ * Copyright (C) 2012-2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef _SIGNON_IDENTITY_MONITOR_H_
+#define _SIGNON_IDENTITY_MONITOR_H_
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/**
+ * SignonIdentityChange:
+ * @SIGNON_IDENTITY_CHANGE_UPDATED: the data of the identity was updated
+ * @SIGNON_IDENTITY_CHANGE_REMOVED: the identity was removed
+ * @SIGNON_IDENTITY_CHANGE_SIGNED_OUT: the identity was signed out
+ * @SIGNON_IDENTITY_CHANGE_RESYNC: the changes of the identity could not be
+ * monitored for a while, because signond was restarted: its data must be
+ * read again
+ *
+ * The changes reported by #SignonIdentityMonitor.
+ *
+ * Since: 2.1
+ */
+typedef enum {
+    SIGNON_IDENTITY_CHANGE_UPDATED = 0,
+    SIGNON_IDENTITY_CHANGE_REMOVED,
+    SIGNON_IDENTITY_CHANGE_SIGNED_OUT,
+    SIGNON_IDENTITY_CHANGE_RESYNC,
+} SignonIdentityChange;
+
+/**
+ * SignonIdentityEvent:
+ * @id: the ID of the identity.
+ * @change: what happened to the identity.
+ *
+ * A change of an identity, as reported by #SignonIdentityMonitor.
+ *
+ * Since: 2.1
+ */
+typedef struct {
+    guint32 id;
+    SignonIdentityChange change;
+} SignonIdentityEvent;
+
+#define SIGNON_TYPE_IDENTITY_MONITOR signon_identity_monitor_get_type ()
+G_DECLARE_FINAL_TYPE (SignonIdentityMonitor, signon_identity_monitor,
+                      SIGNON, IDENTITY_MONITOR, GObject)
+
+SignonIdentityMonitor *signon_identity_monitor_new ();
+
+void signon_identity_monitor_add (SignonIdentityMonitor *self, guint32 id);
+void signon_identity_monitor_remove (SignonIdentityMonitor *self, guint32 id);
+
+G_END_DECLS
+
+#endif /* _SIGNON_IDENTITY_MONITOR_H_ */
@@ -29,6 +29,20 @@
  * @short_description: Client side presentation of a credential.
  *
  * The #SignonIdentity represents a database entry for a single identity.
+ *
+ * #SignonIdentity implements #GAsyncInitable: initializing it is optional,
+ * since every operation waits for the identity to be registered with
+ * signond, but g_async_initable_init_async() can be used to wait for the
+ * registration (and to learn about its failure) without issuing any
+ * operation.
+ *
+ * A #SignonIdentity, and the #SignonAuthSession objects created from it,
+ * belong to the thread which created them: their replies and signals are
+ * dispatched in that thread, and they are not locked against concurrent
+ * use. Threads without a main loop can use the synchronous methods, such
+ * as signon_identity_query_info_sync(), on the objects they created. Many
+ * threads can do that at the same time, each with its own objects, even
+ * for the same identity: the state shared among threads is locked.
  */
 
 #include "signon-identity.h"
@@ -49,6 +63,7 @@
     }
 
 static void signon_identity_proxy_if_init (SignonProxyInterface *iface);
+static void signon_identity_async_initable_if_init (GAsyncInitableIface *iface);
 static void signon_identity_set_id (SignonIdentity *identity, guint32 id);
 
 typedef enum {
@@ -81,11 +96,24 @@ struct _SignonIdentity
   SsoIdentity *proxy;
   SsoAuthService *auth_service_proxy;
   GCancellable *cancellable;
-
+  /* Cancels the pending registration only, which can be restarted without
+   * affecting the other calls */
+  GCancellable *registration_cancellable;
+  /* The thread which created the identity, and which must use it, and
+   * the context where that thread gets the signals and timeouts */
+  GThread *owner_thread;
+  GMainContext *owner_context;
+
+  /* The identity data as received from signond, and its decoded form,
+   * which is only built when needed */
+  GVariant *identity_data;
   SignonIdentityInfo *identity_info;
 
-  GSList *sessions;
+  /* Method name -> SignonAuthSession; the sessions are not owned */
+  GHashTable *sessions;
   IdentityRegistrationState registration_state;
+  /* The context where the pending registration reply will be dispatched */
+  GMainContext *registration_context;
 
   gboolean removed;
   gboolean signed_out;
@@ -94,13 +122,24 @@ struct _SignonIdentity
 
   guint id;
 
-  guint signal_info_updated;
-  guint signal_unregistered;
+  SsoSignalWatch *signal_watch;
+
+  /* The remote object is released after idle_timeout seconds without
+   * operations; 0 means never */
+  guint idle_timeout;
+  GSource *idle_source;
+  guint pending_operations;
+
+  /* Whether the remote object is registered again as soon as signond
+   * releases it */
+  gboolean keep_alive;
 };
 
 G_DEFINE_TYPE_WITH_CODE (SignonIdentity, signon_identity, G_TYPE_OBJECT,
                          G_IMPLEMENT_INTERFACE (SIGNON_TYPE_PROXY,
-                                                signon_identity_proxy_if_init))
+                                                signon_identity_proxy_if_init)
+                         G_IMPLEMENT_INTERFACE (G_TYPE_ASYNC_INITABLE,
+                                                signon_identity_async_initable_if_init))
 
 enum
 {
@@ -115,9 +154,22 @@ enum {
 
 static guint signals[LAST_SIGNAL];
 
+typedef struct {
+    /* Shares the data of the stored info, to mark it as stored */
+    SignonIdentityInfo *info;
+    GVariant *info_variant;
+    GVariant *delta_variant;
+} IdentityStoreData;
+
+typedef struct {
+    gchar *reference;
+    gboolean add;
+} IdentityReferenceData;
+
 static void identity_check_remote_registration (SignonIdentity *self);
 static void identity_store_info_ready_cb (gpointer object, const GError *error, gpointer user_data);
 static void identity_store_info_reply (GObject *object, GAsyncResult *res, gpointer userdata);
+static void identity_update_info_reply (GObject *object, GAsyncResult *res, gpointer userdata);
 static void identity_session_object_destroyed_cb (gpointer data, GObject *where_the_session_was);
 static void identity_verify_ready_cb (gpointer object, const GError *error, gpointer user_data);
 static void identity_query_ready_cb (gpointer object, const GError *error, gpointer user_data);
@@ -126,9 +178,142 @@ static void identity_remove_ready_cb (gpointer object, const GError *error, gpoi
 static void identity_signout_ready_cb (gpointer object, const GError *error, gpointer user_data);
 
 static void identity_process_signout (SignonIdentity *self);
+static void identity_update_sessions (SignonIdentity *self);
 static void identity_process_updated (SignonIdentity *self);
 static void identity_process_removed (SignonIdentity *self);
 
+static void
+identity_store_data_free (IdentityStoreData *store_data)
+{
+    signon_identity_info_free (store_data->info);
+    g_variant_unref (store_data->info_variant);
+    if (store_data->delta_variant != NULL)
+        g_variant_unref (store_data->delta_variant);
+    g_slice_free (IdentityStoreData, store_data);
+}
+
+static void
+identity_clear_info (SignonIdentity *self)
+{
+    g_clear_pointer (&self->identity_data, g_variant_unref);
+    g_clear_pointer (&self->identity_info, signon_identity_info_free);
+}
+
+static void
+identity_cancel_eviction (SignonIdentity *self)
+{
+    if (self->idle_source != NULL)
+    {
+        g_source_destroy (self->idle_source);
+        g_clear_pointer (&self->idle_source, g_source_unref);
+    }
+}
+
+static void
+identity_destroy_proxy (SignonIdentity *self)
+{
+    identity_cancel_eviction (self);
+
+    if (self->signal_watch != NULL)
+    {
+        sso_auth_service_unwatch_object (self->auth_service_proxy,
+                                         self->signal_watch);
+        self->signal_watch = NULL;
+    }
+
+    g_clear_object (&self->proxy);
+}
+
+static gboolean
+identity_has_sessions (SignonIdentity *self)
+{
+    return g_hash_table_size (self->sessions) > 0;
+}
+
+static gboolean
+identity_evict_cb (gpointer user_data)
+{
+    SignonIdentity *self = SIGNON_IDENTITY (user_data);
+
+    g_clear_pointer (&self->idle_source, g_source_unref);
+
+    /* The sessions get their updates through the identity */
+    if (self->pending_operations > 0 || identity_has_sessions (self) ||
+        self->keep_alive)
+        return G_SOURCE_REMOVE;
+
+    DEBUG ("Releasing idle identity %u", self->id);
+
+    /* The cached info is kept; the next operation registers the identity
+     * again, which also refreshes it */
+    identity_destroy_proxy (self);
+    signon_proxy_set_not_ready (self);
+    self->registration_state = NOT_REGISTERED;
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+identity_schedule_eviction (SignonIdentity *self)
+{
+    identity_cancel_eviction (self);
+
+    if (self->idle_timeout == 0 || self->proxy == NULL ||
+        self->pending_operations > 0 || identity_has_sessions (self) ||
+        self->keep_alive)
+        return;
+
+    self->idle_source = g_timeout_source_new_seconds (self->idle_timeout);
+    g_source_set_callback (self->idle_source, identity_evict_cb, self, NULL);
+    /* Not the thread-default context, which during a synchronous call is
+     * only iterated until the call returns */
+    g_source_attach (self->idle_source, self->owner_context);
+}
+
+static void
+identity_task_completed_cb (GTask *task, GParamSpec *pspec,
+                            SignonIdentity *self)
+{
+    g_signal_handlers_disconnect_by_func (task, identity_task_completed_cb,
+                                          self);
+    self->pending_operations--;
+    identity_schedule_eviction (self);
+}
+
+/* Creates the task of an operation, which keeps the remote object from
+ * being released while it runs */
+static GTask *
+identity_task_new (SignonIdentity *self, GCancellable *cancellable,
+                   GAsyncReadyCallback callback, gpointer user_data)
+{
+    GTask *task = g_task_new (self, cancellable, callback, user_data);
+
+    self->pending_operations++;
+    identity_cancel_eviction (self);
+    g_signal_connect (task, "notify::completed",
+                      G_CALLBACK (identity_task_completed_cb), self);
+    return task;
+}
+
+/* Takes ownership of @identity_data */
+static void
+identity_set_data (SignonIdentity *self, GVariant *identity_data)
+{
+    identity_clear_info (self);
+    self->identity_data = identity_data;
+}
+
+static const SignonIdentityInfo *
+identity_get_info (SignonIdentity *self)
+{
+    if (self->identity_info == NULL && self->identity_data != NULL)
+    {
+        self->identity_info =
+            signon_identity_info_new_from_variant (self->identity_data);
+    }
+    return self->identity_info;
+}
+
 static GQuark
 identity_object_quark ()
 {
@@ -152,6 +337,34 @@ signon_identity_proxy_if_init (SignonProxyInterface *iface)
     iface->setup = signon_identity_proxy_setup;
 }
 
+static void
+signon_identity_init_async (GAsyncInitable *initable, int io_priority,
+                            GCancellable *cancellable,
+                            GAsyncReadyCallback callback, gpointer user_data)
+{
+    SignonIdentity *self = SIGNON_IDENTITY (initable);
+
+    /* Don't wait for an idle to start the registration */
+    identity_check_remote_registration (self);
+
+    signon_proxy_init_async (self, identity_object_quark (), cancellable,
+                             callback, user_data);
+}
+
+static gboolean
+signon_identity_init_finish (GAsyncInitable *initable, GAsyncResult *res,
+                             GError **error)
+{
+    return signon_proxy_init_finish (initable, res, error);
+}
+
+static void
+signon_identity_async_initable_if_init (GAsyncInitableIface *iface)
+{
+    iface->init_async = signon_identity_init_async;
+    iface->init_finish = signon_identity_init_finish;
+}
+
 static void
 signon_identity_set_property (GObject *object,
                               guint property_id,
@@ -195,6 +408,11 @@ signon_identity_init (SignonIdentity *identity)
 {
     identity->auth_service_proxy = sso_auth_service_get_instance();
     identity->cancellable = g_cancellable_new ();
+    identity->registration_cancellable = g_cancellable_new ();
+    identity->owner_thread = g_thread_self ();
+    identity->owner_context = signon_thread_context_ref ();
+    identity->sessions = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                g_free, NULL);
     identity->registration_state = NOT_REGISTERED;
 
     identity->removed = FALSE;
@@ -214,18 +432,20 @@ signon_identity_dispose (GObject *object)
         g_clear_object (&identity->cancellable);
     }
 
-    g_clear_object (&identity->auth_service_proxy);
-
-    if (identity->proxy)
+    if (identity->registration_cancellable)
     {
-        g_signal_handler_disconnect (identity->proxy, identity->signal_info_updated);
-        identity->signal_info_updated = 0;
-        g_signal_handler_disconnect (identity->proxy, identity->signal_unregistered);
-        identity->signal_unregistered = 0;
-        g_clear_object (&identity->proxy);
+        g_cancellable_cancel (identity->registration_cancellable);
+        g_clear_object (&identity->registration_cancellable);
     }
 
-    if (identity->sessions)
+    identity_cancel_eviction (identity);
+    if (identity->proxy)
+        identity_destroy_proxy (identity);
+
+    g_clear_object (&identity->auth_service_proxy);
+    g_clear_pointer (&identity->registration_context, g_main_context_unref);
+
+    if (identity_has_sessions (identity))
         g_critical ("SignonIdentity: the list of AuthSessions MUST be empty");
 
     G_OBJECT_CLASS (signon_identity_parent_class)->dispose (object);
@@ -236,7 +456,9 @@ signon_identity_finalize (GObject *object)
 {
     SignonIdentity *identity = SIGNON_IDENTITY (object);
 
-    g_clear_pointer (&identity->identity_info, signon_identity_info_free);
+    identity_clear_info (identity);
+    g_main_context_unref (identity->owner_context);
+    g_hash_table_unref (identity->sessions);
 
     G_OBJECT_CLASS (signon_identity_parent_class)->finalize (object);
 }
@@ -275,16 +497,44 @@ signon_identity_class_init (SignonIdentityClass *klass)
                                     0);
 }
 
+/* Tells @session which mechanisms the identity allows for its method, so that
+ * it can negotiate mechanisms without asking signond. */
 static void
-identity_state_changed_cb (GDBusProxy *proxy,
-                           gint state,
-                           gpointer user_data)
+identity_session_set_allowed_mechanisms (SignonIdentity *self,
+                                         SignonAuthSession *session)
 {
-    SignonIdentity *self;
+    const gchar **mechanisms = NULL;
 
-    g_return_if_fail (SIGNON_IS_IDENTITY (user_data));
+    /* Read the mechanisms directly from the identity data, without decoding
+     * the whole SignonIdentityInfo */
+    if (self->identity_data != NULL)
+    {
+        mechanisms =
+            signon_identity_info_variant_get_allowed_mechanisms (self->identity_data,
+                                                                 signon_auth_session_get_method (session));
+    }
 
-    self = SIGNON_IDENTITY (user_data);
+    signon_auth_session_set_allowed_mechanisms (session, mechanisms);
+    g_free (mechanisms);
+}
+
+static void
+identity_update_sessions (SignonIdentity *self)
+{
+    GHashTableIter iter;
+    gpointer session;
+
+    g_hash_table_iter_init (&iter, self->sessions);
+    while (g_hash_table_iter_next (&iter, NULL, &session))
+    {
+        identity_session_set_allowed_mechanisms (self,
+                                                 SIGNON_AUTH_SESSION (session));
+    }
+}
+
+static void
+identity_state_changed (SignonIdentity *self, gint state)
+{
     switch (state) {
         case DATA_UPDATED:
             DEBUG ("State changed to DATA_UPDATED");
@@ -304,24 +554,46 @@ identity_state_changed_cb (GDBusProxy *proxy,
 }
 
 static void
-identity_remote_object_destroyed_cb(GDBusProxy *proxy,
-                                    gpointer user_data)
+identity_remote_object_destroyed (SignonIdentity *self)
 {
-    SignonIdentity *self;
-
-    g_return_if_fail (SIGNON_IS_IDENTITY (user_data));
-
-    self = SIGNON_IDENTITY (user_data);
-    g_clear_object (&self->proxy);
+    identity_destroy_proxy (self);
 
     DEBUG ("%s %d", G_STRFUNC, __LINE__);
 
     signon_proxy_set_not_ready (self);
     self->registration_state = NOT_REGISTERED;
-    g_clear_pointer (&self->identity_info, signon_identity_info_free);
+    identity_clear_info (self);
     self->removed = FALSE;
     self->signed_out = FALSE;
     self->updated = FALSE;
+
+    /* Don't make the next operation on a kept alive identity wait for the
+     * registration */
+    if (self->keep_alive)
+        identity_check_remote_registration (self);
+}
+
+static void
+identity_signal_cb (const gchar *signal_name, GVariant *parameters,
+                    gpointer user_data)
+{
+    SignonIdentity *self;
+
+    g_return_if_fail (SIGNON_IS_IDENTITY (user_data));
+
+    self = SIGNON_IDENTITY (user_data);
+    if (g_strcmp0 (signal_name, "infoUpdated") == 0 &&
+        g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(i)")))
+    {
+        gint state;
+
+        g_variant_get (parameters, "(i)", &state);
+        identity_state_changed (self, state);
+    }
+    else if (g_strcmp0 (signal_name, "unregistered") == 0)
+    {
+        identity_remote_object_destroyed (self);
+    }
 }
 
 static void
@@ -349,9 +621,13 @@ identity_registered (SignonIdentity *identity,
         connection = g_dbus_proxy_get_connection (auth_service_proxy);
         bus_name = g_dbus_proxy_get_name (auth_service_proxy);
 
+        /* The Identity interface has no properties: creating the proxy
+         * must not cost a blocking round trip. Its signals are dispatched
+         * by the auth service, to keep the number of match rules constant. */
         identity->proxy =
             sso_identity_proxy_new_sync (connection,
-                                         G_DBUS_PROXY_FLAGS_NONE,
+                                         G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                         G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
                                          bus_name,
                                          object_path,
                                          identity->cancellable,
@@ -360,27 +636,23 @@ identity_registered (SignonIdentity *identity,
         {
             g_warning ("Failed to initialize Identity proxy: %s",
                        proxy_error->message);
-            g_clear_error (&proxy_error);
+            error = proxy_error;
+            if (identity_data)
+                g_variant_unref (identity_data);
+            goto ready;
         }
 
-        identity->signal_info_updated =
-            g_signal_connect (identity->proxy,
-                              "info-updated",
-                              G_CALLBACK (identity_state_changed_cb),
-                              identity);
-
-        identity->signal_unregistered =
-            g_signal_connect (identity->proxy,
-                              "unregistered",
-                              G_CALLBACK (identity_remote_object_destroyed_cb),
-                              identity);
+        identity->signal_watch =
+            sso_auth_service_watch_object (identity->auth_service_proxy,
+                                           object_path,
+                                           identity_signal_cb,
+                                           identity);
 
         if (identity_data)
         {
             DEBUG("%s: ", G_STRFUNC);
-            identity->identity_info =
-                signon_identity_info_new_from_variant (identity_data);
-            g_variant_unref (identity_data);
+            identity_set_data (identity, identity_data);
+            identity_update_sessions (identity);
         }
 
         identity->updated = TRUE;
@@ -409,16 +681,19 @@ identity_registered (SignonIdentity *identity,
     else
         g_warning ("%s: %s", G_STRFUNC, error->message);
 
+ready:
     /*
      * execute queued operations or emit errors on each of them
      * */
     identity->registration_state = REGISTERED;
+    g_clear_pointer (&identity->registration_context, g_main_context_unref);
 
     /*
      * TODO: if we will add a new state for identity: "INVALID"
      * consider emission of another error, like "invalid"
      * */
     signon_proxy_set_ready (identity, identity_object_quark (), error);
+    identity_schedule_eviction (identity);
 
     /*
      * as the registration failed we do not
@@ -458,6 +733,103 @@ signon_identity_set_id (SignonIdentity *identity, guint32 id)
     }
 }
 
+/**
+ * signon_identity_set_idle_timeout:
+ * @identity: the #SignonIdentity.
+ * @seconds: the timeout, in seconds, or 0 to disable it.
+ *
+ * Makes @identity release its connection to the remote identity object
+ * after @seconds without operations, while keeping the cached identity
+ * information. The next operation on @identity transparently registers it
+ * again with signond; while released, the identity is not notified about
+ * the changes made by other clients.
+ *
+ * The connection is never released while there are #SignonAuthSession
+ * objects created from @identity, nor while @identity is kept alive (see
+ * signon_identity_set_keep_alive()). By default, the idle timeout is
+ * disabled.
+ *
+ * Since: 2.1
+ */
+void
+signon_identity_set_idle_timeout (SignonIdentity *identity, guint seconds)
+{
+    g_return_if_fail (SIGNON_IS_IDENTITY (identity));
+
+    identity->idle_timeout = seconds;
+    identity_schedule_eviction (identity);
+}
+
+/**
+ * signon_identity_get_idle_timeout:
+ * @identity: the #SignonIdentity.
+ *
+ * Gets the timeout set with signon_identity_set_idle_timeout().
+ *
+ * Returns: the idle timeout, in seconds, or 0 if disabled.
+ *
+ * Since: 2.1
+ */
+guint
+signon_identity_get_idle_timeout (SignonIdentity *identity)
+{
+    g_return_val_if_fail (SIGNON_IS_IDENTITY (identity), 0);
+
+    return identity->idle_timeout;
+}
+
+/**
+ * signon_identity_set_keep_alive:
+ * @identity: the #SignonIdentity.
+ * @keep_alive: whether to keep the remote object registered.
+ *
+ * Makes @identity register its remote object again whenever signond
+ * releases it, so that the next operation doesn't wait for the
+ * registration, and the changes made by other clients keep being notified.
+ * Signond releases the remote objects after its inactivity timeout
+ * (SSO_IDENTITY_TIMEOUT, 300 seconds by default): while kept alive,
+ * @identity costs one registration call per timeout, so this is meant for
+ * the few identities which are used often. The timeout set with
+ * signon_identity_set_idle_timeout() does not apply meanwhile.
+ *
+ * By default, identities are not kept alive.
+ *
+ * Since: 2.1
+ */
+void
+signon_identity_set_keep_alive (SignonIdentity *identity, gboolean keep_alive)
+{
+    g_return_if_fail (SIGNON_IS_IDENTITY (identity));
+
+    identity->keep_alive = keep_alive;
+    if (keep_alive)
+    {
+        identity_cancel_eviction (identity);
+        if (identity->id != 0)
+            identity_check_remote_registration (identity);
+    }
+    else
+        identity_schedule_eviction (identity);
+}
+
+/**
+ * signon_identity_get_keep_alive:
+ * @identity: the #SignonIdentity.
+ *
+ * Gets whether @identity is kept alive; see signon_identity_set_keep_alive().
+ *
+ * Returns: %TRUE if the remote object is kept registered.
+ *
+ * Since: 2.1
+ */
+gboolean
+signon_identity_get_keep_alive (SignonIdentity *identity)
+{
+    g_return_val_if_fail (SIGNON_IS_IDENTITY (identity), FALSE);
+
+    return identity->keep_alive;
+}
+
 /**
  * signon_identity_get_last_error:
  * @identity: the #SignonIdentity.
@@ -520,27 +892,48 @@ identity_new_from_db_cb (GObject *object, GAsyncResult *res,
 static void
 identity_check_remote_registration (SignonIdentity *self)
 {
+    GMainContext *context;
+
     g_return_if_fail (SIGNON_IS_IDENTITY (self));
 
+    if (self->registration_state == PENDING_REGISTRATION &&
+        signon_sync_call_in_progress () &&
+        self->registration_context != g_main_context_get_thread_default ())
+    {
+        /* The reply would be dispatched to a context which this thread is
+         * not running: register again on the context of the call. */
+        DEBUG ("Restarting the registration");
+        g_cancellable_cancel (self->registration_cancellable);
+        g_object_unref (self->registration_cancellable);
+        self->registration_cancellable = g_cancellable_new ();
+        self->registration_state = NOT_REGISTERED;
+    }
+
     if (self->registration_state != NOT_REGISTERED)
         return;
 
+    context = signon_registration_context_push ();
+
     /* TODO: implement the application security context */
     if (self->id != 0)
         sso_auth_service_call_get_identity (self->auth_service_proxy,
                                             self->id,
                                             "*",
-                                            self->cancellable,
+                                            self->registration_cancellable,
                                             identity_new_from_db_cb,
                                             self);
     else
         sso_auth_service_call_register_new_identity (self->auth_service_proxy,
                                                      "*",
-                                                     self->cancellable,
+                                                     self->registration_cancellable,
                                                      identity_new_cb,
                                                      self);
 
+    g_clear_pointer (&self->registration_context, g_main_context_unref);
+    self->registration_context = g_main_context_ref_thread_default ();
     self->registration_state = PENDING_REGISTRATION;
+
+    signon_registration_context_pop (context);
 }
 
 /**
@@ -573,6 +966,10 @@ signon_identity_new_from_db (guint32 id)
  *
  * Construct new, empty, identity object.
  *
+ * The identity is registered with the signon daemon only when the first
+ * operation requiring it is performed, so that creating and discarding an
+ * identity which is never stored costs no D-Bus traffic.
+ *
  * Returns: an instance of an #SignonIdentity.
  */
 SignonIdentity*
@@ -583,11 +980,16 @@ signon_identity_new ()
     DEBUG ("%s %d", G_STRFUNC, __LINE__);
     identity = g_object_new (SIGNON_TYPE_IDENTITY, NULL);
     g_return_val_if_fail (SIGNON_IS_IDENTITY (identity), NULL);
-    identity_check_remote_registration (identity);
 
     return identity;
 }
 
+static gboolean
+identity_session_is (gpointer key, gpointer value, gpointer session)
+{
+    return value == session;
+}
+
 static void
 identity_session_object_destroyed_cb(gpointer data,
                                      GObject *where_the_session_was)
@@ -598,7 +1000,9 @@ identity_session_object_destroyed_cb(gpointer data,
     DEBUG ("%s %d", G_STRFUNC, __LINE__);
 
     self = SIGNON_IDENTITY (data);
-    self->sessions = g_slist_remove (self->sessions, (gpointer)where_the_session_was);
+    g_hash_table_foreach_remove (self->sessions, identity_session_is,
+                                 where_the_session_was);
+    identity_schedule_eviction (self);
     g_object_unref (self);
 }
 
@@ -608,9 +1012,10 @@ identity_session_object_destroyed_cb(gpointer data,
  * @method: method.
  * @error: pointer to a location which will receive the error, if any.
  *
- * Creates an authentication session for this identity.
+ * Creates an authentication session for this identity. If a session for
+ * @method already exists, a new reference to it is returned instead.
  *
- * Returns: (transfer full): a new #SignonAuthSession.
+ * Returns: (transfer full): a #SignonAuthSession.
  */
 SignonAuthSession *
 signon_identity_create_session(SignonIdentity *self,
@@ -631,31 +1036,19 @@ signon_identity_create_session(SignonIdentity *self,
         return NULL;
     }
 
-    GSList *list = self->sessions;
-    while (list)
+    SignonAuthSession *session = g_hash_table_lookup (self->sessions, method);
+    if (session)
     {
-        SignonAuthSession *session = SIGNON_AUTH_SESSION (self->sessions->data);
-        const gchar *sessionMethod = signon_auth_session_get_method (session);
-        if (g_strcmp0(sessionMethod, method) == 0)
-        {
-            DEBUG ("Auth Session with method `%s` already created.", method);
-            g_set_error (error,
-                         signon_error_quark(),
-                         SIGNON_ERROR_METHOD_NOT_AVAILABLE,
-                         "Authentication session for this method already requested.");
-            return NULL;
-        }
-
-        list = list->next;
+        DEBUG ("Reusing the auth session with method `%s`", method);
+        return g_object_ref (session);
     }
 
-    SignonAuthSession *session = signon_auth_session_new (self->id,
-                                                          method,
-                                                          error);
+    session = signon_auth_session_new (self->id, method, error);
     if (session)
     {
         DEBUG ("%s %d", G_STRFUNC, __LINE__);
-        self->sessions = g_slist_append(self->sessions, session);
+        identity_session_set_allowed_mechanisms (self, session);
+        g_hash_table_insert (self->sessions, g_strdup (method), session);
         g_object_weak_ref (G_OBJECT(session),
                            identity_session_object_destroyed_cb,
                            self);
@@ -680,7 +1073,9 @@ signon_identity_create_session(SignonIdentity *self,
  * authentication reply is available.
  * @user_data: user data to be passed to the callback.
  *
- * Stores the data from @info into the identity.
+ * Stores the data from @info into the identity. Once stored, @info only
+ * tracks the changes made to it afterwards, so that storing it again only
+ * sends those.
  *
  * Since: 2.0
  */
@@ -692,16 +1087,31 @@ signon_identity_store_info (SignonIdentity *self,
                             gpointer user_data)
 {
     GTask *task = NULL;
-    GVariant *info_variant = NULL;
+    IdentityStoreData *store_data;
 
     DEBUG ();
     g_return_if_fail (SIGNON_IS_IDENTITY (self));
     g_return_if_fail (info != NULL);
 
-    task = g_task_new (self, cancellable, callback, user_data);
+    task = identity_task_new (self, cancellable, callback, user_data);
     g_task_set_source_tag (task, signon_identity_store_info);
-    info_variant = signon_identity_info_to_variant (info);
-    g_task_set_task_data (task, g_variant_ref_sink (info_variant), (GDestroyNotify)g_variant_unref);
+    store_data = g_slice_new0 (IdentityStoreData);
+    store_data->info = signon_identity_info_copy (info);
+    store_data->info_variant = signon_identity_info_to_variant (info);
+    /* An info read from this same identity only needs its changes sent */
+    if (self->id != 0 &&
+        (guint)signon_identity_info_get_id (info) == self->id &&
+        sso_auth_service_get_update_supported ())
+    {
+        store_data->delta_variant =
+            signon_identity_info_to_variant_delta (info);
+    }
+    g_task_set_task_data (task, store_data,
+                          (GDestroyNotify)identity_store_data_free);
+
+    /* Don't wait for an idle to register a new identity: the store call
+     * will be sent as soon as the registration reply arrives. */
+    identity_check_remote_registration (self);
 
     signon_proxy_call_when_ready (self,
                                   identity_object_quark(),
@@ -731,6 +1141,57 @@ signon_identity_store_info_finish (SignonIdentity *self,
     return g_task_propagate_boolean (G_TASK (res), error);
 }
 
+/**
+ * signon_identity_store_info_sync:
+ * @self: the #SignonIdentity.
+ * @info: the #SignonIdentityInfo data to store.
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @error: return location for error, or %NULL.
+ *
+ * Synchronous version of signon_identity_store_info(). It doesn't need a main
+ * loop to be running, so it can be called from worker threads, as long as
+ * @self was created by the calling thread.
+ *
+ * Returns: %TRUE if the info has been stored, %FALSE otherwise.
+ *
+ * Since: 2.1
+ */
+gboolean
+signon_identity_store_info_sync (SignonIdentity *self,
+                                 const SignonIdentityInfo *info,
+                                 GCancellable *cancellable,
+                                 GError **error)
+{
+    SignonSyncCall call;
+    GAsyncResult *res;
+    gboolean stored;
+
+    g_return_val_if_fail (SIGNON_IS_IDENTITY (self), FALSE);
+    g_return_val_if_fail (self->owner_thread == g_thread_self (), FALSE);
+    g_return_val_if_fail (info != NULL, FALSE);
+
+    signon_sync_call_init (&call);
+    signon_identity_store_info (self, info, cancellable,
+                                signon_sync_call_done_cb, &call);
+    res = signon_sync_call_wait (&call);
+
+    stored = signon_identity_store_info_finish (self, res, error);
+    g_object_unref (res);
+    return stored;
+}
+
+static void
+identity_store_full_info (SignonIdentity *self, GTask *task)
+{
+    IdentityStoreData *store_data = g_task_get_task_data (task);
+
+    sso_identity_call_store (self->proxy,
+                             store_data->info_variant,
+                             g_task_get_cancellable (task),
+                             identity_store_info_reply,
+                             task);
+}
+
 static void
 identity_store_info_ready_cb (gpointer object, const GError *error, gpointer user_data)
 {
@@ -751,20 +1212,69 @@ identity_store_info_ready_cb (gpointer object, const GError *error, gpointer use
     }
     else
     {
+        IdentityStoreData *store_data = g_task_get_task_data (task);
+
         g_return_if_fail (self->proxy != NULL);
 
-        sso_identity_call_store (self->proxy,
-                                 g_task_get_task_data (task),
-                                 g_task_get_cancellable (task),
-                                 identity_store_info_reply,
-                                 task);
+        if (store_data->delta_variant != NULL)
+        {
+            sso_identity_call_update (self->proxy,
+                                      store_data->delta_variant,
+                                      g_task_get_cancellable (task),
+                                      identity_update_info_reply,
+                                      task);
+        }
+        else
+        {
+            identity_store_full_info (self, task);
+        }
     }
 }
 
 static void
-identity_store_info_reply (GObject *object,
-                           GAsyncResult *res,
-                           gpointer userdata)
+identity_store_info_complete (SignonIdentity *self, GTask *task, guint id)
+{
+    IdentityStoreData *store_data = g_task_get_task_data (task);
+    GVariant *stored = store_data->delta_variant != NULL ?
+        store_data->delta_variant : store_data->info_variant;
+    const gchar **realms = NULL;
+    GHashTableIter iter;
+    gpointer session;
+
+    g_return_if_fail (self->identity_data == NULL);
+
+    g_hash_table_iter_init (&iter, self->sessions);
+    while (g_hash_table_iter_next (&iter, NULL, &session))
+        signon_auth_session_set_id (SIGNON_AUTH_SESSION (session), id);
+
+    /* Keep the realm index in sync; a partial update might not touch the
+     * realms at all */
+    if (g_variant_lookup (stored, "Realms", "^a&s", &realms))
+    {
+        sso_auth_service_update_realm_index (id, realms);
+        g_free (realms);
+    }
+
+    signon_identity_set_id (self, id);
+
+    /* The info now matches what signond has: a later store of it only needs
+     * to send what changes next. An info of another identity was stored in
+     * full here, and its changes are still unknown to that identity. */
+    if ((guint)signon_identity_info_get_id (store_data->info) == id)
+        signon_identity_info_mark_stored (store_data->info);
+
+    /*
+     * if the previous state was REMOVED
+     * then we need to reset it
+     * */
+    self->removed = FALSE;
+    g_task_return_boolean (task, TRUE);
+}
+
+static void
+identity_update_info_reply (GObject *object,
+                            GAsyncResult *res,
+                            gpointer userdata)
 {
     GTask *task = (GTask *)userdata;
     SsoIdentity *proxy = SSO_IDENTITY (object);
@@ -777,26 +1287,45 @@ identity_store_info_reply (GObject *object,
     self = g_task_get_source_object (task);
     g_return_if_fail (SIGNON_IS_IDENTITY (self));
 
-    if (sso_identity_call_store_finish (proxy, &id, res, &error)) {
-        GSList *slist = self->sessions;
+    if (sso_identity_call_update_finish (proxy, &id, res, &error))
+    {
+        identity_store_info_complete (self, task, id);
+    }
+    else if (g_error_matches (error, G_DBUS_ERROR,
+                              G_DBUS_ERROR_UNKNOWN_METHOD))
+    {
+        DEBUG ("Partial updates not supported, storing the full info");
+        sso_auth_service_set_update_unsupported ();
+        g_error_free (error);
+        identity_store_full_info (self, task);
+        return;
+    }
+    else
+    {
+        g_task_return_error (task, error);
+    }
 
-        g_return_if_fail (self->identity_info == NULL);
+    g_object_unref (task);
+}
 
-        while (slist)
-        {
-            SignonAuthSession *session = SIGNON_AUTH_SESSION (self->sessions->data);
-            signon_auth_session_set_id (session, id);
-            slist = g_slist_next (slist);
-        }
+static void
+identity_store_info_reply (GObject *object,
+                           GAsyncResult *res,
+                           gpointer userdata)
+{
+    GTask *task = (GTask *)userdata;
+    SsoIdentity *proxy = SSO_IDENTITY (object);
+    SignonIdentity *self = NULL;
+    GError *error = NULL;
+    guint id;
 
-        signon_identity_set_id (self, id);
+    g_return_if_fail (task != NULL);
 
-        /*
-         * if the previous state was REMOVED
-         * then we need to reset it
-         * */
-        self->removed = FALSE;
-        g_task_return_boolean (task, TRUE);
+    self = g_task_get_source_object (task);
+    g_return_if_fail (SIGNON_IS_IDENTITY (self));
+
+    if (sso_identity_call_store_finish (proxy, &id, res, &error)) {
+        identity_store_info_complete (self, task, id);
     }
     else
     {
@@ -892,7 +1421,7 @@ signon_identity_verify_secret (SignonIdentity *self,
 
     DEBUG ("%s %d", G_STRFUNC, __LINE__);
 
-    task = g_task_new (self, cancellable, callback, user_data);
+    task = identity_task_new (self, cancellable, callback, user_data);
     g_task_set_source_tag (task, signon_identity_verify_secret);
     g_task_set_task_data (task, g_strdup (secret), (GDestroyNotify)g_free);
 
@@ -923,6 +1452,44 @@ signon_identity_verify_secret_finish (SignonIdentity *self,
     return g_task_propagate_boolean (G_TASK (res), error);
 }
 
+/**
+ * signon_identity_verify_secret_sync:
+ * @self: the #SignonIdentity.
+ * @secret: the secret (password) to be verified.
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @error: return location for error, or %NULL.
+ *
+ * Synchronous version of signon_identity_verify_secret(). It doesn't need a main
+ * loop to be running, so it can be called from worker threads, as long as
+ * @self was created by the calling thread.
+ *
+ * Returns: %TRUE if the secret is valid, %FALSE otherwise.
+ *
+ * Since: 2.1
+ */
+gboolean
+signon_identity_verify_secret_sync (SignonIdentity *self,
+                                    const gchar *secret,
+                                    GCancellable *cancellable,
+                                    GError **error)
+{
+    SignonSyncCall call;
+    GAsyncResult *res;
+    gboolean valid;
+
+    g_return_val_if_fail (SIGNON_IS_IDENTITY (self), FALSE);
+    g_return_val_if_fail (self->owner_thread == g_thread_self (), FALSE);
+
+    signon_sync_call_init (&call);
+    signon_identity_verify_secret (self, secret, cancellable,
+                                   signon_sync_call_done_cb, &call);
+    res = signon_sync_call_wait (&call);
+
+    valid = signon_identity_verify_secret_finish (self, res, error);
+    g_object_unref (res);
+    return valid;
+}
+
 static void
 identity_process_updated (SignonIdentity *self)
 {
@@ -931,8 +1498,12 @@ identity_process_updated (SignonIdentity *self)
     g_return_if_fail (SIGNON_IS_IDENTITY (self));
     g_return_if_fail (self->proxy != NULL);
 
-    g_clear_pointer (&self->identity_info, signon_identity_info_free);
+    identity_clear_info (self);
     self->updated = FALSE;
+    identity_update_sessions (self);
+
+    /* The change might have been made by another process */
+    sso_auth_service_invalidate_realm_index ();
 }
 
 static void
@@ -945,8 +1516,9 @@ identity_process_removed (SignonIdentity *self)
         return;
 
     self->removed = TRUE;
-    g_clear_pointer (&self->identity_info, signon_identity_info_free);
+    identity_clear_info (self);
 
+    sso_auth_service_update_realm_index (self->id, NULL);
     signon_identity_set_id (self, 0);
 }
 
@@ -960,13 +1532,9 @@ identity_process_signout(SignonIdentity *self)
     if (self->signed_out == TRUE)
         return;
 
-    GSList *llink = self->sessions;
-    while (llink)
-    {
-        GSList *next = llink->next;
-        g_object_unref (G_OBJECT(llink->data));
-        llink = next;
-    }
+    /* Releasing the sessions removes them from the table */
+    GList *sessions = g_hash_table_get_values (self->sessions);
+    g_list_free_full (sessions, g_object_unref);
 
     self->signed_out = TRUE;
     g_signal_emit(G_OBJECT(self), signals[SIGNEDOUT_SIGNAL], 0);
@@ -1020,7 +1588,10 @@ identity_removed_reply (GObject *object, GAsyncResult *res,
     g_return_if_fail (SIGNON_IS_IDENTITY (self));
 
     if (sso_identity_call_remove_finish (proxy, res, &error))
+    {
+        sso_auth_service_update_realm_index (self->id, NULL);
         g_task_return_boolean (task, TRUE);
+    }
     else
         g_task_return_error (task, error);
 
@@ -1123,7 +1694,7 @@ signon_identity_remove (SignonIdentity *self,
     GTask *task = NULL;
     g_return_if_fail (SIGNON_IS_IDENTITY (self));
 
-    task = g_task_new (self, cancellable, callback, user_data);
+    task = identity_task_new (self, cancellable, callback, user_data);
     g_task_set_source_tag (task, signon_identity_remove);
 
     signon_proxy_call_when_ready (self,
@@ -1142,6 +1713,42 @@ signon_identity_remove_finish (SignonIdentity *self,
     return g_task_propagate_boolean (G_TASK (res), error);
 }
 
+/**
+ * signon_identity_remove_sync:
+ * @self: the #SignonIdentity.
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @error: return location for error, or %NULL.
+ *
+ * Synchronous version of signon_identity_remove(). It doesn't need a main
+ * loop to be running, so it can be called from worker threads, as long as
+ * @self was created by the calling thread.
+ *
+ * Returns: %TRUE if the identity has been removed, %FALSE otherwise.
+ *
+ * Since: 2.1
+ */
+gboolean
+signon_identity_remove_sync (SignonIdentity *self,
+                             GCancellable *cancellable,
+                             GError **error)
+{
+    SignonSyncCall call;
+    GAsyncResult *res;
+    gboolean removed;
+
+    g_return_val_if_fail (SIGNON_IS_IDENTITY (self), FALSE);
+    g_return_val_if_fail (self->owner_thread == g_thread_self (), FALSE);
+
+    signon_sync_call_init (&call);
+    signon_identity_remove (self, cancellable,
+                            signon_sync_call_done_cb, &call);
+    res = signon_sync_call_wait (&call);
+
+    removed = signon_identity_remove_finish (self, res, error);
+    g_object_unref (res);
+    return removed;
+}
+
 /**
  * signon_identity_sign_out:
  * @self: the #SignonIdentity.
@@ -1165,7 +1772,7 @@ signon_identity_sign_out (SignonIdentity *self,
     GTask *task = NULL;
     g_return_if_fail (SIGNON_IS_IDENTITY (self));
 
-    task = g_task_new (self, cancellable, callback, user_data);
+    task = identity_task_new (self, cancellable, callback, user_data);
     g_task_set_source_tag (task, signon_identity_sign_out);
 
     signon_proxy_call_when_ready (self,
@@ -1184,6 +1791,42 @@ signon_identity_sign_out_finish (SignonIdentity *self,
     return g_task_propagate_boolean (G_TASK (res), error);
 }
 
+/**
+ * signon_identity_sign_out_sync:
+ * @self: the #SignonIdentity.
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @error: return location for error, or %NULL.
+ *
+ * Synchronous version of signon_identity_sign_out(). It doesn't need a main
+ * loop to be running, so it can be called from worker threads, as long as
+ * @self was created by the calling thread.
+ *
+ * Returns: %TRUE if the identity has been signed out, %FALSE otherwise.
+ *
+ * Since: 2.1
+ */
+gboolean
+signon_identity_sign_out_sync (SignonIdentity *self,
+                               GCancellable *cancellable,
+                               GError **error)
+{
+    SignonSyncCall call;
+    GAsyncResult *res;
+    gboolean signed_out;
+
+    g_return_val_if_fail (SIGNON_IS_IDENTITY (self), FALSE);
+    g_return_val_if_fail (self->owner_thread == g_thread_self (), FALSE);
+
+    signon_sync_call_init (&call);
+    signon_identity_sign_out (self, cancellable,
+                              signon_sync_call_done_cb, &call);
+    res = signon_sync_call_wait (&call);
+
+    signed_out = signon_identity_sign_out_finish (self, res, error);
+    g_object_unref (res);
+    return signed_out;
+}
+
 static void
 identity_query_info_reply (GObject *object,
                            GAsyncResult *res,
@@ -1204,13 +1847,15 @@ identity_query_info_reply (GObject *object,
 
     if (sso_identity_call_get_info_finish (proxy, &identity_data, res, &error))
     {
-        g_clear_pointer (&self->identity_info, (GDestroyNotify)signon_identity_info_free);
-        self->identity_info = signon_identity_info_new_from_variant (identity_data);
-        g_variant_unref (identity_data);
-        signon_identity_set_id (self, signon_identity_info_get_id (self->identity_info));
+        guint32 id = 0;
+
+        identity_set_data (self, identity_data);
+        g_variant_lookup (identity_data, "Id", "u", &id);
+        signon_identity_set_id (self, id);
+        identity_update_sessions (self);
 
         self->updated = TRUE;
-        g_task_return_pointer (task, signon_identity_info_copy (self->identity_info), (GDestroyNotify)signon_identity_info_free);
+        g_task_return_pointer (task, signon_identity_info_copy (identity_get_info (self)), (GDestroyNotify)signon_identity_info_free);
     }
     else
     {
@@ -1256,7 +1901,7 @@ identity_query_ready_cb (gpointer object, const GError *error, gpointer user_dat
                                  "Identity is not stored and has no info yet");
         g_object_unref (task);
     }
-    else if (self->updated == FALSE || self->identity_info == NULL)
+    else if (self->updated == FALSE || self->identity_data == NULL)
     {
         DEBUG ("%s %d", G_STRFUNC, __LINE__);
 
@@ -1270,7 +1915,7 @@ identity_query_ready_cb (gpointer object, const GError *error, gpointer user_dat
     {
         DEBUG ("%s %d", G_STRFUNC, __LINE__);
 
-        g_task_return_pointer (task, signon_identity_info_copy (self->identity_info), (GDestroyNotify)signon_identity_info_free);
+        g_task_return_pointer (task, signon_identity_info_copy (identity_get_info (self)), (GDestroyNotify)signon_identity_info_free);
         g_object_unref (task);
     }
 }
@@ -1296,7 +1941,7 @@ signon_identity_query_info (SignonIdentity *self,
     GTask *task = NULL;
     g_return_if_fail (SIGNON_IS_IDENTITY (self));
 
-    task = g_task_new (self, cancellable, callback, user_data);
+    task = identity_task_new (self, cancellable, callback, user_data);
     g_task_set_source_tag (task, signon_identity_query_info);
 
     signon_proxy_call_when_ready (self,
@@ -1325,3 +1970,261 @@ signon_identity_query_info_finish (SignonIdentity *self,
 
     return g_task_propagate_pointer (G_TASK (res), error);
 }
+
+/**
+ * signon_identity_query_info_sync:
+ * @self: the #SignonIdentity.
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @error: return location for error, or %NULL.
+ *
+ * Synchronous version of signon_identity_query_info(). It doesn't need a main
+ * loop to be running, so it can be called from worker threads, as long as
+ * @self was created by the calling thread.
+ *
+ * Returns: (transfer full): a #SignonIdentityInfo for the identity, or %NULL
+ * on failure.
+ *
+ * Since: 2.1
+ */
+SignonIdentityInfo *
+signon_identity_query_info_sync (SignonIdentity *self,
+                                 GCancellable *cancellable,
+                                 GError **error)
+{
+    SignonSyncCall call;
+    GAsyncResult *res;
+    SignonIdentityInfo *info;
+
+    g_return_val_if_fail (SIGNON_IS_IDENTITY (self), NULL);
+    g_return_val_if_fail (self->owner_thread == g_thread_self (), NULL);
+
+    signon_sync_call_init (&call);
+    signon_identity_query_info (self, cancellable,
+                                signon_sync_call_done_cb, &call);
+    res = signon_sync_call_wait (&call);
+
+    info = signon_identity_query_info_finish (self, res, error);
+    g_object_unref (res);
+    return info;
+}
+
+static void
+identity_reference_data_free (IdentityReferenceData *data)
+{
+    g_free (data->reference);
+    g_slice_free (IdentityReferenceData, data);
+}
+
+static void
+identity_reference_reply (GObject *object,
+                          GAsyncResult *res,
+                          gpointer userdata)
+{
+    SsoIdentity *proxy = SSO_IDENTITY (object);
+    GTask *task = (GTask *)userdata;
+    IdentityReferenceData *data = g_task_get_task_data (task);
+    GError *error = NULL;
+    gboolean ok;
+    gint id;
+
+    if (data->add)
+        ok = sso_identity_call_add_reference_finish (proxy, &id, res, &error);
+    else
+        ok = sso_identity_call_remove_reference_finish (proxy, &id, res,
+                                                        &error);
+
+    if (!ok)
+    {
+        g_task_return_error (task, error);
+        g_object_unref (task);
+        return;
+    }
+
+    g_task_return_boolean (task, TRUE);
+    g_object_unref (task);
+}
+
+static void
+identity_reference_ready_cb (gpointer object, const GError *error,
+                             gpointer user_data)
+{
+    SignonIdentity *self = (SignonIdentity *)object;
+    GTask *task = (GTask *)user_data;
+    IdentityReferenceData *data;
+
+    g_return_if_fail (SIGNON_IS_IDENTITY (self));
+    g_return_if_fail (task != NULL);
+
+    data = g_task_get_task_data (task);
+    if (self->removed == TRUE || self->id == 0)
+    {
+        g_task_return_new_error (task,
+                                 signon_error_quark (),
+                                 SIGNON_ERROR_IDENTITY_NOT_FOUND,
+                                 self->removed ?
+                                 "Already removed from database." :
+                                 "The identity is not stored.");
+        g_object_unref (task);
+    }
+    else if (error)
+    {
+        DEBUG ("IdentityError: %s", error->message);
+        g_task_return_error (task, g_error_copy (error));
+        g_object_unref (task);
+    }
+    else if (data->add)
+    {
+        g_return_if_fail (self->proxy != NULL);
+        sso_identity_call_add_reference (self->proxy,
+                                         data->reference,
+                                         g_task_get_cancellable (task),
+                                         identity_reference_reply,
+                                         task);
+    }
+    else
+    {
+        g_return_if_fail (self->proxy != NULL);
+        sso_identity_call_remove_reference (self->proxy,
+                                            data->reference,
+                                            g_task_get_cancellable (task),
+                                            identity_reference_reply,
+                                            task);
+    }
+}
+
+static void
+identity_change_reference (SignonIdentity *self,
+                           const gchar *reference,
+                           gboolean add,
+                           GCancellable *cancellable,
+                           GAsyncReadyCallback callback,
+                           gpointer user_data,
+                           gpointer source_tag)
+{
+    IdentityReferenceData *data;
+    GTask *task;
+
+    task = identity_task_new (self, cancellable, callback, user_data);
+    g_task_set_source_tag (task, source_tag);
+
+    data = g_slice_new (IdentityReferenceData);
+    data->reference = g_strdup (reference);
+    data->add = add;
+    g_task_set_task_data (task, data,
+                          (GDestroyNotify)identity_reference_data_free);
+
+    signon_proxy_call_when_ready (self,
+                                  identity_object_quark (),
+                                  identity_reference_ready_cb,
+                                  task);
+}
+
+/**
+ * signon_identity_add_reference:
+ * @self: the #SignonIdentity.
+ * @reference: a name for the reference.
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @callback: a callback which will be called when the reference is added.
+ * @user_data: user data to be passed to the callback.
+ *
+ * Adds a named reference to the stored identity, telling signond that
+ * the calling application uses it. References are persistent: signond
+ * stores them in its database, and they stay there after @self is
+ * destroyed and the application exits, until they are removed with
+ * signon_identity_remove_reference() or the identity is removed.
+ *
+ * References don't affect the remote object of @self, which signond
+ * releases after its inactivity timeout all the same; to keep it
+ * registered, see signon_identity_set_keep_alive().
+ *
+ * Since: 2.1
+ */
+void
+signon_identity_add_reference (SignonIdentity *self,
+                               const gchar *reference,
+                               GCancellable *cancellable,
+                               GAsyncReadyCallback callback,
+                               gpointer user_data)
+{
+    g_return_if_fail (SIGNON_IS_IDENTITY (self));
+    g_return_if_fail (reference != NULL);
+
+    identity_change_reference (self, reference, TRUE,
+                               cancellable, callback, user_data,
+                               signon_identity_add_reference);
+}
+
+/**
+ * signon_identity_add_reference_finish:
+ * @self: the #SignonIdentity.
+ * @res: A #GAsyncResult obtained from the #GAsyncReadyCallback passed to
+ * signon_identity_add_reference().
+ * @error: return location for error, or %NULL.
+ *
+ * Collect the result of the signon_identity_add_reference() operation.
+ *
+ * Returns: %TRUE if the reference was added, %FALSE otherwise.
+ *
+ * Since: 2.1
+ */
+gboolean
+signon_identity_add_reference_finish (SignonIdentity *self,
+                                      GAsyncResult *res,
+                                      GError **error)
+{
+    g_return_val_if_fail (g_task_is_valid (res, self), FALSE);
+
+    return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+/**
+ * signon_identity_remove_reference:
+ * @self: the #SignonIdentity.
+ * @reference: the name of a reference added with
+ * signon_identity_add_reference().
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @callback: a callback which will be called when the reference is removed.
+ * @user_data: user data to be passed to the callback.
+ *
+ * Removes a named reference from the stored identity, added by this or by
+ * an earlier instance of the application.
+ *
+ * Since: 2.1
+ */
+void
+signon_identity_remove_reference (SignonIdentity *self,
+                                  const gchar *reference,
+                                  GCancellable *cancellable,
+                                  GAsyncReadyCallback callback,
+                                  gpointer user_data)
+{
+    g_return_if_fail (SIGNON_IS_IDENTITY (self));
+    g_return_if_fail (reference != NULL);
+
+    identity_change_reference (self, reference, FALSE,
+                               cancellable, callback, user_data,
+                               signon_identity_remove_reference);
+}
+
+/**
+ * signon_identity_remove_reference_finish:
+ * @self: the #SignonIdentity.
+ * @res: A #GAsyncResult obtained from the #GAsyncReadyCallback passed to
+ * signon_identity_remove_reference().
+ * @error: return location for error, or %NULL.
+ *
+ * Collect the result of the signon_identity_remove_reference() operation.
+ *
+ * Returns: %TRUE if the reference was removed, %FALSE otherwise.
+ *
+ * Since: 2.1
+ */
+gboolean
+signon_identity_remove_reference_finish (SignonIdentity *self,
+                                         GAsyncResult *res,
+                                         GError **error)
+{
+    g_return_val_if_fail (g_task_is_valid (res, self), FALSE);
+
+    return g_task_propagate_boolean (G_TASK (res), error);
+}
@@ -42,6 +42,13 @@ guint32 signon_identity_get_id (SignonIdentity *identity);
 
 const GError *signon_identity_get_last_error (SignonIdentity *identity);
 
+void signon_identity_set_idle_timeout (SignonIdentity *identity,
+                                       guint seconds);
+guint signon_identity_get_idle_timeout (SignonIdentity *identity);
+void signon_identity_set_keep_alive (SignonIdentity *identity,
+                                     gboolean keep_alive);
+gboolean signon_identity_get_keep_alive (SignonIdentity *identity);
+
 SignonAuthSession *signon_identity_create_session(SignonIdentity *self,
                                                   const gchar *method,
                                                   GError **error);
@@ -54,6 +61,10 @@ void signon_identity_store_info (SignonIdentity *self,
 gboolean signon_identity_store_info_finish (SignonIdentity *self,
                                             GAsyncResult *res,
                                             GError **error);
+gboolean signon_identity_store_info_sync (SignonIdentity *self,
+                                          const SignonIdentityInfo *info,
+                                          GCancellable *cancellable,
+                                          GError **error);
 
 void signon_identity_verify_secret (SignonIdentity *self,
                                     const gchar *secret,
@@ -63,6 +74,10 @@ void signon_identity_verify_secret (SignonIdentity *self,
 gboolean signon_identity_verify_secret_finish (SignonIdentity *self,
                                                GAsyncResult *res,
                                                GError **error);
+gboolean signon_identity_verify_secret_sync (SignonIdentity *self,
+                                             const gchar *secret,
+                                             GCancellable *cancellable,
+                                             GError **error);
 
 void signon_identity_query_info (SignonIdentity *self,
                                  GCancellable *cancellable,
@@ -71,6 +86,9 @@ void signon_identity_query_info (SignonIdentity *self,
 SignonIdentityInfo *signon_identity_query_info_finish (SignonIdentity *self,
                                                        GAsyncResult *res,
                                                        GError **error);
+SignonIdentityInfo *signon_identity_query_info_sync (SignonIdentity *self,
+                                                     GCancellable *cancellable,
+                                                     GError **error);
 
 void signon_identity_remove (SignonIdentity *self,
                              GCancellable *cancellable,
@@ -79,6 +97,9 @@ void signon_identity_remove (SignonIdentity *self,
 gboolean signon_identity_remove_finish (SignonIdentity *self,
                                         GAsyncResult *res,
                                         GError **error);
+gboolean signon_identity_remove_sync (SignonIdentity *self,
+                                      GCancellable *cancellable,
+                                      GError **error);
 
 void signon_identity_sign_out (SignonIdentity *self,
                                GCancellable *cancellable,
@@ -87,6 +108,27 @@ void signon_identity_sign_out (SignonIdentity *self,
 gboolean signon_identity_sign_out_finish (SignonIdentity *self,
                                           GAsyncResult *res,
                                           GError **error);
+gboolean signon_identity_sign_out_sync (SignonIdentity *self,
+                                        GCancellable *cancellable,
+                                        GError **error);
+
+void signon_identity_add_reference (SignonIdentity *self,
+                                    const gchar *reference,
+                                    GCancellable *cancellable,
+                                    GAsyncReadyCallback callback,
+                                    gpointer user_data);
+gboolean signon_identity_add_reference_finish (SignonIdentity *self,
+                                               GAsyncResult *res,
+                                               GError **error);
+
+void signon_identity_remove_reference (SignonIdentity *self,
+                                       const gchar *reference,
+                                       GCancellable *cancellable,
+                                       GAsyncReadyCallback callback,
+                                       gpointer user_data);
+gboolean signon_identity_remove_reference_finish (SignonIdentity *self,
+                                                  GAsyncResult *res,
+                                                  GError **error);
 
 G_END_DECLS
 
@@ -36,23 +36,59 @@
     #define DEBUG(...) do {} while (0)
 #endif
 
+#include <gio/gunixfdlist.h>
+
 #include "signon-identity.h"
 #include "signon-auth-session.h"
 #include "signon-security-context.h"
 
 G_BEGIN_DECLS
 
-struct _SignonIdentityInfo
+/* The fields of a SignonIdentityInfo which can be stored separately */
+typedef enum {
+    SIGNON_IDENTITY_INFO_FIELD_USERNAME = 1 << 0,
+    SIGNON_IDENTITY_INFO_FIELD_SECRET = 1 << 1, /* with StoreSecret */
+    SIGNON_IDENTITY_INFO_FIELD_CAPTION = 1 << 2,
+    SIGNON_IDENTITY_INFO_FIELD_METHODS = 1 << 3,
+    SIGNON_IDENTITY_INFO_FIELD_REALMS = 1 << 4,
+    SIGNON_IDENTITY_INFO_FIELD_ACL = 1 << 5,
+    SIGNON_IDENTITY_INFO_FIELD_TYPE = 1 << 6,
+    SIGNON_IDENTITY_INFO_FIELD_ALL = (1 << 7) - 1,
+} SignonIdentityInfoField;
+
+typedef struct _SignonIdentityInfoData SignonIdentityInfoData;
+
+/* The contents of a SignonIdentityInfo: shared by its copies and copied
+ * when one of them is modified */
+struct _SignonIdentityInfoData
 {
+    gint ref_count;
     gint id;
     gchar *username;
     gchar *secret;
     gchar *caption;
     gboolean store_secret;
-    GHashTable *methods;
+    /* IdentityInfoMethod items sorted by method; NULL if there are none */
+    GArray *methods;
     gchar **realms;
     GList *access_control_list;
     SignonIdentityType type;
+    /* Serialized form, built on demand (and published atomically) and
+     * dropped by the setters */
+    GVariant *methods_variant;
+    GVariant *acl_variant;
+    GVariant *variant;
+    /* Fields changed since the info was received from signond, or last
+     * stored; accessed atomically, since it's reset on shared data */
+    guint changed_fields;
+};
+
+struct _SignonIdentityInfo
+{
+    SignonIdentityInfoData *data;
+    /* Built by signon_identity_info_get_methods(), borrowing the contents of
+     * data->methods; kept in sync with them, also when the data is copied */
+    GHashTable *methods_table;
 };
 
 struct _SignonSecurityContext
@@ -64,6 +100,7 @@ struct _SignonSecurityContext
 #define SIGNOND_SERVICE_PREFIX "com.google.code.AccountsSSO.SingleSignOn"
 #define SIGNON_DBUS_ERROR_PREFIX SIGNOND_SERVICE_PREFIX ".Error."
 #define SIGNOND_DAEMON_OBJECTPATH "/com/google/code/AccountsSSO/SingleSignOn"
+#define SIGNOND_IDENTITY_INTERFACE SIGNOND_SERVICE_PREFIX ".Identity"
 
 /*
  * Common server/client sides error names and messages
@@ -117,6 +154,12 @@ struct _SignonSecurityContext
 #define SIGNOND_INCORRECT_DATE_ERR_NAME SIGNON_DBUS_ERROR_PREFIX "IncorrectDate"
 #define SIGNOND_USER_ERROR_ERR_NAME SIGNON_DBUS_ERROR_PREFIX "User"
 
+/*
+ * Session data keys negotiating the passing of values as file descriptors
+ * */
+#define SIGNON_SESSION_DATA_FD_PASSING_REQUESTED "_SignonFdPassingRequested"
+#define SIGNON_SESSION_DATA_FD_PASSING_SUPPORTED "_SignonFdPassingSupported"
+
 G_GNUC_INTERNAL
 SignonIdentityInfo *
 signon_identity_info_new_from_variant (GVariant *variant);
@@ -125,6 +168,23 @@ G_GNUC_INTERNAL
 GVariant *
 signon_identity_info_to_variant (const SignonIdentityInfo *self);
 
+G_GNUC_INTERNAL
+GVariant *
+signon_identity_info_to_variant_delta (const SignonIdentityInfo *self);
+
+G_GNUC_INTERNAL
+void signon_identity_info_mark_stored (SignonIdentityInfo *self);
+
+G_GNUC_INTERNAL
+const gchar **
+signon_identity_info_variant_get_allowed_mechanisms (GVariant *variant,
+                                                     const gchar *method);
+
+G_GNUC_INTERNAL
+gboolean
+signon_identity_info_mechanism_matches (const gchar * const *mechanisms,
+                                        const gchar *mechanism);
+
 G_GNUC_INTERNAL
 SignonSecurityContext *
 signon_security_context_new_from_variant (GVariant *variant);
@@ -141,6 +201,39 @@ G_GNUC_INTERNAL
 void signon_auth_session_set_id(SignonAuthSession* self,
                                 gint32 id);
 
+G_GNUC_INTERNAL
+void signon_auth_session_set_allowed_mechanisms (SignonAuthSession *self,
+                                                 const gchar * const *mechanisms);
+
+G_GNUC_INTERNAL
+GVariant *signon_session_data_encode_fds (GVariant *session_data,
+                                          gsize threshold,
+                                          GUnixFDList *fd_list);
+
+G_GNUC_INTERNAL
+GVariant *signon_session_data_decode_fds (GVariant *session_data,
+                                          GUnixFDList *fd_list,
+                                          gboolean *fd_passing_supported,
+                                          GError **error);
+
+typedef struct _SignonRealmIndex SignonRealmIndex;
+
+G_GNUC_INTERNAL
+SignonRealmIndex *signon_realm_index_new (void);
+
+G_GNUC_INTERNAL
+void signon_realm_index_free (SignonRealmIndex *self);
+
+G_GNUC_INTERNAL
+void signon_realm_index_set (SignonRealmIndex *self,
+                             guint32 id,
+                             const gchar * const *realms);
+
+G_GNUC_INTERNAL
+void signon_realm_index_lookup (SignonRealmIndex *self,
+                                const gchar *host,
+                                GArray *ids);
+
 G_END_DECLS
 
 #endif
@@ -39,6 +39,17 @@ typedef struct {
     GSource *idle_source;
 } SignonReadyData;
 
+typedef struct {
+    GSource *cancel_source;
+    gboolean returned;
+} SignonInitData;
+
+/* The context on which the synchronous calls made by a thread run */
+static GPrivate sync_context =
+    G_PRIVATE_INIT ((GDestroyNotify)g_main_context_unref);
+/* The innermost synchronous call running in a thread */
+static GPrivate current_sync_call;
+
 static void
 signon_proxy_default_init (SignonProxyInterface *iface)
 {
@@ -104,8 +115,8 @@ signon_ready_data_free (SignonReadyData *rd)
     g_slice_free (SignonReadyData, rd);
 }
 
-static gboolean
-signon_proxy_call_when_ready_idle (SignonReadyData *rd)
+static void
+signon_proxy_check_ready (SignonReadyData *rd)
 {
     if (GPOINTER_TO_INT (g_object_get_qdata((GObject*)rd->self,
                            _signon_proxy_ready_quark())) == TRUE)
@@ -119,6 +130,12 @@ signon_proxy_call_when_ready_idle (SignonReadyData *rd)
     {
         signon_proxy_setup (SIGNON_PROXY (rd->self));
     }
+}
+
+static gboolean
+signon_proxy_call_when_ready_idle (SignonReadyData *rd)
+{
+    signon_proxy_check_ready (rd);
 
     g_main_context_unref (g_source_get_context (rd->idle_source));
     rd->idle_source = NULL;
@@ -166,7 +183,15 @@ signon_proxy_call_when_ready (gpointer object, GQuark quark, SignonReadyCb callb
     }
 
     rd->callbacks = g_slist_append (rd->callbacks, cb);
-    if (!rd->idle_source)
+    if (signon_sync_call_in_progress ())
+    {
+        /* Nothing else can run on this thread until the synchronous call
+         * returns: there's no need to wait for an idle */
+        g_object_ref (object);
+        signon_proxy_check_ready (rd);
+        g_object_unref (object);
+    }
+    else if (!rd->idle_source)
     {
         rd->idle_source = g_idle_source_new ();
         g_source_set_callback (rd->idle_source,
@@ -223,3 +248,301 @@ signon_proxy_get_last_error (gpointer object)
     return g_object_get_qdata((GObject *)object,
                               _signon_proxy_error_quark());
 }
+
+static void
+signon_init_data_free (SignonInitData *init_data)
+{
+    if (init_data->cancel_source)
+    {
+        g_source_destroy (init_data->cancel_source);
+        g_source_unref (init_data->cancel_source);
+    }
+    g_slice_free (SignonInitData, init_data);
+}
+
+static gboolean
+signon_proxy_init_cancelled_cb (GCancellable *cancellable, gpointer user_data)
+{
+    GTask *task = G_TASK (user_data);
+    SignonInitData *init_data = g_task_get_task_data (task);
+
+    /* The ready callback still holds a reference on the task, and will
+     * ignore the result once it's invoked. */
+    init_data->returned = TRUE;
+    g_clear_pointer (&init_data->cancel_source, g_source_unref);
+    g_task_return_error_if_cancelled (task);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+signon_proxy_init_ready_cb (gpointer object, const GError *error,
+                            gpointer user_data)
+{
+    GTask *task = G_TASK (user_data);
+    SignonInitData *init_data = g_task_get_task_data (task);
+
+    if (!init_data->returned)
+    {
+        init_data->returned = TRUE;
+        if (init_data->cancel_source)
+        {
+            g_source_destroy (init_data->cancel_source);
+            g_clear_pointer (&init_data->cancel_source, g_source_unref);
+        }
+
+        if (error != NULL)
+            g_task_return_error (task, g_error_copy (error));
+        else
+            g_task_return_boolean (task, TRUE);
+    }
+
+    g_object_unref (task);
+}
+
+/*
+ * signon_proxy_init_async:
+ * @self: the #SignonProxy.
+ * @quark: the quark used by @self for its readiness.
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @callback: a callback to execute upon completion.
+ * @user_data: closure data for @callback.
+ *
+ * Waits for @self to be ready, without issuing any operation on it. This
+ * implements #GAsyncInitable for the objects having a remote counterpart.
+ */
+void
+signon_proxy_init_async (gpointer self, GQuark quark,
+                         GCancellable *cancellable,
+                         GAsyncReadyCallback callback, gpointer user_data)
+{
+    SignonInitData *init_data;
+    GTask *task;
+
+    g_return_if_fail (SIGNON_IS_PROXY (self));
+
+    task = g_task_new (self, cancellable, callback, user_data);
+    g_task_set_source_tag (task, signon_proxy_init_async);
+    init_data = g_slice_new0 (SignonInitData);
+    g_task_set_task_data (task, init_data,
+                          (GDestroyNotify)signon_init_data_free);
+
+    if (g_task_return_error_if_cancelled (task))
+    {
+        g_object_unref (task);
+        return;
+    }
+
+    /* The readiness callbacks cannot be removed: on cancellation the task
+     * returns immediately, and the callback only drops its reference. */
+    if (cancellable != NULL)
+    {
+        init_data->cancel_source = g_cancellable_source_new (cancellable);
+        g_task_attach_source (task, init_data->cancel_source,
+                              (GSourceFunc)signon_proxy_init_cancelled_cb);
+    }
+
+    signon_proxy_call_when_ready (self, quark, signon_proxy_init_ready_cb,
+                                  task);
+}
+
+gboolean
+signon_proxy_init_finish (gpointer self, GAsyncResult *res, GError **error)
+{
+    g_return_val_if_fail (g_task_is_valid (res, self), FALSE);
+
+    return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+static GMainContext *
+signon_sync_context_get (void)
+{
+    GMainContext *context = g_private_get (&sync_context);
+
+    if (context == NULL)
+    {
+        context = g_main_context_new ();
+        g_private_set (&sync_context, context);
+    }
+    return context;
+}
+
+/*
+ * signon_sync_call_init:
+ * @call: the #SignonSyncCall.
+ *
+ * Starts a synchronous call: until signon_sync_call_wait() returns, the
+ * asynchronous operations started by this thread run on a private context,
+ * which doesn't require the thread to have a main loop.
+ */
+void
+signon_sync_call_init (SignonSyncCall *call)
+{
+    call->outer_call = g_private_get (&current_sync_call);
+    call->thread_context = signon_thread_context_ref ();
+    call->context = signon_sync_context_get ();
+    call->result = NULL;
+    g_private_set (&current_sync_call, call);
+    g_main_context_push_thread_default (call->context);
+}
+
+/*
+ * signon_sync_call_done_cb:
+ *
+ * The #GAsyncReadyCallback to pass, with the #SignonSyncCall as user data, to
+ * the asynchronous operation implementing the synchronous call.
+ */
+void
+signon_sync_call_done_cb (GObject *source_object, GAsyncResult *res,
+                          gpointer user_data)
+{
+    SignonSyncCall *call = user_data;
+
+    call->result = g_object_ref (res);
+}
+
+/*
+ * signon_sync_call_wait:
+ * @call: the #SignonSyncCall.
+ *
+ * Waits for the asynchronous operation to complete, and ends the call.
+ *
+ * Returns: (transfer full): the result of the operation.
+ */
+GAsyncResult *
+signon_sync_call_wait (SignonSyncCall *call)
+{
+    while (call->result == NULL)
+        g_main_context_iteration (call->context, TRUE);
+
+    g_main_context_pop_thread_default (call->context);
+    g_private_set (&current_sync_call, call->outer_call);
+    g_main_context_unref (call->thread_context);
+    return call->result;
+}
+
+gboolean
+signon_sync_call_in_progress (void)
+{
+    GMainContext *context = g_private_get (&sync_context);
+
+    return context != NULL && context == g_main_context_get_thread_default ();
+}
+
+/*
+ * signon_thread_context_ref:
+ *
+ * Gets the context where the objects of the calling thread dispatch the
+ * signals and timeouts meant for it: the thread-default context, but not
+ * the private one of a synchronous call, which stops being iterated once
+ * the call returns.
+ *
+ * A thread with no thread-default context would get them dispatched by the
+ * thread running the global default context: if another thread is running
+ * it, they go to the context of the synchronous calls of this thread
+ * instead, where its next synchronous call will get them.
+ *
+ * Returns: (transfer full): the #GMainContext of the thread.
+ */
+GMainContext *
+signon_thread_context_ref (void)
+{
+    SignonSyncCall *call = g_private_get (&current_sync_call);
+    GMainContext *context;
+
+    if (call != NULL)
+        return g_main_context_ref (call->thread_context);
+
+    context = g_main_context_get_thread_default ();
+    if (context != NULL)
+        return g_main_context_ref (context);
+
+    context = g_main_context_default ();
+    if (g_main_context_acquire (context))
+    {
+        g_main_context_release (context);
+        return g_main_context_ref (context);
+    }
+
+    return g_main_context_ref (signon_sync_context_get ());
+}
+
+/*
+ * signon_thread_context_push:
+ *
+ * To be called before subscribing to D-Bus signals meant for the calling
+ * thread, which GDBus dispatches in the thread-default context: during a
+ * synchronous call, it makes the context of the thread the thread-default
+ * one again.
+ *
+ * Returns: the context pushed, to be passed to signon_thread_context_pop(),
+ * or %NULL.
+ */
+GMainContext *
+signon_thread_context_push (void)
+{
+    GMainContext *context = signon_thread_context_ref ();
+    GMainContext *current = g_main_context_ref_thread_default ();
+    gboolean pushed = FALSE;
+
+    /* Pushing a context requires owning it */
+    if (context != current && g_main_context_acquire (context))
+    {
+        g_main_context_push_thread_default (context);
+        g_main_context_release (context);
+        pushed = TRUE;
+    }
+
+    g_main_context_unref (current);
+    if (!pushed)
+        g_clear_pointer (&context, g_main_context_unref);
+    return context;
+}
+
+void
+signon_thread_context_pop (GMainContext *context)
+{
+    if (context != NULL)
+    {
+        g_main_context_pop_thread_default (context);
+        g_main_context_unref (context);
+    }
+}
+
+/*
+ * signon_registration_context_push:
+ *
+ * To be called before starting the registration of a remote object, so
+ * that its reply is dispatched in the context of the calling thread (see
+ * signon_thread_context_ref()), even if the thread has no thread-default
+ * context.
+ *
+ * Returns: the context pushed, to be passed to
+ * signon_registration_context_pop(), or %NULL.
+ */
+GMainContext *
+signon_registration_context_push (void)
+{
+    GMainContext *context;
+
+    if (g_main_context_get_thread_default () != NULL)
+        return NULL;
+
+    context = signon_thread_context_ref ();
+    if (context == g_main_context_default ())
+    {
+        g_main_context_unref (context);
+        return NULL;
+    }
+
+    /* The context of the synchronous calls lives as long as the thread */
+    g_main_context_push_thread_default (context);
+    g_main_context_unref (context);
+    return context;
+}
+
+void
+signon_registration_context_pop (GMainContext *context)
+{
+    if (context != NULL)
+        g_main_context_pop_thread_default (context);
+}
@@ -26,6 +26,7 @@
 #ifndef _SIGNON_PROXY_H_
 #define _SIGNON_PROXY_H_
 
+#include <gio/gio.h>
 #include <glib.h>
 #include <glib-object.h>
 
@@ -38,6 +39,16 @@ G_DECLARE_INTERFACE(SignonProxy, signon_proxy, SIGNON, PROXY, GObject)
 typedef void (*SignonReadyCb) (gpointer object, const GError *error,
                                gpointer user_data);
 
+typedef struct _SignonSyncCall SignonSyncCall;
+
+struct _SignonSyncCall {
+    GMainContext *context;
+    GAsyncResult *result;
+    /* The context of the thread outside of any synchronous call */
+    GMainContext *thread_context;
+    SignonSyncCall *outer_call;
+};
+
 struct _SignonProxyInterface
 {
     GTypeInterface parent_iface;
@@ -61,5 +72,43 @@ void signon_proxy_set_not_ready (gpointer self);
 G_GNUC_INTERNAL
 const GError *signon_proxy_get_last_error (gpointer self);
 
+G_GNUC_INTERNAL
+void signon_proxy_init_async (gpointer self, GQuark quark,
+                              GCancellable *cancellable,
+                              GAsyncReadyCallback callback,
+                              gpointer user_data);
+
+G_GNUC_INTERNAL
+gboolean signon_proxy_init_finish (gpointer self, GAsyncResult *res,
+                                   GError **error);
+
+G_GNUC_INTERNAL
+void signon_sync_call_init (SignonSyncCall *call);
+
+G_GNUC_INTERNAL
+void signon_sync_call_done_cb (GObject *source_object, GAsyncResult *res,
+                               gpointer user_data);
+
+G_GNUC_INTERNAL
+GAsyncResult *signon_sync_call_wait (SignonSyncCall *call);
+
+G_GNUC_INTERNAL
+gboolean signon_sync_call_in_progress (void);
+
+G_GNUC_INTERNAL
+GMainContext *signon_thread_context_ref (void);
+
+G_GNUC_INTERNAL
+GMainContext *signon_thread_context_push (void);
+
+G_GNUC_INTERNAL
+void signon_thread_context_pop (GMainContext *context);
+
+G_GNUC_INTERNAL
+GMainContext *signon_registration_context_push (void);
+
+G_GNUC_INTERNAL
+void signon_registration_context_pop (GMainContext *context);
+
 G_END_DECLS
 #endif /* _SIGNON_PROXY_H_ */
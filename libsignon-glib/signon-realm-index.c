@@ -0,0 +1,431 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of libsignon-glib
+ *
+ * Copyright (C) 2012-2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/*
+ * Index of the identities by realm, used to find the identities which can
+ * serve a given host.
+ *
+ * The realms are stored in a trie of domain labels, starting from the
+ * rightmost one: "www.example.com" is stored under "com", then "example",
+ * then "www". A realm matches:
+ * - "example.com": the host "example.com" only;
+ * - "*.example.com": any subdomain of "example.com", but not the domain
+ *   itself;
+ * - "*": any host.
+ * Labels are compared case-insensitively, and a trailing dot is ignored.
+ */
+
+#include "signon-internals.h"
+
+#include <string.h>
+
+/* Longest label accepted by DNS */
+#define MAX_LABEL_LENGTH 63
+
+typedef struct _RealmNode RealmNode;
+
+struct _RealmNode
+{
+    /* Label -> RealmNode; NULL if the node has no children */
+    GHashTable *children;
+    /* Identities having exactly this realm, sorted by ID */
+    GArray *ids;
+    /* Identities having "*." followed by this realm, sorted by ID */
+    GArray *wildcard_ids;
+};
+
+struct _SignonRealmIndex
+{
+    RealmNode root;
+    /* Identity ID -> the realms it was added with, to remove it */
+    GHashTable *realms;
+};
+
+static void
+realm_node_clear (RealmNode *node)
+{
+    g_clear_pointer (&node->children, g_hash_table_unref);
+    g_clear_pointer (&node->ids, g_array_unref);
+    g_clear_pointer (&node->wildcard_ids, g_array_unref);
+}
+
+static void
+realm_node_free (RealmNode *node)
+{
+    realm_node_clear (node);
+    g_slice_free (RealmNode, node);
+}
+
+/* Returns the position of @id in @array, sorted by ID, or where it would be
+ * inserted */
+static guint
+id_array_find (const GArray *array, guint32 id, gboolean *found)
+{
+    guint low = 0, high = array->len;
+
+    while (low < high)
+    {
+        guint middle = low + (high - low) / 2;
+        guint32 current = g_array_index (array, guint32, middle);
+
+        if (current == id)
+        {
+            *found = TRUE;
+            return middle;
+        }
+
+        if (current < id)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    *found = FALSE;
+    return low;
+}
+
+static gboolean
+id_array_contains (const GArray *array, guint32 id)
+{
+    gboolean found = FALSE;
+
+    if (array != NULL)
+        id_array_find (array, id, &found);
+    return found;
+}
+
+static void
+id_array_add (GArray **array, guint32 id)
+{
+    gboolean found;
+    guint position;
+
+    if (*array == NULL)
+        *array = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+    position = id_array_find (*array, id, &found);
+    if (!found)
+        g_array_insert_val (*array, position, id);
+}
+
+static void
+id_array_remove (GArray *array, guint32 id)
+{
+    gboolean found;
+    guint position;
+
+    if (array == NULL)
+        return;
+
+    position = id_array_find (array, id, &found);
+    if (found)
+        g_array_remove_index (array, position);
+}
+
+/* Appends the IDs in @sources[@n], skipping the ones which are in one of the
+ * previous sources (and thus already in @ids) */
+static void
+id_array_merge (GArray *ids, const GArray **sources, guint n)
+{
+    const GArray *from = sources[n];
+    guint i, j;
+
+    for (i = 0; from != NULL && i < from->len; i++)
+    {
+        guint32 id = g_array_index (from, guint32, i);
+
+        for (j = 0; j < n; j++)
+            if (id_array_contains (sources[j], id))
+                break;
+
+        if (j == n)
+            g_array_append_val (ids, id);
+    }
+}
+
+/*
+ * Copies the label of @name ending at @end (excluded) into @label, in lower
+ * case, and returns the position where it starts. Returns -1 if the label is
+ * empty or too long.
+ */
+static gssize
+realm_previous_label (const gchar *name, gsize end,
+                      gchar label[MAX_LABEL_LENGTH + 1])
+{
+    gsize start = end, i;
+
+    while (start > 0 && name[start - 1] != '.')
+        start--;
+
+    if (start == end || end - start > MAX_LABEL_LENGTH)
+        return -1;
+
+    for (i = start; i < end; i++)
+        label[i - start] = g_ascii_tolower (name[i]);
+    label[end - start] = '\0';
+
+    return start;
+}
+
+/* Returns the node for @domain, creating it if @create is TRUE */
+static RealmNode *
+realm_index_find_node (SignonRealmIndex *self, const gchar *domain,
+                       gsize length, gboolean create)
+{
+    RealmNode *node = &self->root;
+    gchar label[MAX_LABEL_LENGTH + 1];
+    gssize start;
+    gsize end = length;
+
+    while (end > 0)
+    {
+        RealmNode *child;
+
+        start = realm_previous_label (domain, end, label);
+        if (start < 0)
+            return NULL;
+
+        child = node->children != NULL ?
+            g_hash_table_lookup (node->children, label) : NULL;
+        if (child == NULL)
+        {
+            if (!create)
+                return NULL;
+
+            if (node->children == NULL)
+                node->children =
+                    g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                           (GDestroyNotify)realm_node_free);
+            child = g_slice_new0 (RealmNode);
+            g_hash_table_insert (node->children, g_strdup (label), child);
+        }
+
+        node = child;
+        end = start > 0 ? start - 1 : 0;
+    }
+
+    return node;
+}
+
+/* Splits @realm into its domain and wildcard flag */
+static gboolean
+realm_parse (const gchar *realm, const gchar **domain, gsize *length,
+             gboolean *wildcard)
+{
+    gsize len = strlen (realm);
+
+    if (len > 0 && realm[len - 1] == '.')
+        len--;
+
+    *wildcard = FALSE;
+    if (len == 1 && realm[0] == '*')
+    {
+        *wildcard = TRUE;
+        realm++;
+        len = 0;
+    }
+    else if (len > 2 && realm[0] == '*' && realm[1] == '.')
+    {
+        *wildcard = TRUE;
+        realm += 2;
+        len -= 2;
+    }
+    else if (len == 0)
+    {
+        return FALSE;
+    }
+
+    *domain = realm;
+    *length = len;
+    return TRUE;
+}
+
+static void
+realm_index_unlink (SignonRealmIndex *self, guint32 id,
+                    const gchar * const *realms)
+{
+    gint i;
+
+    for (i = 0; realms != NULL && realms[i] != NULL; i++)
+    {
+        const gchar *domain;
+        gsize length;
+        gboolean wildcard;
+        RealmNode *node;
+
+        if (!realm_parse (realms[i], &domain, &length, &wildcard))
+            continue;
+
+        node = realm_index_find_node (self, domain, length, FALSE);
+        if (node != NULL)
+            id_array_remove (wildcard ? node->wildcard_ids : node->ids, id);
+    }
+}
+
+SignonRealmIndex *
+signon_realm_index_new (void)
+{
+    SignonRealmIndex *self = g_slice_new0 (SignonRealmIndex);
+
+    self->realms = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                           NULL, (GDestroyNotify)g_strfreev);
+    return self;
+}
+
+void
+signon_realm_index_free (SignonRealmIndex *self)
+{
+    if (self == NULL) return;
+
+    realm_node_clear (&self->root);
+    g_hash_table_unref (self->realms);
+    g_slice_free (SignonRealmIndex, self);
+}
+
+/*
+ * signon_realm_index_set:
+ * @self: the #SignonRealmIndex.
+ * @id: the ID of an identity.
+ * @realms: (allow-none): the realms of the identity.
+ *
+ * Replaces the realms of @id in @self; if @realms is %NULL or empty, @id is
+ * removed from @self.
+ */
+void
+signon_realm_index_set (SignonRealmIndex *self, guint32 id,
+                        const gchar * const *realms)
+{
+    gchar **old_realms;
+    gint i;
+
+    g_return_if_fail (self != NULL);
+
+    old_realms = g_hash_table_lookup (self->realms, GUINT_TO_POINTER (id));
+    if (old_realms != NULL)
+    {
+        realm_index_unlink (self, id, (const gchar * const *)old_realms);
+        g_hash_table_remove (self->realms, GUINT_TO_POINTER (id));
+    }
+
+    if (realms == NULL || realms[0] == NULL)
+        return;
+
+    for (i = 0; realms[i] != NULL; i++)
+    {
+        const gchar *domain;
+        gsize length;
+        gboolean wildcard;
+        RealmNode *node;
+
+        if (!realm_parse (realms[i], &domain, &length, &wildcard))
+            continue;
+
+        node = realm_index_find_node (self, domain, length, TRUE);
+        if (node == NULL)
+        {
+            DEBUG ("Invalid realm: %s", realms[i]);
+            continue;
+        }
+
+        id_array_add (wildcard ? &node->wildcard_ids : &node->ids, id);
+    }
+
+    g_hash_table_insert (self->realms, GUINT_TO_POINTER (id),
+                         g_strdupv ((gchar **)realms));
+}
+
+/*
+ * signon_realm_index_lookup:
+ * @self: the #SignonRealmIndex.
+ * @host: a host name.
+ * @ids: (element-type guint32): an array where to append the IDs.
+ *
+ * Appends to @ids the identities whose realms match @host, the most specific
+ * matches first. Doesn't allocate memory, other than for growing @ids.
+ * Each identity is appended once, in time logarithmic in the number of
+ * identities sharing a realm; the IDs already in @ids are not checked.
+ */
+void
+signon_realm_index_lookup (SignonRealmIndex *self, const gchar *host,
+                           GArray *ids)
+{
+    /* The matching nodes, from the root down */
+    const RealmNode *path[128];
+    /* Their matching IDs, the most specific first */
+    const GArray *sources[G_N_ELEMENTS (path) + 1];
+    guint n_sources = 0;
+    gchar label[MAX_LABEL_LENGTH + 1];
+    const RealmNode *node;
+    gsize end;
+    guint depth = 0;
+    gint i;
+
+    g_return_if_fail (self != NULL);
+    g_return_if_fail (host != NULL);
+    g_return_if_fail (ids != NULL);
+
+    end = strlen (host);
+    if (end > 0 && host[end - 1] == '.')
+        end--;
+    if (end == 0)
+        return;
+
+    node = &self->root;
+    path[depth++] = node;
+    while (end > 0 && depth < G_N_ELEMENTS (path))
+    {
+        const RealmNode *child;
+        gssize start = realm_previous_label (host, end, label);
+
+        if (start < 0)
+            return;
+
+        child = node->children != NULL ?
+            g_hash_table_lookup (node->children, label) : NULL;
+        if (child == NULL)
+            break;
+
+        node = child;
+        path[depth++] = node;
+        end = start > 0 ? start - 1 : 0;
+    }
+
+    if (end == 0)
+    {
+        /* All the labels matched: the last node matches exactly, and the
+         * wildcards of its ancestors match too */
+        sources[n_sources++] = path[depth - 1]->ids;
+        for (i = depth - 2; i >= 0; i--)
+            sources[n_sources++] = path[i]->wildcard_ids;
+    }
+    else
+    {
+        /* The host is a subdomain of all the matched nodes */
+        for (i = depth - 1; i >= 0; i--)
+            sources[n_sources++] = path[i]->wildcard_ids;
+    }
+
+    for (i = 0; i < (gint)n_sources; i++)
+        id_array_merge (ids, sources, i);
+}
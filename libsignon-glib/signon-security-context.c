@@ -42,16 +42,19 @@ G_DEFINE_BOXED_TYPE (SignonSecurityContext, signon_security_context,
 SignonSecurityContext *
 signon_security_context_new_from_variant (GVariant *variant)
 {
-    gchar *system_context = NULL;
-    gchar *application_context = NULL;
+    const gchar *system_context = NULL;
+    const gchar *application_context = NULL;
     SignonSecurityContext *ctx;
 
     g_return_val_if_fail (variant != NULL, NULL);
 
-    g_variant_get (variant, "(ss)", &system_context, &application_context);
-    ctx = signon_security_context_new_from_values (system_context, application_context);
-    g_free (system_context);
-    g_free (application_context);
+    /* Borrow the strings from the variant, and copy them only once. They
+     * come from arbitrary peers, so they are not interned: interned strings
+     * are never freed. */
+    g_variant_get (variant, "(&s&s)", &system_context, &application_context);
+    ctx = g_slice_new (SignonSecurityContext);
+    ctx->system_context = g_strdup (system_context);
+    ctx->application_context = g_strdup (application_context);
     return ctx;
 }
 
@@ -0,0 +1,971 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of libsignon-glib
+ *
+ * Copyright (C) 2012-2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/**
+ * SECTION:signon-session-data
+ * @title: SignonSessionData
+ * @short_description: Reusable session data dictionaries.
+ *
+ * A #SignonSessionData holds a set of session parameters which can be used
+ * as a template for the @session_data argument of
+ * signon_auth_session_process(). Each entry is serialized once, when it is
+ * added to the template; building a request out of it with
+ * signon_session_data_build() or signon_session_data_build_with_values()
+ * only allocates the overridden entries, while the others are shared with
+ * the template.
+ *
+ * |[
+ *   SignonSessionData *template = signon_session_data_new ();
+ *   signon_session_data_set (template, "ClientId",
+ *                            g_variant_new_string (client_id));
+ *   signon_session_data_set (template, SIGNON_SESSION_DATA_UI_POLICY,
+ *                            g_variant_new_int32 (SIGNON_POLICY_DEFAULT));
+ *   ...
+ *   signon_auth_session_process (session,
+ *       signon_session_data_build_with_values (template,
+ *           "Scope", g_variant_new_string (scope),
+ *           NULL),
+ *       "web_server", NULL, callback, user_data);
+ * ]|
+ *
+ * A #SignonSessionData can also wrap the reply of
+ * signon_auth_session_process(): signon_session_data_new_from_variant()
+ * indexes the dictionary once, after which the typed getters such as
+ * signon_session_data_get_string() find each key with a hash table lookup
+ * and return pointers into the reply data, without copying it.
+ *
+ * |[
+ *   GVariant *reply = signon_auth_session_process_finish (session, res, &error);
+ *   SignonSessionData *data = signon_session_data_new_from_variant (reply);
+ *   const gchar *token = signon_session_data_get_string (data, "AccessToken");
+ *   gint32 expires_in;
+ *   if (signon_session_data_get_int32 (data, "ExpiresIn", &expires_in))
+ *     ...
+ * ]|
+ */
+
+#ifdef HAVE_MEMFD_CREATE
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+#include <unistd.h>
+
+#include "signon-session-data.h"
+
+#include "signon-errors.h"
+#include "signon-internals.h"
+
+typedef struct {
+    GVariant *entry;    /* the "{sv}" dictionary entry */
+    const gchar *key;   /* owned by entry */
+    GVariant *value;    /* the unboxed value */
+} SessionDataEntry;
+
+struct _SignonSessionData
+{
+    volatile gint ref_count;
+    GArray *entries;
+    /* key -> GUINT_TO_POINTER (index in entries + 1) */
+    GHashTable *index;
+};
+
+G_DEFINE_BOXED_TYPE (SignonSessionData, signon_session_data,
+                     signon_session_data_ref,
+                     signon_session_data_unref);
+
+static void
+session_data_entry_clear (SessionDataEntry *entry)
+{
+    g_variant_unref (entry->value);
+    g_variant_unref (entry->entry);
+}
+
+/* Takes ownership of @entry, which must be a non-floating "{sv}". */
+static void
+session_data_add_entry (SignonSessionData *self, GVariant *entry)
+{
+    SessionDataEntry new_entry;
+    GVariant *boxed;
+    guint i;
+
+    g_variant_get_child (entry, 0, "&s", &new_entry.key);
+    boxed = g_variant_get_child_value (entry, 1);
+    new_entry.value = g_variant_get_variant (boxed);
+    g_variant_unref (boxed);
+    new_entry.entry = entry;
+
+    i = GPOINTER_TO_UINT (g_hash_table_lookup (self->index, new_entry.key));
+    if (i != 0)
+    {
+        SessionDataEntry *old_entry =
+            &g_array_index (self->entries, SessionDataEntry, i - 1);
+        /* The hash table key is borrowed from the entry being replaced */
+        g_hash_table_remove (self->index, old_entry->key);
+        session_data_entry_clear (old_entry);
+        *old_entry = new_entry;
+    }
+    else
+    {
+        g_array_append_val (self->entries, new_entry);
+        i = self->entries->len;
+    }
+    g_hash_table_insert (self->index, (gpointer)new_entry.key,
+                         GUINT_TO_POINTER (i));
+}
+
+/**
+ * signon_session_data_new:
+ *
+ * Creates a new, empty #SignonSessionData.
+ *
+ * Returns: (transfer full): a new #SignonSessionData.
+ *
+ * Since: 2.1
+ */
+SignonSessionData *
+signon_session_data_new (void)
+{
+    SignonSessionData *self;
+
+    self = g_slice_new0 (SignonSessionData);
+    self->ref_count = 1;
+    self->entries = g_array_new (FALSE, FALSE, sizeof (SessionDataEntry));
+    g_array_set_clear_func (self->entries,
+                            (GDestroyNotify)session_data_entry_clear);
+    self->index = g_hash_table_new (g_str_hash, g_str_equal);
+    return self;
+}
+
+/**
+ * signon_session_data_new_from_variant:
+ * @dict: (transfer floating): a #GVariant of type %G_VARIANT_TYPE_VARDICT.
+ *
+ * Creates a new #SignonSessionData holding all the entries of @dict. The
+ * entries are not copied, but shared with @dict.
+ *
+ * Returns: (transfer full): a new #SignonSessionData.
+ *
+ * Since: 2.1
+ */
+SignonSessionData *
+signon_session_data_new_from_variant (GVariant *dict)
+{
+    SignonSessionData *self;
+    gsize n_children, i;
+
+    g_return_val_if_fail (dict != NULL, NULL);
+    g_return_val_if_fail (g_variant_is_of_type (dict, G_VARIANT_TYPE_VARDICT),
+                          NULL);
+
+    g_variant_ref_sink (dict);
+
+    self = signon_session_data_new ();
+    n_children = g_variant_n_children (dict);
+    for (i = 0; i < n_children; i++)
+        session_data_add_entry (self, g_variant_get_child_value (dict, i));
+
+    g_variant_unref (dict);
+    return self;
+}
+
+/**
+ * signon_session_data_ref:
+ * @self: the #SignonSessionData.
+ *
+ * Increment the reference count of @self.
+ *
+ * Returns: (transfer full): @self.
+ *
+ * Since: 2.1
+ */
+SignonSessionData *
+signon_session_data_ref (SignonSessionData *self)
+{
+    g_return_val_if_fail (self != NULL, NULL);
+
+    g_atomic_int_inc (&self->ref_count);
+    return self;
+}
+
+/**
+ * signon_session_data_unref:
+ * @self: the #SignonSessionData.
+ *
+ * Decrement the reference count of @self; when it reaches zero, @self is
+ * freed.
+ *
+ * Since: 2.1
+ */
+void
+signon_session_data_unref (SignonSessionData *self)
+{
+    g_return_if_fail (self != NULL);
+
+    if (g_atomic_int_dec_and_test (&self->ref_count))
+    {
+        g_hash_table_unref (self->index);
+        g_array_unref (self->entries);
+        g_slice_free (SignonSessionData, self);
+    }
+}
+
+/**
+ * signon_session_data_set:
+ * @self: the #SignonSessionData.
+ * @key: the parameter name.
+ * @value: (transfer floating) (allow-none): the parameter value, or %NULL to
+ * remove @key.
+ *
+ * Set the value of a parameter, replacing any previous value for @key.
+ *
+ * Since: 2.1
+ */
+void
+signon_session_data_set (SignonSessionData *self,
+                         const gchar *key,
+                         GVariant *value)
+{
+    GVariant *entry;
+
+    g_return_if_fail (self != NULL);
+    g_return_if_fail (key != NULL);
+
+    if (value == NULL)
+    {
+        signon_session_data_remove (self, key);
+        return;
+    }
+
+    entry = g_variant_ref_sink (
+        g_variant_new_dict_entry (g_variant_new_string (key),
+                                  g_variant_new_variant (value)));
+    /* Serialize the entry now, so that building requests out of this
+     * template only needs to copy its bytes. */
+    g_variant_get_data (entry);
+    session_data_add_entry (self, entry);
+}
+
+/**
+ * signon_session_data_remove:
+ * @self: the #SignonSessionData.
+ * @key: the parameter name.
+ *
+ * Remove a parameter.
+ *
+ * Returns: %TRUE if @key was found and removed, %FALSE otherwise.
+ *
+ * Since: 2.1
+ */
+gboolean
+signon_session_data_remove (SignonSessionData *self,
+                            const gchar *key)
+{
+    SessionDataEntry *moved;
+    guint i;
+
+    g_return_val_if_fail (self != NULL, FALSE);
+    g_return_val_if_fail (key != NULL, FALSE);
+
+    i = GPOINTER_TO_UINT (g_hash_table_lookup (self->index, key));
+    if (i == 0) return FALSE;
+
+    g_hash_table_remove (self->index, key);
+    g_array_remove_index_fast (self->entries, i - 1);
+
+    /* The last entry has been moved into the freed slot */
+    if (i - 1 < self->entries->len)
+    {
+        moved = &g_array_index (self->entries, SessionDataEntry, i - 1);
+        g_hash_table_insert (self->index, (gpointer)moved->key,
+                             GUINT_TO_POINTER (i));
+    }
+    return TRUE;
+}
+
+/**
+ * signon_session_data_get_size:
+ * @self: the #SignonSessionData.
+ *
+ * Returns: the number of parameters held by @self.
+ *
+ * Since: 2.1
+ */
+guint
+signon_session_data_get_size (SignonSessionData *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    return self->entries->len;
+}
+
+/* Returns the value for @key, if it's of type @type. */
+static GVariant *
+session_data_lookup (SignonSessionData *self,
+                     const gchar *key,
+                     const GVariantType *type)
+{
+    SessionDataEntry *entry;
+    guint i;
+
+    i = GPOINTER_TO_UINT (g_hash_table_lookup (self->index, key));
+    if (i == 0) return NULL;
+
+    entry = &g_array_index (self->entries, SessionDataEntry, i - 1);
+    if (type != NULL && !g_variant_is_of_type (entry->value, type))
+        return NULL;
+
+    return entry->value;
+}
+
+/**
+ * signon_session_data_contains:
+ * @self: the #SignonSessionData.
+ * @key: the parameter name.
+ *
+ * Returns: %TRUE if @self has a value for @key, %FALSE otherwise.
+ *
+ * Since: 2.1
+ */
+gboolean
+signon_session_data_contains (SignonSessionData *self,
+                              const gchar *key)
+{
+    g_return_val_if_fail (self != NULL, FALSE);
+    g_return_val_if_fail (key != NULL, FALSE);
+
+    return g_hash_table_contains (self->index, key);
+}
+
+/**
+ * signon_session_data_lookup_value:
+ * @self: the #SignonSessionData.
+ * @key: the parameter name.
+ * @expected_type: (allow-none): a #GVariantType, or %NULL.
+ *
+ * Get the value of a parameter. If @expected_type is not %NULL, %NULL is
+ * returned unless the value is of that type.
+ *
+ * Returns: (transfer none): the value of @key, or %NULL. The value is owned
+ * by @self.
+ *
+ * Since: 2.1
+ */
+GVariant *
+signon_session_data_lookup_value (SignonSessionData *self,
+                                  const gchar *key,
+                                  const GVariantType *expected_type)
+{
+    g_return_val_if_fail (self != NULL, NULL);
+    g_return_val_if_fail (key != NULL, NULL);
+
+    return session_data_lookup (self, key, expected_type);
+}
+
+/**
+ * signon_session_data_get_string:
+ * @self: the #SignonSessionData.
+ * @key: the parameter name.
+ *
+ * Get the value of a string parameter.
+ *
+ * Returns: (transfer none): the string value of @key, or %NULL if @key is
+ * not set or is not a string. The string is owned by @self.
+ *
+ * Since: 2.1
+ */
+const gchar *
+signon_session_data_get_string (SignonSessionData *self,
+                                const gchar *key)
+{
+    GVariant *value;
+
+    g_return_val_if_fail (self != NULL, NULL);
+    g_return_val_if_fail (key != NULL, NULL);
+
+    value = session_data_lookup (self, key, G_VARIANT_TYPE_STRING);
+    return value != NULL ? g_variant_get_string (value, NULL) : NULL;
+}
+
+/**
+ * signon_session_data_get_strv:
+ * @self: the #SignonSessionData.
+ * @key: the parameter name.
+ *
+ * Get the value of a string list parameter.
+ *
+ * Returns: (transfer container) (array zero-terminated=1): the value of
+ * @key, or %NULL if @key is not set or is not a string list. Only the
+ * array must be freed, with g_free(); the strings are owned by @self.
+ *
+ * Since: 2.1
+ */
+const gchar **
+signon_session_data_get_strv (SignonSessionData *self,
+                              const gchar *key)
+{
+    GVariant *value;
+
+    g_return_val_if_fail (self != NULL, NULL);
+    g_return_val_if_fail (key != NULL, NULL);
+
+    value = session_data_lookup (self, key, G_VARIANT_TYPE_STRING_ARRAY);
+    return value != NULL ? g_variant_get_strv (value, NULL) : NULL;
+}
+
+/**
+ * signon_session_data_get_boolean:
+ * @self: the #SignonSessionData.
+ * @key: the parameter name.
+ * @value: (out) (allow-none): location for the value.
+ *
+ * Get the value of a boolean parameter.
+ *
+ * Returns: %TRUE if @key is set and is a boolean, %FALSE otherwise.
+ *
+ * Since: 2.1
+ */
+gboolean
+signon_session_data_get_boolean (SignonSessionData *self,
+                                 const gchar *key,
+                                 gboolean *value)
+{
+    GVariant *variant;
+
+    g_return_val_if_fail (self != NULL, FALSE);
+    g_return_val_if_fail (key != NULL, FALSE);
+
+    variant = session_data_lookup (self, key, G_VARIANT_TYPE_BOOLEAN);
+    if (variant == NULL) return FALSE;
+
+    if (value != NULL)
+        *value = g_variant_get_boolean (variant);
+    return TRUE;
+}
+
+/**
+ * signon_session_data_get_int32:
+ * @self: the #SignonSessionData.
+ * @key: the parameter name.
+ * @value: (out) (allow-none): location for the value.
+ *
+ * Get the value of a 32-bit signed integer parameter.
+ *
+ * Returns: %TRUE if @key is set and is of type %G_VARIANT_TYPE_INT32,
+ * %FALSE otherwise.
+ *
+ * Since: 2.1
+ */
+gboolean
+signon_session_data_get_int32 (SignonSessionData *self,
+                               const gchar *key,
+                               gint32 *value)
+{
+    GVariant *variant;
+
+    g_return_val_if_fail (self != NULL, FALSE);
+    g_return_val_if_fail (key != NULL, FALSE);
+
+    variant = session_data_lookup (self, key, G_VARIANT_TYPE_INT32);
+    if (variant == NULL) return FALSE;
+
+    if (value != NULL)
+        *value = g_variant_get_int32 (variant);
+    return TRUE;
+}
+
+/**
+ * signon_session_data_get_uint32:
+ * @self: the #SignonSessionData.
+ * @key: the parameter name.
+ * @value: (out) (allow-none): location for the value.
+ *
+ * Get the value of a 32-bit unsigned integer parameter.
+ *
+ * Returns: %TRUE if @key is set and is of type %G_VARIANT_TYPE_UINT32,
+ * %FALSE otherwise.
+ *
+ * Since: 2.1
+ */
+gboolean
+signon_session_data_get_uint32 (SignonSessionData *self,
+                                const gchar *key,
+                                guint32 *value)
+{
+    GVariant *variant;
+
+    g_return_val_if_fail (self != NULL, FALSE);
+    g_return_val_if_fail (key != NULL, FALSE);
+
+    variant = session_data_lookup (self, key, G_VARIANT_TYPE_UINT32);
+    if (variant == NULL) return FALSE;
+
+    if (value != NULL)
+        *value = g_variant_get_uint32 (variant);
+    return TRUE;
+}
+
+/**
+ * signon_session_data_get_int64:
+ * @self: the #SignonSessionData.
+ * @key: the parameter name.
+ * @value: (out) (allow-none): location for the value.
+ *
+ * Get the value of a 64-bit signed integer parameter.
+ *
+ * Returns: %TRUE if @key is set and is of type %G_VARIANT_TYPE_INT64,
+ * %FALSE otherwise.
+ *
+ * Since: 2.1
+ */
+gboolean
+signon_session_data_get_int64 (SignonSessionData *self,
+                               const gchar *key,
+                               gint64 *value)
+{
+    GVariant *variant;
+
+    g_return_val_if_fail (self != NULL, FALSE);
+    g_return_val_if_fail (key != NULL, FALSE);
+
+    variant = session_data_lookup (self, key, G_VARIANT_TYPE_INT64);
+    if (variant == NULL) return FALSE;
+
+    if (value != NULL)
+        *value = g_variant_get_int64 (variant);
+    return TRUE;
+}
+
+/**
+ * signon_session_data_get_uint64:
+ * @self: the #SignonSessionData.
+ * @key: the parameter name.
+ * @value: (out) (allow-none): location for the value.
+ *
+ * Get the value of a 64-bit unsigned integer parameter.
+ *
+ * Returns: %TRUE if @key is set and is of type %G_VARIANT_TYPE_UINT64,
+ * %FALSE otherwise.
+ *
+ * Since: 2.1
+ */
+gboolean
+signon_session_data_get_uint64 (SignonSessionData *self,
+                                const gchar *key,
+                                guint64 *value)
+{
+    GVariant *variant;
+
+    g_return_val_if_fail (self != NULL, FALSE);
+    g_return_val_if_fail (key != NULL, FALSE);
+
+    variant = session_data_lookup (self, key, G_VARIANT_TYPE_UINT64);
+    if (variant == NULL) return FALSE;
+
+    if (value != NULL)
+        *value = g_variant_get_uint64 (variant);
+    return TRUE;
+}
+
+/* Builds the dictionary out of the template entries and the
+ * @n_overrides entries in @overrides, which take precedence. */
+static GVariant *
+session_data_build (SignonSessionData *self,
+                    GVariant **overrides,
+                    guint n_overrides)
+{
+    SessionDataEntry *entries;
+    GVariant **children;
+    GVariant *result;
+    gboolean *overridden = NULL;
+    const gchar *key;
+    guint n_children = 0;
+    guint i, j;
+
+    entries = (SessionDataEntry *)self->entries->data;
+    children = g_new (GVariant *, self->entries->len + n_overrides);
+
+    for (i = 0; i < n_overrides; i++)
+    {
+        g_variant_get_child (overrides[i], 0, "&s", &key);
+        j = GPOINTER_TO_UINT (g_hash_table_lookup (self->index, key));
+        if (j != 0)
+        {
+            if (overridden == NULL)
+                overridden = g_new0 (gboolean, self->entries->len);
+            overridden[j - 1] = TRUE;
+        }
+        children[n_children++] = overrides[i];
+    }
+
+    for (i = 0; i < self->entries->len; i++)
+    {
+        if (overridden != NULL && overridden[i]) continue;
+        children[n_children++] = entries[i].entry;
+    }
+
+    result = g_variant_new_array (G_VARIANT_TYPE ("{sv}"),
+                                  children, n_children);
+    g_free (overridden);
+    g_free (children);
+    return result;
+}
+
+/**
+ * signon_session_data_build:
+ * @self: the #SignonSessionData.
+ * @overrides: (transfer floating) (allow-none): a #GVariant of type
+ * %G_VARIANT_TYPE_VARDICT, or %NULL.
+ *
+ * Builds a session data dictionary containing all the parameters from
+ * @self, plus the entries of @overrides; parameters which appear in
+ * @overrides replace those of @self. The template is not modified.
+ *
+ * Returns: (transfer floating): a #GVariant of type
+ * %G_VARIANT_TYPE_VARDICT, suitable for signon_auth_session_process().
+ *
+ * Since: 2.1
+ */
+GVariant *
+signon_session_data_build (SignonSessionData *self,
+                           GVariant *overrides)
+{
+    GVariant **children = NULL;
+    GVariant *result;
+    gsize n_children = 0, i;
+
+    g_return_val_if_fail (self != NULL, NULL);
+    g_return_val_if_fail (overrides == NULL ||
+                          g_variant_is_of_type (overrides,
+                                                G_VARIANT_TYPE_VARDICT),
+                          NULL);
+
+    if (overrides != NULL)
+    {
+        g_variant_ref_sink (overrides);
+        n_children = g_variant_n_children (overrides);
+        children = g_new (GVariant *, n_children);
+        for (i = 0; i < n_children; i++)
+            children[i] = g_variant_get_child_value (overrides, i);
+    }
+
+    result = session_data_build (self, children, n_children);
+
+    for (i = 0; i < n_children; i++)
+        g_variant_unref (children[i]);
+    g_free (children);
+    if (overrides != NULL)
+        g_variant_unref (overrides);
+    return result;
+}
+
+/**
+ * signon_session_data_build_with_values:
+ * @self: the #SignonSessionData.
+ * @first_key: (allow-none): the name of the first parameter to override.
+ * @...: the #GVariant value (transfer floating) of the first parameter,
+ * followed optionally by more name/value pairs, followed by %NULL.
+ *
+ * Like signon_session_data_build(), but takes the overriding parameters as
+ * a %NULL-terminated list of name/value pairs, sparing the creation of an
+ * intermediate dictionary.
+ *
+ * Returns: (transfer floating): a #GVariant of type
+ * %G_VARIANT_TYPE_VARDICT, suitable for signon_auth_session_process().
+ *
+ * Since: 2.1
+ */
+GVariant *
+signon_session_data_build_with_values (SignonSessionData *self,
+                                       const gchar *first_key,
+                                       ...)
+{
+    GPtrArray *children;
+    GVariant *result, *entry;
+    const gchar *key;
+    va_list args;
+
+    g_return_val_if_fail (self != NULL, NULL);
+
+    children = g_ptr_array_new_with_free_func ((GDestroyNotify)g_variant_unref);
+    va_start (args, first_key);
+    for (key = first_key; key != NULL; key = va_arg (args, const gchar *))
+    {
+        GVariant *value = va_arg (args, GVariant *);
+        entry = g_variant_new_dict_entry (g_variant_new_string (key),
+                                          g_variant_new_variant (value));
+        g_ptr_array_add (children, g_variant_ref_sink (entry));
+    }
+    va_end (args);
+
+    result = session_data_build (self, (GVariant **)children->pdata,
+                                 children->len);
+    g_ptr_array_unref (children);
+    return result;
+}
+
+/* Stores the serialized @value into a sealed memfd; returns -1 if that's
+ * not possible. */
+static gint
+session_data_value_to_memfd (GVariant *value)
+{
+#ifdef HAVE_MEMFD_CREATE
+    const gchar *data;
+    gsize size, written = 0;
+    gssize n;
+    gint fd;
+
+    fd = memfd_create ("signon-session-data", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+    {
+        DEBUG ("memfd_create failed: %s", g_strerror (errno));
+        return -1;
+    }
+
+    data = g_variant_get_data (value);
+    size = g_variant_get_size (value);
+    while (written < size)
+    {
+        n = write (fd, data + written, size - written);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            DEBUG ("Writing to memfd failed: %s", g_strerror (errno));
+            close (fd);
+            return -1;
+        }
+        written += n;
+    }
+
+    /* The receiver maps the file: make sure it cannot change under it */
+    fcntl (fd, F_ADD_SEALS,
+           F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+/*
+ * signon_session_data_encode_fds:
+ * @session_data: a %G_VARIANT_TYPE_VARDICT.
+ * @threshold: the minimum size of values to be passed as file descriptors.
+ * @fd_list: (allow-none): the #GUnixFDList which will be sent along with
+ * the data, or %NULL if the service doesn't support file descriptors.
+ *
+ * Prepares @session_data for the "process" D-Bus call: values whose
+ * serialized size is at least @threshold are moved into memfds appended
+ * to @fd_list, and the request for file descriptor passing is added.
+ * Values which cannot be moved are left inline.
+ *
+ * Returns: (transfer floating): the encoded session data.
+ */
+GVariant *
+signon_session_data_encode_fds (GVariant *session_data,
+                                gsize threshold,
+                                GUnixFDList *fd_list)
+{
+    GVariantBuilder builder;
+    GVariantIter iter;
+    GVariant *value;
+    const gchar *key;
+    GError *error = NULL;
+    gint fd, handle;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_iter_init (&iter, session_data);
+    while (g_variant_iter_next (&iter, "{&sv}", &key, &value))
+    {
+        if (fd_list != NULL && g_variant_get_size (value) >= threshold &&
+            (fd = session_data_value_to_memfd (value)) >= 0)
+        {
+            handle = g_unix_fd_list_append (fd_list, fd, &error);
+            close (fd);
+            if (G_LIKELY (handle >= 0))
+            {
+                DEBUG ("Passing %s (%" G_GSIZE_FORMAT " bytes) as fd",
+                       key, g_variant_get_size (value));
+                g_variant_builder_add (&builder, "{sv}", key,
+                                       g_variant_new ("(sht)",
+                                                      g_variant_get_type_string (value),
+                                                      handle,
+                                                      (guint64)g_variant_get_size (value)));
+                g_variant_unref (value);
+                continue;
+            }
+            DEBUG ("Cannot append fd: %s", error->message);
+            g_clear_error (&error);
+        }
+
+        g_variant_builder_add (&builder, "{sv}", key, value);
+        g_variant_unref (value);
+    }
+
+    g_variant_builder_add (&builder, "{sv}",
+                           SIGNON_SESSION_DATA_FD_PASSING_REQUESTED,
+                           g_variant_new_boolean (TRUE));
+    return g_variant_builder_end (&builder);
+}
+
+static gboolean
+session_data_fd_is_sealed (gint fd)
+{
+#ifdef HAVE_MEMFD_CREATE
+    const gint required = F_SEAL_SHRINK | F_SEAL_WRITE;
+    gint seals = fcntl (fd, F_GET_SEALS);
+
+    if (seals < 0)
+    {
+        DEBUG ("Cannot get the seals: %s", g_strerror (errno));
+        return FALSE;
+    }
+    return (seals & required) == required;
+#else
+    return FALSE;
+#endif
+}
+
+static GVariant *
+session_data_value_from_fd (GVariant *encoded,
+                            GUnixFDList *fd_list,
+                            GError **error)
+{
+    GMappedFile *mapped;
+    GBytes *bytes;
+    GVariant *value;
+    const gchar *type_string;
+    gint32 handle;
+    guint64 size;
+    gint fd;
+
+    g_variant_get (encoded, "(&sht)", &type_string, &handle, &size);
+    if (!g_variant_type_string_is_valid (type_string))
+    {
+        g_set_error (error, signon_error_quark (), SIGNON_ERROR_RUNTIME,
+                     "Invalid type \"%s\" for value passed as fd",
+                     type_string);
+        return NULL;
+    }
+
+    fd = g_unix_fd_list_get (fd_list, handle, error);
+    if (fd < 0) return NULL;
+
+    /* A file which the sender can still truncate or modify would make
+     * reading the mapped value crash or change under our feet */
+    if (!session_data_fd_is_sealed (fd))
+    {
+        g_set_error (error, signon_error_quark (), SIGNON_ERROR_RUNTIME,
+                     "Value passed as fd is not sealed");
+        close (fd);
+        return NULL;
+    }
+
+    mapped = g_mapped_file_new_from_fd (fd, FALSE, error);
+    close (fd);
+    if (mapped == NULL) return NULL;
+
+    if (g_mapped_file_get_length (mapped) != size)
+    {
+        g_set_error (error, signon_error_quark (), SIGNON_ERROR_RUNTIME,
+                     "Value passed as fd has wrong size");
+        g_mapped_file_unref (mapped);
+        return NULL;
+    }
+
+    /* The variant keeps the file mapped for as long as it's alive */
+    bytes = g_mapped_file_get_bytes (mapped);
+    g_mapped_file_unref (mapped);
+    value = g_variant_new_from_bytes (G_VARIANT_TYPE (type_string),
+                                      bytes, FALSE);
+    g_bytes_unref (bytes);
+    return value;
+}
+
+/*
+ * signon_session_data_decode_fds:
+ * @session_data: a %G_VARIANT_TYPE_VARDICT received from the "process"
+ * D-Bus call.
+ * @fd_list: (allow-none): the #GUnixFDList received with @session_data.
+ * @fd_passing_supported: (out): whether the service supports receiving
+ * values as file descriptors.
+ * @error: return location for error, or %NULL.
+ *
+ * Reverses signon_session_data_encode_fds(): values passed as file
+ * descriptors are mapped in memory, and the negotiation keys are removed.
+ *
+ * Returns: (transfer full): the decoded session data, or %NULL on error.
+ */
+GVariant *
+signon_session_data_decode_fds (GVariant *session_data,
+                                GUnixFDList *fd_list,
+                                gboolean *fd_passing_supported,
+                                GError **error)
+{
+    GVariantBuilder builder;
+    GVariantIter iter;
+    GVariant *value, *decoded;
+    const gchar *key;
+
+    *fd_passing_supported = FALSE;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_iter_init (&iter, session_data);
+    while (g_variant_iter_next (&iter, "{&sv}", &key, &value))
+    {
+        if (g_strcmp0 (key, SIGNON_SESSION_DATA_FD_PASSING_SUPPORTED) == 0)
+        {
+            *fd_passing_supported = g_variant_is_of_type (value,
+                                                          G_VARIANT_TYPE_BOOLEAN) &&
+                g_variant_get_boolean (value);
+            g_variant_unref (value);
+            continue;
+        }
+
+        if (g_strcmp0 (key, SIGNON_SESSION_DATA_FD_PASSING_REQUESTED) == 0)
+        {
+            /* Plugins might echo our request back */
+            g_variant_unref (value);
+            continue;
+        }
+
+        if (fd_list != NULL &&
+            g_variant_is_of_type (value, G_VARIANT_TYPE ("(sht)")))
+        {
+            decoded = session_data_value_from_fd (value, fd_list, error);
+            g_variant_unref (value);
+            if (decoded == NULL)
+            {
+                g_variant_builder_clear (&builder);
+                return NULL;
+            }
+            value = g_variant_ref_sink (decoded);
+        }
+
+        g_variant_builder_add (&builder, "{sv}", key, value);
+        g_variant_unref (value);
+    }
+
+    return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
@@ -0,0 +1,90 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of libsignon-glib
+ *
+ * Copyright (C) 2012-2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _SIGNON_SESSION_DATA_H_
+#define _SIGNON_SESSION_DATA_H_
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/**
+ * SignonSessionData:
+ *
+ * Opaque struct. Use the accessor functions below.
+ */
+typedef struct _SignonSessionData SignonSessionData;
+
+#define SIGNON_TYPE_SESSION_DATA signon_session_data_get_type ()
+GType signon_session_data_get_type (void) G_GNUC_CONST;
+
+SignonSessionData *signon_session_data_new (void);
+SignonSessionData *signon_session_data_new_from_variant (GVariant *dict);
+
+SignonSessionData *signon_session_data_ref (SignonSessionData *self);
+void signon_session_data_unref (SignonSessionData *self);
+
+void signon_session_data_set (SignonSessionData *self,
+                              const gchar *key,
+                              GVariant *value);
+gboolean signon_session_data_remove (SignonSessionData *self,
+                                     const gchar *key);
+guint signon_session_data_get_size (SignonSessionData *self);
+
+gboolean signon_session_data_contains (SignonSessionData *self,
+                                       const gchar *key);
+GVariant *signon_session_data_lookup_value (SignonSessionData *self,
+                                            const gchar *key,
+                                            const GVariantType *expected_type);
+const gchar *signon_session_data_get_string (SignonSessionData *self,
+                                             const gchar *key);
+const gchar **signon_session_data_get_strv (SignonSessionData *self,
+                                            const gchar *key);
+gboolean signon_session_data_get_boolean (SignonSessionData *self,
+                                          const gchar *key,
+                                          gboolean *value);
+gboolean signon_session_data_get_int32 (SignonSessionData *self,
+                                        const gchar *key,
+                                        gint32 *value);
+gboolean signon_session_data_get_uint32 (SignonSessionData *self,
+                                         const gchar *key,
+                                         guint32 *value);
+gboolean signon_session_data_get_int64 (SignonSessionData *self,
+                                        const gchar *key,
+                                        gint64 *value);
+gboolean signon_session_data_get_uint64 (SignonSessionData *self,
+                                         const gchar *key,
+                                         guint64 *value);
+
+GVariant *signon_session_data_build (SignonSessionData *self,
+                                     GVariant *overrides);
+GVariant *signon_session_data_build_with_values (SignonSessionData *self,
+                                                 const gchar *first_key,
+                                                 ...) G_GNUC_NULL_TERMINATED;
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SignonSessionData, signon_session_data_unref);
+
+G_END_DECLS
+
+#endif /* _SIGNON_SESSION_DATA_H_ */
@@ -24,11 +24,55 @@
 
 #include "signon-errors.h"
 #include "signon-internals.h"
+#include "signon-proxy.h"
 #include "sso-auth-service.h"
 
 static GHashTable *thread_objects = NULL;
 static GMutex map_mutex;
 
+static GHashTable *mechanisms_cache = NULL;
+/* Whether signond accepts session data values as file descriptors; only
+ * known once it has answered a request offering them */
+static SsoFdPassing fd_passing = SSO_FD_PASSING_UNKNOWN;
+/* Set once signond has been found not to implement the "update" method */
+static gboolean update_unsupported = FALSE;
+static GMutex cache_mutex;
+
+/* NULL until loaded, and after being invalidated. The generation counts the
+ * changes, so that an index loaded while a change happened is discarded. */
+static SignonRealmIndex *realm_index = NULL;
+static guint realm_index_generation = 0;
+static GMutex realm_index_mutex;
+
+/* The signals emitted by the remote Identity and AuthSession objects */
+static const gchar * const dispatched_signals[] = {
+    "infoUpdated",
+    "stateChanged",
+    "unregistered",
+};
+
+#define N_DISPATCHED_SIGNALS G_N_ELEMENTS (dispatched_signals)
+
+/* Fans out the signals of all the objects of signond to their watchers,
+ * using one subscription per signal name on the connection instead of one
+ * per object. */
+typedef struct {
+    gint ref_count;
+    GDBusConnection *connection;
+    gchar *bus_name;
+    guint subscriptions[N_DISPATCHED_SIGNALS];
+    /* Object path -> GPtrArray of SsoSignalWatch */
+    GHashTable *watches;
+} SignalDispatcher;
+
+struct _SsoSignalWatch {
+    gint ref_count;
+    gchar *object_path;
+    /* NULL once the watch has been removed */
+    SsoSignalCallback callback;
+    gpointer user_data;
+};
+
 static SsoAuthService *
 get_singleton ()
 {
@@ -80,16 +124,38 @@ set_singleton (SsoAuthService *object)
     g_mutex_unlock (&map_mutex);
 }
 
+static void
+sso_auth_service_clear_cached_mechanisms ()
+{
+    g_mutex_lock (&cache_mutex);
+    g_clear_pointer (&mechanisms_cache, g_hash_table_unref);
+    fd_passing = SSO_FD_PASSING_UNKNOWN;
+    update_unsupported = FALSE;
+    g_mutex_unlock (&cache_mutex);
+}
+
+static void
+on_name_owner_changed (GObject *object, GParamSpec *pspec, gpointer user_data)
+{
+    DEBUG ("signond owner changed, clearing the caches");
+    sso_auth_service_clear_cached_mechanisms ();
+    /* The identities might have been changed while signond was away */
+    sso_auth_service_invalidate_realm_index ();
+}
+
 SsoAuthService *
 sso_auth_service_get_instance ()
 {
     SsoAuthService *sso_auth_service;
+    GMainContext *context;
     GError *error = NULL;
 
     sso_auth_service = get_singleton ();
     if (sso_auth_service != NULL) return sso_auth_service;
 
-    /* Create the object */
+    /* Create the object; its name owner is tracked in the context of the
+     * thread, also when it's first needed by a synchronous call */
+    context = signon_thread_context_push ();
     sso_auth_service =
         sso_auth_service_proxy_new_for_bus_sync (G_BUS_TYPE_SESSION,
                                                  G_DBUS_PROXY_FLAGS_NONE,
@@ -97,8 +163,11 @@ sso_auth_service_get_instance ()
                                                  SIGNOND_DAEMON_OBJECTPATH,
                                                  NULL,
                                                  &error);
+    signon_thread_context_pop (context);
     if (G_LIKELY (error == NULL)) {
         set_singleton (sso_auth_service);
+        g_signal_connect (sso_auth_service, "notify::g-name-owner",
+                          G_CALLBACK (on_name_owner_changed), NULL);
     }
     else
     {
@@ -111,3 +180,368 @@ sso_auth_service_get_instance ()
 
     return sso_auth_service;
 }
+
+/* The mechanisms supported by a plugin don't change while signond is
+ * running, so the cache is shared by all threads; it's cleared when signond
+ * restarts, since plugins might have been installed or removed meanwhile. */
+gchar **
+sso_auth_service_get_cached_mechanisms (const gchar *method)
+{
+    gchar **mechanisms = NULL;
+
+    g_return_val_if_fail (method != NULL, NULL);
+
+    g_mutex_lock (&cache_mutex);
+
+    if (mechanisms_cache != NULL)
+    {
+        mechanisms = g_strdupv (g_hash_table_lookup (mechanisms_cache,
+                                                     method));
+    }
+
+    g_mutex_unlock (&cache_mutex);
+    return mechanisms;
+}
+
+void
+sso_auth_service_cache_mechanisms (const gchar *method,
+                                   const gchar * const *mechanisms)
+{
+    g_return_if_fail (method != NULL);
+    g_return_if_fail (mechanisms != NULL);
+
+    g_mutex_lock (&cache_mutex);
+
+    if (mechanisms_cache == NULL)
+    {
+        mechanisms_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                  g_free,
+                                                  (GDestroyNotify) g_strfreev);
+    }
+
+    g_hash_table_replace (mechanisms_cache, g_strdup (method),
+                          g_strdupv ((gchar **) mechanisms));
+
+    g_mutex_unlock (&cache_mutex);
+}
+
+/* The fd passing support is negotiated once per signond instance, so that
+ * a signond which doesn't know about it forwards the request to a plugin at
+ * most once. */
+SsoFdPassing
+sso_auth_service_get_fd_passing ()
+{
+    SsoFdPassing support;
+
+    g_mutex_lock (&cache_mutex);
+    support = fd_passing;
+    g_mutex_unlock (&cache_mutex);
+    return support;
+}
+
+void
+sso_auth_service_set_fd_passing (gboolean supported)
+{
+    g_mutex_lock (&cache_mutex);
+    if (fd_passing == SSO_FD_PASSING_UNKNOWN)
+    {
+        DEBUG ("signond %s values as file descriptors",
+               supported ? "accepts" : "doesn't accept");
+        fd_passing = supported ?
+            SSO_FD_PASSING_SUPPORTED : SSO_FD_PASSING_UNSUPPORTED;
+    }
+    g_mutex_unlock (&cache_mutex);
+}
+
+/* Like the file descriptors support, this is forgotten when signond
+ * restarts: the new instance might implement "update". */
+gboolean
+sso_auth_service_get_update_supported ()
+{
+    gboolean supported;
+
+    g_mutex_lock (&cache_mutex);
+    supported = !update_unsupported;
+    g_mutex_unlock (&cache_mutex);
+    return supported;
+}
+
+void
+sso_auth_service_set_update_unsupported ()
+{
+    g_mutex_lock (&cache_mutex);
+    update_unsupported = TRUE;
+    g_mutex_unlock (&cache_mutex);
+}
+
+/* The realm index is shared by all threads, like the mechanisms cache, but
+ * it's kept current: the identities report the changes they are told about.
+ * Returns %FALSE if the index needs to be loaded first. */
+gboolean
+sso_auth_service_lookup_realm (const gchar *host, GArray *ids)
+{
+    gboolean loaded;
+
+    g_return_val_if_fail (host != NULL, FALSE);
+
+    g_mutex_lock (&realm_index_mutex);
+
+    loaded = (realm_index != NULL);
+    if (loaded)
+        signon_realm_index_lookup (realm_index, host, ids);
+
+    g_mutex_unlock (&realm_index_mutex);
+    return loaded;
+}
+
+guint
+sso_auth_service_get_realm_index_generation ()
+{
+    guint generation;
+
+    g_mutex_lock (&realm_index_mutex);
+    generation = realm_index_generation;
+    g_mutex_unlock (&realm_index_mutex);
+
+    return generation;
+}
+
+/* Takes ownership of @loaded, which was loaded when the generation was
+ * @generation */
+void
+sso_auth_service_set_realm_index (SignonRealmIndex *loaded, guint generation)
+{
+    g_return_if_fail (loaded != NULL);
+
+    g_mutex_lock (&realm_index_mutex);
+
+    if (generation == realm_index_generation)
+    {
+        signon_realm_index_free (realm_index);
+        realm_index = loaded;
+        loaded = NULL;
+    }
+
+    g_mutex_unlock (&realm_index_mutex);
+
+    /* Outdated: something changed while it was being loaded */
+    signon_realm_index_free (loaded);
+}
+
+void
+sso_auth_service_update_realm_index (guint32 id, const gchar * const *realms)
+{
+    g_mutex_lock (&realm_index_mutex);
+
+    realm_index_generation++;
+    if (realm_index != NULL)
+        signon_realm_index_set (realm_index, id, realms);
+
+    g_mutex_unlock (&realm_index_mutex);
+}
+
+void
+sso_auth_service_invalidate_realm_index ()
+{
+    g_mutex_lock (&realm_index_mutex);
+
+    realm_index_generation++;
+    g_clear_pointer (&realm_index, signon_realm_index_free);
+
+    g_mutex_unlock (&realm_index_mutex);
+}
+
+static SsoSignalWatch *
+signal_watch_ref (SsoSignalWatch *watch)
+{
+    g_atomic_int_inc (&watch->ref_count);
+    return watch;
+}
+
+static void
+signal_watch_unref (SsoSignalWatch *watch)
+{
+    if (g_atomic_int_dec_and_test (&watch->ref_count))
+    {
+        g_free (watch->object_path);
+        g_slice_free (SsoSignalWatch, watch);
+    }
+}
+
+static void
+signal_dispatcher_unref (SignalDispatcher *dispatcher)
+{
+    if (!g_atomic_int_dec_and_test (&dispatcher->ref_count))
+        return;
+
+    if (g_hash_table_size (dispatcher->watches) > 0)
+        g_warning ("%s: %u objects still watched", G_STRFUNC,
+                   g_hash_table_size (dispatcher->watches));
+
+    g_hash_table_unref (dispatcher->watches);
+    g_free (dispatcher->bus_name);
+    g_object_unref (dispatcher->connection);
+    g_slice_free (SignalDispatcher, dispatcher);
+}
+
+static void
+signal_dispatcher_dispatch (GDBusConnection *connection,
+                            const gchar *sender_name,
+                            const gchar *object_path,
+                            const gchar *interface_name,
+                            const gchar *signal_name,
+                            GVariant *parameters,
+                            gpointer user_data)
+{
+    SignalDispatcher *dispatcher = user_data;
+    GPtrArray *watches, *snapshot;
+    guint i;
+
+    watches = g_hash_table_lookup (dispatcher->watches, object_path);
+    if (watches == NULL) return;
+
+    /* The callbacks are allowed to add and remove watches */
+    snapshot = g_ptr_array_new_full (watches->len,
+                                     (GDestroyNotify)signal_watch_unref);
+    for (i = 0; i < watches->len; i++)
+        g_ptr_array_add (snapshot,
+                         signal_watch_ref (g_ptr_array_index (watches, i)));
+
+    for (i = 0; i < snapshot->len; i++)
+    {
+        SsoSignalWatch *watch = g_ptr_array_index (snapshot, i);
+
+        if (watch->callback != NULL)
+            watch->callback (signal_name, parameters, watch->user_data);
+    }
+
+    g_ptr_array_unref (snapshot);
+}
+
+static void
+signal_dispatcher_free (SignalDispatcher *dispatcher)
+{
+    guint i;
+
+    for (i = 0; i < N_DISPATCHED_SIGNALS; i++)
+        g_dbus_connection_signal_unsubscribe (dispatcher->connection,
+                                              dispatcher->subscriptions[i]);
+
+    signal_dispatcher_unref (dispatcher);
+}
+
+static SignalDispatcher *
+signal_dispatcher_get (SsoAuthService *self)
+{
+    SignalDispatcher *dispatcher;
+    GDBusProxy *proxy = G_DBUS_PROXY (self);
+    GMainContext *context;
+    guint i;
+
+    dispatcher = g_object_get_data (G_OBJECT (self), "sso-signal-dispatcher");
+    if (dispatcher != NULL) return dispatcher;
+
+    dispatcher = g_slice_new0 (SignalDispatcher);
+    dispatcher->ref_count = 1;
+    dispatcher->connection = g_object_ref (g_dbus_proxy_get_connection (proxy));
+    dispatcher->bus_name = g_strdup (g_dbus_proxy_get_name (proxy));
+    dispatcher->watches =
+        g_hash_table_new_full (g_str_hash, g_str_equal,
+                               g_free, (GDestroyNotify)g_ptr_array_unref);
+
+    /* One subscription per signal, for all the objects of signond: GDBus
+     * adds (and eventually removes) a single match rule for each. The
+     * signals are dispatched in the context of the thread, even if the
+     * first watch is added during a synchronous call. */
+    context = signon_thread_context_push ();
+    for (i = 0; i < N_DISPATCHED_SIGNALS; i++)
+    {
+        g_atomic_int_inc (&dispatcher->ref_count);
+        dispatcher->subscriptions[i] =
+            g_dbus_connection_signal_subscribe (dispatcher->connection,
+                                                dispatcher->bus_name,
+                                                NULL,
+                                                dispatched_signals[i],
+                                                NULL,
+                                                NULL,
+                                                G_DBUS_SIGNAL_FLAGS_NONE,
+                                                signal_dispatcher_dispatch,
+                                                dispatcher,
+                                                (GDestroyNotify)signal_dispatcher_unref);
+    }
+    signon_thread_context_pop (context);
+
+    g_object_set_data_full (G_OBJECT (self), "sso-signal-dispatcher",
+                            dispatcher,
+                            (GDestroyNotify)signal_dispatcher_free);
+    return dispatcher;
+}
+
+/*
+ * sso_auth_service_watch_object:
+ * @self: the #SsoAuthService.
+ * @object_path: the path of a remote Identity or AuthSession object.
+ * @callback: the function to call when the object emits a signal.
+ * @user_data: user data for @callback.
+ *
+ * Starts watching the signals of a remote object; the proxies of the remote
+ * objects are created with %G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS, and
+ * they get their signals from here instead. The watch must be removed with
+ * sso_auth_service_unwatch_object() before releasing @self.
+ */
+SsoSignalWatch *
+sso_auth_service_watch_object (SsoAuthService *self,
+                               const gchar *object_path,
+                               SsoSignalCallback callback,
+                               gpointer user_data)
+{
+    SignalDispatcher *dispatcher;
+    SsoSignalWatch *watch;
+    GPtrArray *watches;
+
+    g_return_val_if_fail (SSO_IS_AUTH_SERVICE (self), NULL);
+    g_return_val_if_fail (object_path != NULL, NULL);
+    g_return_val_if_fail (callback != NULL, NULL);
+
+    dispatcher = signal_dispatcher_get (self);
+
+    watch = g_slice_new (SsoSignalWatch);
+    watch->ref_count = 1;
+    watch->object_path = g_strdup (object_path);
+    watch->callback = callback;
+    watch->user_data = user_data;
+
+    watches = g_hash_table_lookup (dispatcher->watches, object_path);
+    if (watches == NULL)
+    {
+        watches = g_ptr_array_new_with_free_func ((GDestroyNotify)signal_watch_unref);
+        g_hash_table_insert (dispatcher->watches, g_strdup (object_path),
+                             watches);
+    }
+    g_ptr_array_add (watches, watch);
+
+    return watch;
+}
+
+void
+sso_auth_service_unwatch_object (SsoAuthService *self, SsoSignalWatch *watch)
+{
+    SignalDispatcher *dispatcher;
+    GPtrArray *watches;
+
+    g_return_if_fail (SSO_IS_AUTH_SERVICE (self));
+    g_return_if_fail (watch != NULL);
+
+    dispatcher = signal_dispatcher_get (self);
+    watch->callback = NULL;
+
+    watches = g_hash_table_lookup (dispatcher->watches, watch->object_path);
+    g_return_if_fail (watches != NULL);
+
+    /* This drops the last reference to @watch, unless it's being
+     * dispatched */
+    if (watches->len == 1)
+        g_hash_table_remove (dispatcher->watches, watch->object_path);
+    else
+        g_ptr_array_remove (watches, watch);
+}
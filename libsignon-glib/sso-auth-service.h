@@ -25,13 +25,72 @@
 #ifndef _SSO_AUTH_SERVICE_H_
 #define _SSO_AUTH_SERVICE_H_
 
+#include "signon-internals.h"
 #include "sso-auth-service-gen.h"
 
 G_BEGIN_DECLS
 
+typedef struct _SsoSignalWatch SsoSignalWatch;
+
+typedef void (*SsoSignalCallback) (const gchar *signal_name,
+                                   GVariant *parameters,
+                                   gpointer user_data);
+
+typedef enum {
+    SSO_FD_PASSING_UNKNOWN = 0,
+    SSO_FD_PASSING_SUPPORTED,
+    SSO_FD_PASSING_UNSUPPORTED,
+} SsoFdPassing;
+
 G_GNUC_INTERNAL
 SsoAuthService *sso_auth_service_get_instance ();
 
+G_GNUC_INTERNAL
+SsoSignalWatch *sso_auth_service_watch_object (SsoAuthService *self,
+                                               const gchar *object_path,
+                                               SsoSignalCallback callback,
+                                               gpointer user_data);
+
+G_GNUC_INTERNAL
+void sso_auth_service_unwatch_object (SsoAuthService *self,
+                                      SsoSignalWatch *watch);
+
+G_GNUC_INTERNAL
+gchar **sso_auth_service_get_cached_mechanisms (const gchar *method);
+
+G_GNUC_INTERNAL
+void sso_auth_service_cache_mechanisms (const gchar *method,
+                                        const gchar * const *mechanisms);
+
+G_GNUC_INTERNAL
+SsoFdPassing sso_auth_service_get_fd_passing ();
+
+G_GNUC_INTERNAL
+void sso_auth_service_set_fd_passing (gboolean supported);
+
+G_GNUC_INTERNAL
+gboolean sso_auth_service_get_update_supported ();
+
+G_GNUC_INTERNAL
+void sso_auth_service_set_update_unsupported ();
+
+G_GNUC_INTERNAL
+gboolean sso_auth_service_lookup_realm (const gchar *host, GArray *ids);
+
+G_GNUC_INTERNAL
+guint sso_auth_service_get_realm_index_generation ();
+
+G_GNUC_INTERNAL
+void sso_auth_service_set_realm_index (SignonRealmIndex *realm_index,
+                                       guint generation);
+
+G_GNUC_INTERNAL
+void sso_auth_service_update_realm_index (guint32 id,
+                                          const gchar * const *realms);
+
+G_GNUC_INTERNAL
+void sso_auth_service_invalidate_realm_index ();
+
 G_END_DECLS
 
 #endif /* _SSO_AUTH_SERVICE_H_ */
@@ -0,0 +1,311 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of libsignon-glib
+ *
+ * Copyright (C) 2012-2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/*
+ * Microbenchmark for the decoding of the identity data received from
+ * signond into a SignonIdentityInfo, and for its encoding when it's stored
+ * back (both unchanged and after changing a single field). It also reports
+ * the heap used by a working set of decoded identities, where available,
+ * and compares the cost of their methods tables with and without interning
+ * the method names and mechanisms.
+ *
+ * Usage: benchmark-identity-info [ITERATIONS]
+ */
+
+#include "libsignon-glib/signon-internals.h"
+
+#include <stdlib.h>
+#ifdef HAVE_MALLINFO2
+#include <malloc.h>
+#endif
+
+#define WORKING_SET_SIZE 10000
+
+static GVariant *
+build_identity_data (guint id, guint n_acl, guint n_methods,
+                     guint n_mechanisms)
+{
+    GVariantBuilder builder;
+    GVariantBuilder acl_builder;
+    GVariantBuilder methods_builder;
+    GVariantBuilder mechanisms_builder;
+    const gchar *realms[] = { "example.com", "example.org", NULL };
+    GVariant *data, *tree;
+    guint i, j;
+
+    g_variant_builder_init (&acl_builder, (const GVariantType *)"a(ss)");
+    for (i = 0; i < n_acl; i++)
+    {
+        gchar *application = g_strdup_printf ("com.example.application%u", i);
+        g_variant_builder_add (&acl_builder, "(ss)",
+                               "/usr/bin/application", application);
+        g_free (application);
+    }
+
+    g_variant_builder_init (&methods_builder,
+                            (const GVariantType *)"a{sas}");
+    for (i = 0; i < n_methods; i++)
+    {
+        gchar *method = g_strdup_printf ("method%u", i);
+
+        g_variant_builder_init (&mechanisms_builder, G_VARIANT_TYPE_STRING_ARRAY);
+        for (j = 0; j < n_mechanisms; j++)
+        {
+            gchar *mechanism = g_strdup_printf ("mechanism%u", j);
+            g_variant_builder_add (&mechanisms_builder, "s", mechanism);
+            g_free (mechanism);
+        }
+        g_variant_builder_add (&methods_builder, "{sas}",
+                               method, &mechanisms_builder);
+        g_free (method);
+    }
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&builder, "{sv}", "Id", g_variant_new_uint32 (id));
+    g_variant_builder_add (&builder, "{sv}", "UserName",
+                           g_variant_new_string ("James Bond"));
+    g_variant_builder_add (&builder, "{sv}", "Secret",
+                           g_variant_new_string ("007"));
+    g_variant_builder_add (&builder, "{sv}", "StoreSecret",
+                           g_variant_new_boolean (TRUE));
+    g_variant_builder_add (&builder, "{sv}", "Caption",
+                           g_variant_new_string ("MI-6"));
+    g_variant_builder_add (&builder, "{sv}", "Realms",
+                           g_variant_new_strv (realms, -1));
+    g_variant_builder_add (&builder, "{sv}", "AuthMethods",
+                           g_variant_builder_end (&methods_builder));
+    g_variant_builder_add (&builder, "{sv}", "ACL",
+                           g_variant_builder_end (&acl_builder));
+    g_variant_builder_add (&builder, "{sv}", "Type",
+                           g_variant_new_uint32 (SIGNON_IDENTITY_TYPE_APP));
+
+    /* Make it serialized, like a variant received from D-Bus */
+    tree = g_variant_ref_sink (g_variant_builder_end (&builder));
+    data = g_variant_get_normal_form (tree);
+    g_variant_unref (tree);
+    return data;
+}
+
+static void
+run_benchmark (const gchar *name, GVariant *data, guint iterations)
+{
+    SignonIdentityInfo *info;
+    gint64 start, elapsed;
+    guint i;
+
+    /* Warm up */
+    info = signon_identity_info_new_from_variant (data);
+    g_assert (info != NULL);
+    g_assert_cmpint (signon_identity_info_get_id (info), ==, 42);
+    signon_identity_info_free (info);
+
+    start = g_get_monotonic_time ();
+    for (i = 0; i < iterations; i++)
+    {
+        info = signon_identity_info_new_from_variant (data);
+        signon_identity_info_free (info);
+    }
+    elapsed = g_get_monotonic_time () - start;
+
+    g_print ("%-24s %8" G_GSIZE_FORMAT " bytes %10.3f us/decode\n",
+             name, g_variant_get_size (data),
+             (gdouble)elapsed / iterations);
+
+    info = signon_identity_info_new_from_variant (data);
+
+    start = g_get_monotonic_time ();
+    for (i = 0; i < iterations; i++)
+        g_variant_unref (signon_identity_info_to_variant (info));
+    elapsed = g_get_monotonic_time () - start;
+    g_print ("%-24s %14s %10.3f us/encode (unchanged)\n",
+             name, "", (gdouble)elapsed / iterations);
+
+    start = g_get_monotonic_time ();
+    for (i = 0; i < iterations; i++)
+    {
+        signon_identity_info_set_caption (info, (i % 2) ? "MI-5" : "MI-6");
+        g_variant_unref (signon_identity_info_to_variant (info));
+    }
+    elapsed = g_get_monotonic_time () - start;
+    g_print ("%-24s %14s %10.3f us/encode (caption changed)\n",
+             name, "", (gdouble)elapsed / iterations);
+
+    signon_identity_info_free (info);
+}
+
+static gsize
+heap_in_use (void)
+{
+#ifdef HAVE_MALLINFO2
+    struct mallinfo2 info = mallinfo2 ();
+    return info.uordblks;
+#else
+    return 0;
+#endif
+}
+
+/* Builds, for every identity, a copy of its methods table: either owning
+ * its strings, as SignonIdentityInfo does, or referring to interned
+ * strings, which would be cheaper but never freed. */
+static gsize
+build_methods_tables (SignonIdentityInfo **infos, guint n_identities,
+                      gboolean interned, GHashTable **tables)
+{
+    gsize before = heap_in_use ();
+    guint i;
+
+    for (i = 0; i < n_identities; i++)
+    {
+        GHashTableIter iter;
+        gpointer method, mechanisms;
+
+        tables[i] = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                           interned ? NULL : g_free,
+                                           interned ? g_free :
+                                           (GDestroyNotify)g_strfreev);
+        g_hash_table_iter_init (&iter, (GHashTable *)
+                                signon_identity_info_get_methods (infos[i]));
+        while (g_hash_table_iter_next (&iter, &method, &mechanisms))
+        {
+            const gchar * const *strv = mechanisms;
+            gchar **copy;
+            guint j, n = g_strv_length ((gchar **)strv);
+
+            copy = g_new (gchar *, n + 1);
+            for (j = 0; j < n; j++)
+                copy[j] = interned ? (gchar *)g_intern_string (strv[j]) :
+                    g_strdup (strv[j]);
+            copy[n] = NULL;
+            g_hash_table_insert (tables[i],
+                                 interned ? (gchar *)g_intern_string (method) :
+                                 g_strdup (method),
+                                 copy);
+        }
+    }
+
+    return heap_in_use () - before;
+}
+
+static void
+run_methods_layouts (SignonIdentityInfo **infos, guint n_identities)
+{
+    GHashTable **tables = g_new (GHashTable *, n_identities);
+    gsize copied, interned;
+    guint i;
+
+    copied = build_methods_tables (infos, n_identities, FALSE, tables);
+    for (i = 0; i < n_identities; i++)
+        g_hash_table_unref (tables[i]);
+
+    interned = build_methods_tables (infos, n_identities, TRUE, tables);
+    for (i = 0; i < n_identities; i++)
+        g_hash_table_unref (tables[i]);
+
+#ifdef HAVE_MALLINFO2
+    g_print ("methods, copied:   %" G_GSIZE_FORMAT " bytes "
+             "(%.1f bytes/identity)\n",
+             copied, (gdouble)copied / n_identities);
+    g_print ("methods, interned: %" G_GSIZE_FORMAT " bytes "
+             "(%.1f bytes/identity)\n",
+             interned, (gdouble)interned / n_identities);
+#else
+    (void)copied;
+    (void)interned;
+#endif
+
+    g_free (tables);
+}
+
+/* Identities as they are typically configured: a couple of ACL entries,
+ * and a few methods sharing the same names and mechanisms */
+static void
+run_working_set (guint n_identities)
+{
+    SignonIdentityInfo **infos;
+    gsize before, after;
+    guint i;
+
+    infos = g_new (SignonIdentityInfo *, n_identities);
+
+    before = heap_in_use ();
+    for (i = 0; i < n_identities; i++)
+    {
+        GVariant *data = build_identity_data (i + 1, 2, 3, 3);
+        infos[i] = signon_identity_info_new_from_variant (data);
+        g_variant_unref (data);
+    }
+    after = heap_in_use ();
+
+#ifdef HAVE_MALLINFO2
+    g_print ("working set: %u identities, %" G_GSIZE_FORMAT " bytes "
+             "(%.1f bytes/identity)\n",
+             n_identities, after - before,
+             (gdouble)(after - before) / n_identities);
+#else
+    (void)before;
+    (void)after;
+    g_print ("working set: heap statistics not available\n");
+#endif
+
+    run_methods_layouts (infos, n_identities);
+
+    for (i = 0; i < n_identities; i++)
+        signon_identity_info_free (infos[i]);
+    g_free (infos);
+}
+
+int
+main (int argc, char **argv)
+{
+    struct {
+        const gchar *name;
+        guint n_acl;
+        guint n_methods;
+        guint n_mechanisms;
+    } cases[] = {
+        { "small", 1, 1, 1 },
+        { "acl-100", 100, 2, 2 },
+        { "acl-1000", 1000, 2, 2 },
+        { "methods-50x10", 2, 50, 10 },
+        { "acl-1000,methods-50x10", 1000, 50, 10 },
+    };
+    guint iterations = 2000;
+    guint i;
+
+    if (argc > 1)
+        iterations = MAX (atoi (argv[1]), 1);
+
+    for (i = 0; i < G_N_ELEMENTS (cases); i++)
+    {
+        GVariant *data = build_identity_data (42, cases[i].n_acl,
+                                              cases[i].n_methods,
+                                              cases[i].n_mechanisms);
+        run_benchmark (cases[i].name, data, iterations);
+        g_variant_unref (data);
+    }
+
+    run_working_set (WORKING_SET_SIZE);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,127 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of libsignon-glib
+ *
+ * Copyright (C) 2012-2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/*
+ * Microbenchmark for the realm index: it indexes a large number of
+ * identities, each one with a couple of realms, and measures the time needed
+ * to find the identities serving a host; then it does the same with
+ * identities which all share the same realms.
+ *
+ * Usage: benchmark-realm-index [IDENTITIES]
+ */
+
+#include "libsignon-glib/signon-internals.h"
+
+#include <stdlib.h>
+
+#define ITERATIONS 100000
+
+static void
+run_lookups (SignonRealmIndex *realm_index, const gchar *host,
+             guint expected)
+{
+    GArray *ids = g_array_sized_new (FALSE, FALSE, sizeof (guint32), 16);
+    gint64 start, elapsed;
+    guint i;
+
+    signon_realm_index_lookup (realm_index, host, ids);
+    g_assert_cmpuint (ids->len, ==, expected);
+
+    start = g_get_monotonic_time ();
+    for (i = 0; i < ITERATIONS; i++)
+    {
+        g_array_set_size (ids, 0);
+        signon_realm_index_lookup (realm_index, host, ids);
+    }
+    elapsed = g_get_monotonic_time () - start;
+
+    g_print ("%-32s %4u matches %10.3f ns/lookup\n",
+             host, ids->len, (gdouble)elapsed * 1000 / ITERATIONS);
+
+    g_array_unref (ids);
+}
+
+int
+main (int argc, char **argv)
+{
+    SignonRealmIndex *realm_index;
+    guint n_identities = 50000;
+    gint64 start, elapsed;
+    guint i;
+
+    if (argc > 1)
+        n_identities = MAX (atoi (argv[1]), 1);
+
+    realm_index = signon_realm_index_new ();
+
+    /* Every identity serves its own domain and its subdomains; one in a
+     * hundred also serves a shared domain */
+    start = g_get_monotonic_time ();
+    for (i = 0; i < n_identities; i++)
+    {
+        gchar *domain = g_strdup_printf ("host%u.example.com", i);
+        gchar *subdomains = g_strdup_printf ("*.host%u.example.com", i);
+        const gchar *realms[] = { domain, subdomains, NULL, NULL };
+
+        if (i % 100 == 0)
+            realms[2] = "*.shared.example.org";
+
+        signon_realm_index_set (realm_index, i + 1, realms);
+        g_free (domain);
+        g_free (subdomains);
+    }
+    elapsed = g_get_monotonic_time () - start;
+
+    g_print ("indexed %u identities in %.3f ms\n",
+             n_identities, (gdouble)elapsed / 1000);
+
+    run_lookups (realm_index, "host42.example.com", 1);
+    run_lookups (realm_index, "www.host42.example.com", 1);
+    run_lookups (realm_index, "mail.shared.example.org",
+                 (n_identities + 99) / 100);
+    run_lookups (realm_index, "www.unknown.example.net", 0);
+
+    signon_realm_index_free (realm_index);
+
+    /* Every identity serves any host, and the subdomains of a corporate
+     * domain: lookups must skip the identities matching twice */
+    realm_index = signon_realm_index_new ();
+
+    start = g_get_monotonic_time ();
+    for (i = 0; i < n_identities; i++)
+    {
+        const gchar *realms[] = { "*", "*.corp.example", NULL };
+        signon_realm_index_set (realm_index, i + 1, realms);
+    }
+    elapsed = g_get_monotonic_time () - start;
+
+    g_print ("indexed %u identities sharing realms in %.3f ms\n",
+             n_identities, (gdouble)elapsed / 1000);
+
+    run_lookups (realm_index, "www.corp.example", n_identities);
+
+    signon_realm_index_free (realm_index);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,218 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of libsignon-glib
+ *
+ * Copyright (C) 2012-2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/*
+ * Tests for the partial updates of the identities: the tracking of the
+ * fields changed since an info was received from signond. signond is not
+ * involved: the codec is internal to the library, and is built into this
+ * test.
+ */
+
+#include "libsignon-glib/signon-internals.h"
+#include <check.h>
+#include <stdlib.h>
+
+static SignonIdentityInfo *
+create_received_info (void)
+{
+    GVariantBuilder builder;
+    const gchar *realms[] = { "example.com", NULL };
+    const gchar *mechanisms[] = { "mechanism1", "mechanism2", NULL };
+    SignonIdentityInfo *info;
+    GVariant *data;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&builder, "{sv}", "Id", g_variant_new_uint32 (42));
+    g_variant_builder_add (&builder, "{sv}", "UserName",
+                           g_variant_new_string ("James Bond"));
+    g_variant_builder_add (&builder, "{sv}", "Caption",
+                           g_variant_new_string ("MI-6"));
+    g_variant_builder_add (&builder, "{sv}", "Realms",
+                           g_variant_new_strv (realms, -1));
+    g_variant_builder_add (&builder, "{sv}", "AuthMethods",
+                           g_variant_new_parsed ("{'method1': %^as}",
+                                                 mechanisms));
+    data = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+    info = signon_identity_info_new_from_variant (data);
+    g_variant_unref (data);
+    fail_unless (info != NULL);
+    return info;
+}
+
+static gboolean
+delta_has_key (GVariant *delta, const gchar *key)
+{
+    GVariant *value = g_variant_lookup_value (delta, key, NULL);
+
+    if (value == NULL) return FALSE;
+    g_variant_unref (value);
+    return TRUE;
+}
+
+START_TEST(test_delta_new_info)
+{
+    SignonIdentityInfo *info = signon_identity_info_new ();
+
+    /* Not from signond: it must be stored in full */
+    signon_identity_info_set_caption (info, "MI-5");
+    fail_unless (signon_identity_info_to_variant_delta (info) == NULL);
+
+    /* ...also after having been stored once */
+    signon_identity_info_mark_stored (info);
+    fail_unless (signon_identity_info_to_variant_delta (info) == NULL);
+
+    signon_identity_info_free (info);
+}
+END_TEST
+
+START_TEST(test_delta_changed_fields)
+{
+    SignonIdentityInfo *info = create_received_info ();
+    GVariant *delta;
+    const gchar **realms;
+    guint32 id;
+
+    /* Nothing changed yet: only the Id */
+    delta = signon_identity_info_to_variant_delta (info);
+    fail_unless (delta != NULL);
+    fail_unless (g_variant_n_children (delta) == 1);
+    fail_unless (g_variant_lookup (delta, "Id", "u", &id));
+    fail_unless (id == 42);
+    g_variant_unref (delta);
+
+    signon_identity_info_set_caption (info, "MI-5");
+    signon_identity_info_set_realms (info, NULL);
+    delta = signon_identity_info_to_variant_delta (info);
+    fail_unless (delta != NULL);
+    fail_unless (g_variant_n_children (delta) == 3);
+    fail_unless (delta_has_key (delta, "Id"));
+    fail_unless (delta_has_key (delta, "Caption"));
+    fail_if (delta_has_key (delta, "UserName"));
+    fail_if (delta_has_key (delta, "AuthMethods"));
+    /* Clearing a field is a change to be sent, too */
+    fail_unless (g_variant_lookup (delta, "Realms", "^a&s", &realms));
+    fail_unless (realms[0] == NULL);
+    g_free (realms);
+    g_variant_unref (delta);
+
+    /* The full form is not affected */
+    delta = signon_identity_info_to_variant (info);
+    fail_unless (delta_has_key (delta, "UserName"));
+    fail_unless (delta_has_key (delta, "AuthMethods"));
+    g_variant_unref (delta);
+
+    signon_identity_info_free (info);
+}
+END_TEST
+
+START_TEST(test_delta_all_fields)
+{
+    SignonIdentityInfo *info = create_received_info ();
+    const gchar *mechanisms[] = { "mechanism1", NULL };
+
+    signon_identity_info_set_username (info, "Bill");
+    signon_identity_info_set_secret (info, "secret", TRUE);
+    signon_identity_info_set_caption (info, "MI-5");
+    signon_identity_info_set_method (info, "method2", mechanisms);
+    signon_identity_info_set_realms (info, NULL);
+    signon_identity_info_set_access_control_list (info, NULL);
+    fail_unless (signon_identity_info_to_variant_delta (info) != NULL);
+
+    /* Everything changed: no point in a partial update */
+    signon_identity_info_set_identity_type (info, SIGNON_IDENTITY_TYPE_WEB);
+    fail_unless (signon_identity_info_to_variant_delta (info) == NULL);
+
+    signon_identity_info_free (info);
+}
+END_TEST
+
+START_TEST(test_mark_stored)
+{
+    SignonIdentityInfo *info = create_received_info ();
+    SignonIdentityInfo *copy, *modified;
+    GVariant *delta;
+
+    signon_identity_info_set_caption (info, "MI-5");
+    copy = signon_identity_info_copy (info);
+    modified = signon_identity_info_copy (info);
+    signon_identity_info_set_username (modified, "Bill");
+
+    signon_identity_info_mark_stored (info);
+
+    /* The next delta only has the changes made from now on */
+    delta = signon_identity_info_to_variant_delta (info);
+    fail_unless (g_variant_n_children (delta) == 1);
+    g_variant_unref (delta);
+    signon_identity_info_set_username (info, "Bill");
+    delta = signon_identity_info_to_variant_delta (info);
+    fail_unless (g_variant_n_children (delta) == 2);
+    fail_unless (delta_has_key (delta, "UserName"));
+    g_variant_unref (delta);
+
+    /* A copy sharing the data was stored as well */
+    delta = signon_identity_info_to_variant_delta (copy);
+    fail_unless (g_variant_n_children (delta) == 1);
+    g_variant_unref (delta);
+
+    /* A copy modified before has its own changes, which were not stored */
+    delta = signon_identity_info_to_variant_delta (modified);
+    fail_unless (delta_has_key (delta, "Caption"));
+    fail_unless (delta_has_key (delta, "UserName"));
+    g_variant_unref (delta);
+
+    signon_identity_info_free (modified);
+    signon_identity_info_free (copy);
+    signon_identity_info_free (info);
+}
+END_TEST
+
+Suite *
+identity_info_suite (void)
+{
+    Suite *s = suite_create ("signon-glib-identity-info");
+    TCase *tc_core = tcase_create ("PartialUpdates");
+
+    tcase_add_test (tc_core, test_delta_new_info);
+    tcase_add_test (tc_core, test_delta_changed_fields);
+    tcase_add_test (tc_core, test_delta_all_fields);
+    tcase_add_test (tc_core, test_mark_stored);
+    suite_add_tcase (s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite * s = identity_info_suite();
+    SRunner * sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free (sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* vim: set ai et tw=75 ts=4 sw=4: */
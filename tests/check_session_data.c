@@ -0,0 +1,236 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of libsignon-glib
+ *
+ * Copyright (C) 2012-2016 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/*
+ * Tests for the passing of session data values as file descriptors. signond
+ * is not involved: the codec is internal to the library, and is built into
+ * this test.
+ */
+
+#include "libsignon-glib/signon-internals.h"
+#include "libsignon-glib/signon-errors.h"
+#include <check.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define THRESHOLD 1024
+
+static GVariant *
+build_session_data (const gchar *payload)
+{
+    GVariantBuilder builder;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&builder, "{sv}", "UserName",
+                           g_variant_new_string ("James Bond"));
+    g_variant_builder_add (&builder, "{sv}", "Assertion",
+                           g_variant_new_string (payload));
+    return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+START_TEST(test_fd_roundtrip)
+{
+    GUnixFDList *fd_list;
+    GVariant *session_data, *encoded, *decoded, *value;
+    gchar *payload;
+    const gchar *string;
+    gboolean requested, supported;
+    GError *error = NULL;
+
+    payload = g_strnfill (256 * 1024, 'x');
+    session_data = build_session_data (payload);
+
+    fd_list = g_unix_fd_list_new ();
+    encoded = g_variant_ref_sink (
+        signon_session_data_encode_fds (session_data, THRESHOLD, fd_list));
+
+    fail_unless (g_variant_lookup (encoded,
+                                   SIGNON_SESSION_DATA_FD_PASSING_REQUESTED,
+                                   "b", &requested));
+    fail_unless (requested);
+
+    /* The small value stays inline */
+    fail_unless (g_variant_lookup (encoded, "UserName", "&s", &string));
+    ck_assert_str_eq (string, "James Bond");
+
+    value = g_variant_lookup_value (encoded, "Assertion", NULL);
+    fail_unless (value != NULL);
+#ifdef HAVE_MEMFD_CREATE
+    fail_unless (g_variant_is_of_type (value, G_VARIANT_TYPE ("(sht)")));
+    fail_unless (g_unix_fd_list_get_length (fd_list) == 1);
+#else
+    fail_unless (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING));
+    fail_unless (g_unix_fd_list_get_length (fd_list) == 0);
+#endif
+    g_variant_unref (value);
+
+    /* Decode it as if it were the reply */
+    decoded = signon_session_data_decode_fds (encoded, fd_list, &supported,
+                                              &error);
+    fail_unless (error == NULL);
+    fail_unless (decoded != NULL);
+    fail_if (supported);
+
+    fail_unless (g_variant_lookup (decoded, "Assertion", "&s", &string));
+    ck_assert_str_eq (string, payload);
+    fail_unless (g_variant_lookup (decoded, "UserName", "&s", &string));
+    ck_assert_str_eq (string, "James Bond");
+    /* The negotiation keys are not exposed */
+    fail_if (g_variant_lookup (decoded,
+                               SIGNON_SESSION_DATA_FD_PASSING_REQUESTED,
+                               "b", &requested));
+
+    g_variant_unref (decoded);
+    g_variant_unref (encoded);
+    g_object_unref (fd_list);
+    g_variant_unref (session_data);
+    g_free (payload);
+}
+END_TEST
+
+START_TEST(test_fd_below_threshold)
+{
+    GUnixFDList *fd_list;
+    GVariant *session_data, *encoded, *value;
+
+    session_data = build_session_data ("short");
+
+    fd_list = g_unix_fd_list_new ();
+    encoded = g_variant_ref_sink (
+        signon_session_data_encode_fds (session_data, THRESHOLD, fd_list));
+    fail_unless (g_unix_fd_list_get_length (fd_list) == 0);
+
+    value = g_variant_lookup_value (encoded, "Assertion",
+                                    G_VARIANT_TYPE_STRING);
+    fail_unless (value != NULL);
+    g_variant_unref (value);
+
+    g_variant_unref (encoded);
+    g_object_unref (fd_list);
+    g_variant_unref (session_data);
+}
+END_TEST
+
+START_TEST(test_fd_supported)
+{
+    GVariantBuilder builder;
+    GVariant *reply, *decoded;
+    gboolean supported;
+    GError *error = NULL;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&builder, "{sv}",
+                           SIGNON_SESSION_DATA_FD_PASSING_SUPPORTED,
+                           g_variant_new_boolean (TRUE));
+    g_variant_builder_add (&builder, "{sv}", "AccessToken",
+                           g_variant_new_string ("t0k3n"));
+    reply = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+    decoded = signon_session_data_decode_fds (reply, NULL, &supported,
+                                              &error);
+    fail_unless (error == NULL);
+    fail_unless (supported);
+    fail_if (g_variant_lookup (decoded,
+                               SIGNON_SESSION_DATA_FD_PASSING_SUPPORTED,
+                               "b", &supported));
+    fail_unless (g_variant_n_children (decoded) == 1);
+
+    g_variant_unref (decoded);
+    g_variant_unref (reply);
+}
+END_TEST
+
+START_TEST(test_fd_unsealed)
+{
+    GUnixFDList *fd_list;
+    GVariantBuilder builder;
+    GVariant *value, *reply, *decoded;
+    gchar *path = NULL;
+    gboolean supported;
+    GError *error = NULL;
+    gint fd, handle;
+
+    /* A plain file can be truncated by the sender after being sent */
+    value = g_variant_ref_sink (g_variant_new_string ("not sealed"));
+    fd = g_file_open_tmp ("signon-session-data-XXXXXX", &path, &error);
+    fail_unless (fd >= 0);
+    g_unlink (path);
+    g_free (path);
+    fail_unless (write (fd, g_variant_get_data (value),
+                        g_variant_get_size (value)) ==
+                 (gssize)g_variant_get_size (value));
+
+    fd_list = g_unix_fd_list_new ();
+    handle = g_unix_fd_list_append (fd_list, fd, &error);
+    close (fd);
+    fail_unless (handle >= 0);
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&builder, "{sv}", "Assertion",
+                           g_variant_new ("(sht)", "s", handle,
+                                          (guint64)g_variant_get_size (value)));
+    reply = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+    decoded = signon_session_data_decode_fds (reply, fd_list, &supported,
+                                              &error);
+    fail_unless (decoded == NULL);
+    fail_unless (g_error_matches (error, SIGNON_ERROR, SIGNON_ERROR_RUNTIME));
+    g_clear_error (&error);
+
+    g_variant_unref (reply);
+    g_object_unref (fd_list);
+    g_variant_unref (value);
+}
+END_TEST
+
+Suite *
+session_data_suite (void)
+{
+    Suite *s = suite_create ("signon-glib-session-data");
+    TCase *tc_core = tcase_create ("FdPassing");
+
+    tcase_add_test (tc_core, test_fd_roundtrip);
+    tcase_add_test (tc_core, test_fd_below_threshold);
+    tcase_add_test (tc_core, test_fd_supported);
+    tcase_add_test (tc_core, test_fd_unsealed);
+    suite_add_tcase (s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite * s = session_data_suite();
+    SRunner * sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free (sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* vim: set ai et tw=75 ts=4 sw=4: */
@@ -33,10 +33,12 @@
 #include "libsignon-glib/signon-auth-service.h"
 #include "libsignon-glib/signon-auth-session.h"
 #include "libsignon-glib/signon-identity.h"
+#include "libsignon-glib/signon-identity-monitor.h"
 #include "libsignon-glib/signon-errors.h"
 
 #include <glib.h>
 #include <check.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -415,6 +417,48 @@ START_TEST(test_auth_session_creation)
 }
 END_TEST
 
+START_TEST(test_auth_session_reuse)
+{
+    GError *err = NULL;
+    gpointer auth_session_sentinel;
+
+    g_debug("%s", G_STRFUNC);
+    SignonIdentity *idty = signon_identity_new(NULL, NULL);
+    fail_unless (idty != NULL, "Cannot create Identity object");
+
+    SignonAuthSession *as1 = signon_identity_create_session (idty, "ssotest",
+                                                             &err);
+    fail_unless (as1 != NULL, "Cannot create AuthSession object");
+
+    SignonAuthSession *as2 = signon_identity_create_session (idty, "ssotest",
+                                                             &err);
+    fail_unless (as2 == as1, "The AuthSession for the method is not reused");
+    fail_unless (err == NULL);
+
+    SignonAuthSession *as3 = signon_identity_create_session (idty, "ssotest2",
+                                                             &err);
+    fail_unless (as3 != NULL, "Cannot create AuthSession object");
+    fail_unless (as3 != as1, "Different methods must have different sessions");
+    g_object_unref (as3);
+
+    auth_session_sentinel = as1;
+    g_object_add_weak_pointer (G_OBJECT (as1), &auth_session_sentinel);
+    g_object_unref (as2);
+    fail_unless (auth_session_sentinel != NULL,
+                 "AuthSession destroyed while still referenced");
+    g_object_unref (as1);
+    fail_unless (auth_session_sentinel == NULL);
+
+    /* Once destroyed, a new session is created for the method */
+    as1 = signon_identity_create_session (idty, "ssotest", &err);
+    fail_unless (as1 != NULL, "Cannot create AuthSession object");
+    g_object_unref (as1);
+
+    g_object_unref (idty);
+    g_clear_error(&err);
+}
+END_TEST
+
 static void
 test_auth_session_process_async_cb (GObject *source_object,
                                     GAsyncResult *res,
@@ -495,96 +539,132 @@ START_TEST(test_auth_session_process_async)
 }
 END_TEST
 
-static void
-test_auth_session_process_failure_cb (GObject *source_object,
-                                      GAsyncResult *res,
-                                      gpointer user_data)
-{
-    SignonAuthSession *auth_session = SIGNON_AUTH_SESSION (source_object);
-    GVariant *v_reply;
-    GError **error = user_data;
-
-    fail_unless (SIGNON_IS_AUTH_SESSION (source_object));
-
-    v_reply = signon_auth_session_process_finish (auth_session, res, error);
-    fail_unless (v_reply == NULL);
-
-    g_main_loop_quit (main_loop);
-}
-
-START_TEST(test_auth_session_process_failure)
+START_TEST(test_auth_session_coalesce_states)
 {
-    SignonAuthSession *auth_session;
+    gint state_counter = 0;
+    GError *err = NULL;
     GVariantBuilder builder;
-    GVariant *session_data;
-    GError *error = NULL;
+    GVariant *session_data, *reply = NULL;
+    guint dropped;
 
     g_debug("%s", G_STRFUNC);
+    SignonIdentity *idty = signon_identity_new(NULL, NULL);
+    fail_unless (idty != NULL, "Cannot create Identity object");
 
-    auth_session = signon_auth_session_new (0, "nonexisting-method", &error);
+    SignonAuthSession *auth_session = signon_identity_create_session(idty,
+                                                                     "ssotest",
+                                                                     &err);
     fail_unless (auth_session != NULL, "Cannot create AuthSession object");
-    fail_unless (error == NULL);
+    g_clear_error(&err);
+
+    fail_if (signon_auth_session_get_coalesce_state_changes (auth_session));
+    signon_auth_session_set_coalesce_state_changes (auth_session, TRUE);
+    fail_unless (signon_auth_session_get_coalesce_state_changes (auth_session));
+
+    g_signal_connect(auth_session, "state-changed",
+                     G_CALLBACK(test_auth_session_states_cb), &state_counter);
 
     g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
     g_variant_builder_add (&builder, "{sv}",
-                           "key", g_variant_new_string ("value"));
-
+                           SIGNON_SESSION_DATA_USERNAME,
+                           g_variant_new_string ("test_username"));
     session_data = g_variant_builder_end (&builder);
 
     signon_auth_session_process (auth_session,
                                  session_data,
                                  "mech1",
                                  NULL,
-                                 test_auth_session_process_failure_cb,
-                                 &error);
-
+                                 test_auth_session_process_async_cb,
+                                 &reply);
     main_loop = g_main_loop_new (NULL, FALSE);
     g_main_loop_run (main_loop);
-    fail_unless (error != NULL);
-    fail_unless (error->domain == SIGNON_ERROR);
-    fail_unless (error->code == SIGNON_ERROR_METHOD_NOT_KNOWN);
+    fail_unless (reply != NULL);
 
-    g_error_free (error);
+    /* Every state is either emitted or accounted for as dropped */
+    dropped = signon_auth_session_get_dropped_state_changes (auth_session);
+    fail_unless (state_counter >= 1);
+    fail_unless (state_counter + dropped == 12,
+                 "Wrong numer of state changes: %d + %u",
+                 state_counter, dropped);
+
+    g_variant_unref (reply);
     g_object_unref (auth_session);
+    g_object_unref (idty);
 
     end_test ();
 }
 END_TEST
 
-START_TEST(test_auth_session_process_cancel)
+static void
+test_auth_session_timings_cb (GObject *source_object,
+                              GAsyncResult *res,
+                              gpointer user_data)
 {
-    SignonAuthSession *auth_session;
-    GVariantBuilder builder;
-    GVariant *session_data;
+    SignonAuthSession *auth_session = SIGNON_AUTH_SESSION (source_object);
+    SignonAuthSessionTimings **timings = user_data;
+    GVariant *reply;
     GError *error = NULL;
 
-    g_debug("%s", G_STRFUNC);
+    reply = signon_auth_session_process_finish (auth_session, res, &error);
+    fail_unless (error == NULL);
+    fail_unless (reply != NULL);
+    g_variant_unref (reply);
 
-    auth_session = signon_auth_session_new (0, "nonexisting-method", &error);
+    *timings = signon_auth_session_process_get_timings (auth_session, res);
+
+    g_main_loop_quit (main_loop);
+}
+
+START_TEST(test_auth_session_process_timings)
+{
+    SignonAuthSessionTimings *timings = NULL;
+    GVariantBuilder builder;
+    gint64 start, ready, sent, reply, time, previous;
+    guint n_transitions, i;
+
+    g_debug("%s", G_STRFUNC);
+    SignonAuthSession *auth_session = signon_auth_session_new (0, "ssotest",
+                                                               NULL);
     fail_unless (auth_session != NULL, "Cannot create AuthSession object");
-    fail_unless (error == NULL);
 
     g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
     g_variant_builder_add (&builder, "{sv}",
-                           "key", g_variant_new_string ("value"));
-
-    session_data = g_variant_builder_end (&builder);
+                           SIGNON_SESSION_DATA_USERNAME,
+                           g_variant_new_string ("test_username"));
 
     signon_auth_session_process (auth_session,
-                                 session_data,
+                                 g_variant_builder_end (&builder),
                                  "mech1",
                                  NULL,
-                                 test_auth_session_process_failure_cb,
-                                 &error);
-    signon_auth_session_cancel (auth_session);
-
+                                 test_auth_session_timings_cb,
+                                 &timings);
     main_loop = g_main_loop_new (NULL, FALSE);
     g_main_loop_run (main_loop);
-    fail_unless (error != NULL);
-    fail_unless (error->domain == SIGNON_ERROR);
-    fail_unless (error->code == SIGNON_ERROR_METHOD_NOT_KNOWN);
+    fail_unless (timings != NULL);
+
+    start = signon_auth_session_timings_get_start_time (timings);
+    ready = signon_auth_session_timings_get_ready_time (timings);
+    sent = signon_auth_session_timings_get_sent_time (timings);
+    reply = signon_auth_session_timings_get_reply_time (timings);
+    fail_unless (start > 0);
+    fail_unless (start <= ready);
+    fail_unless (ready <= sent);
+    fail_unless (sent <= reply);
+
+    /* The ssotest plugin emits 11 state changes */
+    n_transitions = signon_auth_session_timings_get_n_transitions (timings);
+    fail_unless (n_transitions == 11,
+                 "Wrong number of transitions: %u", n_transitions);
+    previous = sent;
+    for (i = 0; i < n_transitions; i++)
+    {
+        signon_auth_session_timings_get_transition (timings, i, &time);
+        fail_unless (time >= previous);
+        fail_unless (time <= reply);
+        previous = time;
+    }
 
-    g_error_free (error);
+    signon_auth_session_timings_unref (timings);
     g_object_unref (auth_session);
 
     end_test ();
@@ -592,621 +672,1947 @@ START_TEST(test_auth_session_process_cancel)
 END_TEST
 
 static void
-test_auth_session_process_after_store_cb (GObject *source_object,
-                                          GAsyncResult *res,
-                                          gpointer user_data)
+test_auth_session_overlap_timings_cb (GObject *source_object,
+                                      GAsyncResult *res,
+                                      gpointer user_data)
 {
-    gchar *v_username;
+    SignonAuthSession *auth_session = SIGNON_AUTH_SESSION (source_object);
+    GPtrArray *timings = user_data;
+    GVariant *reply;
     GError *error = NULL;
-    GVariantDict *dict = NULL;
-    GVariant *reply = signon_auth_session_process_finish ((SignonAuthSession *)source_object, res, &error);
 
-    if (error != NULL)
-    {
-        fail("Got error: %s", error->message);
+    reply = signon_auth_session_process_finish (auth_session, res, &error);
+    fail_unless (error == NULL);
+    fail_unless (reply != NULL);
+    g_variant_unref (reply);
+
+    g_ptr_array_add (timings,
+                     signon_auth_session_process_get_timings (auth_session,
+                                                              res));
+    if (timings->len == 2)
         g_main_loop_quit (main_loop);
-        return;
-    }
+}
 
-    fail_unless (reply != NULL, "The result is empty");
+/* Each of two overlapping requests gets its own reply time */
+START_TEST(test_auth_session_process_timings_overlap)
+{
+    GPtrArray *timings;
+    GVariantBuilder builder;
+    GVariant *session_data;
+    guint i;
 
-    dict = g_variant_dict_new (reply);
-    g_variant_dict_lookup (dict, SIGNON_SESSION_DATA_USERNAME, "s", &v_username);
-    fail_unless (g_strcmp0 (v_username, "Nice user") == 0,
-                 "Wrong value of username");
-    g_variant_dict_unref (dict);
-    g_free (v_username);
+    g_debug("%s", G_STRFUNC);
+    SignonAuthSession *auth_session = signon_auth_session_new (0, "ssotest",
+                                                               NULL);
+    fail_unless (auth_session != NULL, "Cannot create AuthSession object");
 
-    g_main_loop_quit (main_loop);
-}
+    timings = g_ptr_array_new_with_free_func ((GDestroyNotify)
+                                              signon_auth_session_timings_unref);
 
-static void
-test_auth_session_process_after_store_start_session (GObject *source_object,
-                                                     GAsyncResult *res,
-                                                     gpointer user_data)
-{
-    SignonIdentity *self = (SignonIdentity *)source_object;
-    GError *error = NULL;
-    GVariant *session_data = NULL;
-    guint32 id;
-    SignonAuthSession *auth_session = (SignonAuthSession *)user_data;
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&builder, "{sv}",
+                           SIGNON_SESSION_DATA_USERNAME,
+                           g_variant_new_string ("test_username"));
+    session_data = g_variant_ref_sink (g_variant_builder_end (&builder));
 
-    fail_unless (auth_session != NULL);
-    fail_unless (SIGNON_IS_AUTH_SESSION (auth_session));
+    signon_auth_session_process (auth_session, session_data, "mech1", NULL,
+                                 test_auth_session_overlap_timings_cb,
+                                 timings);
+    signon_auth_session_process (auth_session, session_data, "mech1", NULL,
+                                 test_auth_session_overlap_timings_cb,
+                                 timings);
+    main_loop = g_main_loop_new (NULL, FALSE);
+    g_main_loop_run (main_loop);
+    fail_unless (timings->len == 2);
 
-    if (!signon_identity_store_info_finish (self, res, &error)) {
-        g_warning ("%s %d: %s", G_STRFUNC, __LINE__, error->message);
-        fail();
-        g_main_loop_quit (main_loop);
-        return;
-    }
+    for (i = 0; i < timings->len; i++)
+    {
+        SignonAuthSessionTimings *t = g_ptr_array_index (timings, i);
+        gint64 sent = signon_auth_session_timings_get_sent_time (t);
+        gint64 reply = signon_auth_session_timings_get_reply_time (t);
 
-    id = signon_identity_get_id (self);
-    fail_unless (id > 0);
+        fail_unless (sent > 0);
+        fail_unless (reply >= sent, "Request %u has no reply time", i);
+    }
+    fail_unless (g_ptr_array_index (timings, 0) !=
+                 g_ptr_array_index (timings, 1));
 
-    session_data = g_variant_new (g_variant_type_peek_string (G_VARIANT_TYPE_VARDICT), NULL);
+    g_variant_unref (session_data);
+    g_ptr_array_unref (timings);
+    g_object_unref (auth_session);
 
-    signon_auth_session_process (auth_session,
-                                 session_data,
-                                 "mech1",
-                                 NULL,
-                                 test_auth_session_process_after_store_cb,
-                                 NULL);
+    end_test ();
 }
+END_TEST
 
-START_TEST(test_auth_session_process_after_store)
+START_TEST(test_auth_session_process_fd_fallback)
 {
-    SignonIdentityInfo *info = NULL;
-    SignonIdentity *identity = NULL;
-    GList *acl = g_list_append (NULL, signon_security_context_new_from_values ("*", "*"));
-    SignonAuthSession *auth_session = NULL;
-    GError *error = NULL;
+    GVariantBuilder builder;
+    GVariant *reply = NULL;
+    gchar *payload;
+    const gchar *string;
+    gboolean requested;
 
     g_debug("%s", G_STRFUNC);
-
-    main_loop = g_main_loop_new (NULL, FALSE);
-
-    identity = signon_identity_new ();
-    fail_unless (SIGNON_IS_IDENTITY (identity),
-                 "Failed to initialize the Identity.");
-
-    info = signon_identity_info_new ();
-    signon_identity_info_set_username (info, "Nice user");
-    signon_identity_info_set_access_control_list (info, acl);
-
-    g_list_free_full (acl, (GDestroyNotify)signon_security_context_free);
-
-    /*
-     * This auth session will get an updated Identity ID when the identity
-     * get created.
-     */
-    auth_session = signon_identity_create_session(identity,
-                                                  "ssotest",
-                                                  &error);
-
+    SignonAuthSession *auth_session = signon_auth_session_new (0, "ssotest",
+                                                               NULL);
     fail_unless (auth_session != NULL, "Cannot create AuthSession object");
-    if (error != NULL)
-    {
-        fail ("Got error: %s", error->message);
-        g_clear_error (&error);
-    }
 
-    signon_identity_store_info (identity,
-                                info,
-                                NULL,
-                                test_auth_session_process_after_store_start_session,
-                                auth_session);
+    fail_unless (signon_auth_session_get_fd_passing_threshold (auth_session) == 0);
+    signon_auth_session_set_fd_passing_threshold (auth_session, 1024);
+    fail_unless (signon_auth_session_get_fd_passing_threshold (auth_session) == 1024);
 
+    /* signond doesn't negotiate fd passing: the payload travels inline */
+    payload = g_strnfill (256 * 1024, 'x');
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&builder, "{sv}", "Assertion",
+                           g_variant_new_string (payload));
+
+    signon_auth_session_process (auth_session,
+                                 g_variant_builder_end (&builder),
+                                 "mech1",
+                                 NULL,
+                                 test_auth_session_process_async_cb,
+                                 &reply);
+    main_loop = g_main_loop_new (NULL, FALSE);
     g_main_loop_run (main_loop);
+    fail_unless (reply != NULL);
 
-    g_object_unref (identity);
+    fail_unless (g_variant_lookup (reply, "Assertion", "&s", &string));
+    ck_assert_str_eq (string, payload);
+    /* The negotiation keys are not exposed to the client */
+    fail_if (g_variant_lookup (reply, "_SignonFdPassingRequested", "b",
+                               &requested));
+
+    g_variant_unref (reply);
+    g_free (payload);
     g_object_unref (auth_session);
-    signon_identity_info_free (info);
 
     end_test ();
 }
 END_TEST
 
-static void add_methods_to_identity_info (SignonIdentityInfo *info)
+static void
+test_auth_session_prepare_cb (GObject *source_object,
+                              GAsyncResult *res,
+                              gpointer user_data)
 {
-    const gchar *mechanisms[] = {
-            "mechanism1",
-            "mechanism2",
-            "mechanism3",
-            NULL
-    };
+    SignonAuthSession *auth_session = SIGNON_AUTH_SESSION (source_object);
+    gboolean *prepared = user_data;
+    GError *error = NULL;
 
-    signon_identity_info_set_method (info, "method1", mechanisms);
-    signon_identity_info_set_method (info, "method2", mechanisms);
-    signon_identity_info_set_method (info, "method3", mechanisms);
+    *prepared = signon_auth_session_prepare_finish (auth_session, res, &error);
+    fail_unless (error == NULL);
+
+    g_main_loop_quit (main_loop);
 }
 
-static void new_identity_store_credentials_cb (GObject *source_object,
-                                               GAsyncResult *res,
-                                               gpointer user_data)
+START_TEST(test_auth_session_prepare)
 {
-    SignonIdentity *self = (SignonIdentity *)source_object;
-    GError *error = NULL;
+    SignonAuthSession *auth_session;
+    GVariantBuilder builder;
+    GVariant *session_data, *reply = NULL;
+    gboolean prepared = FALSE;
+    gchar *username;
+    GError *error = NULL;
+    gboolean ok;
+
+    g_debug("%s", G_STRFUNC);
+
+    auth_session = signon_auth_session_new (0, "ssotest", &error);
+    fail_unless (auth_session != NULL, "Cannot create AuthSession object");
+    fail_unless (error == NULL);
+
+    main_loop = g_main_loop_new (NULL, FALSE);
+
+    signon_auth_session_prepare (auth_session, TRUE, NULL,
+                                 test_auth_session_prepare_cb, &prepared);
+    g_main_loop_run (main_loop);
+    fail_unless (prepared, "The session was not prepared");
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&builder, "{sv}",
+                           SIGNON_SESSION_DATA_USERNAME,
+                           g_variant_new_string ("test_username"));
+    session_data = g_variant_builder_end (&builder);
+
+    signon_auth_session_process (auth_session,
+                                 session_data,
+                                 "mech1",
+                                 NULL,
+                                 test_auth_session_process_async_cb,
+                                 &reply);
+    g_main_loop_run (main_loop);
+
+    fail_unless (reply != NULL);
+    ok = g_variant_lookup (reply, SIGNON_SESSION_DATA_USERNAME, "&s", &username);
+    ck_assert (ok);
+    ck_assert_str_eq (username, "test_username");
+
+    g_variant_unref (reply);
+    g_object_unref (auth_session);
+
+    end_test ();
+}
+END_TEST
+
+static void
+test_auth_session_query_mechanisms_cb (GObject *source_object,
+                                       GAsyncResult *res,
+                                       gpointer user_data)
+{
+    SignonAuthSession *auth_session = SIGNON_AUTH_SESSION (source_object);
+    gchar ***mechanisms = user_data;
+    GError *error = NULL;
+
+    *mechanisms =
+        signon_auth_session_query_available_mechanisms_finish (auth_session,
+                                                               res, &error);
+    fail_unless (error == NULL);
+
+    g_main_loop_quit (main_loop);
+}
+
+START_TEST(test_auth_session_query_mechanisms)
+{
+    SignonAuthSession *auth_session;
+    const gchar *wanted[] = { "mech3", "non-existing", "mech1", NULL };
+    const gchar *candidates[] = { "non-existing", "mech1", NULL };
+    gchar **mechanisms = NULL;
+    GVariant *session_data, *reply = NULL;
+    GError *error = NULL;
+
+    g_debug("%s", G_STRFUNC);
+
+    auth_session = signon_auth_session_new (0, "ssotest", &error);
+    fail_unless (auth_session != NULL, "Cannot create AuthSession object");
+    fail_unless (error == NULL);
+
+    main_loop = g_main_loop_new (NULL, FALSE);
+
+    signon_auth_session_query_available_mechanisms (auth_session, wanted, NULL,
+                                                    test_auth_session_query_mechanisms_cb,
+                                                    &mechanisms);
+    g_main_loop_run (main_loop);
+
+    fail_unless (mechanisms != NULL);
+    ck_assert_int_eq (g_strv_length (mechanisms), 2);
+    ck_assert_str_eq (mechanisms[0], "mech3");
+    ck_assert_str_eq (mechanisms[1], "mech1");
+    g_strfreev (mechanisms);
+
+    /* The unsupported mechanism must be skipped */
+    session_data = g_variant_new ("a{sv}", NULL);
+    signon_auth_session_process_with_mechanisms (auth_session,
+                                                 session_data,
+                                                 candidates,
+                                                 NULL,
+                                                 test_auth_session_process_async_cb,
+                                                 &reply);
+    g_main_loop_run (main_loop);
+    fail_unless (reply != NULL);
+
+    g_variant_unref (reply);
+    g_object_unref (auth_session);
+
+    end_test ();
+}
+END_TEST
+
+START_TEST(test_auth_session_mechanism_list)
+{
+    SignonIdentity *identity;
+    SignonIdentityInfo *info;
+    SignonAuthSession *auth_session;
+    const gchar *mechanisms[] = { "mech1", NULL };
+    GVariantBuilder builder;
+    GVariant *session_data, *reply;
+    GError *error = NULL;
+
+    g_debug("%s", G_STRFUNC);
+
+    identity = signon_identity_new ();
+    info = signon_identity_info_new ();
+    signon_identity_info_set_username (info, "James Bond");
+    signon_identity_info_set_secret (info, "007", TRUE);
+    signon_identity_info_add_access_control (info, "*", "*");
+    signon_identity_info_set_method (info, "ssotest", mechanisms);
+    fail_unless (signon_identity_store_info_sync (identity, info, NULL,
+                                                  &error));
+    signon_identity_info_free (info);
+
+    /* Get the session to know about the allowed mechanisms */
+    info = signon_identity_query_info_sync (identity, NULL, &error);
+    fail_unless (info != NULL);
+    signon_identity_info_free (info);
+
+    auth_session = signon_identity_create_session (identity, "ssotest",
+                                                   &error);
+    fail_unless (auth_session != NULL, "Cannot create AuthSession object");
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&builder, "{sv}", SIGNON_SESSION_DATA_USERNAME,
+                           g_variant_new_string ("test_username"));
+    g_variant_builder_add (&builder, "{sv}", SIGNON_SESSION_DATA_SECRET,
+                           g_variant_new_string ("test_pw"));
+    session_data = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+    /* A SASL-like list is allowed if any of its mechanisms is: signond
+     * reduces it to the allowed subset */
+    reply = signon_auth_session_process_sync (auth_session, session_data,
+                                              "mech2 mech1", NULL, &error);
+    fail_unless (reply != NULL, "process failed: %s",
+                 error != NULL ? error->message : "");
+    g_variant_unref (reply);
+
+    /* ...and rejected if none is */
+    reply = signon_auth_session_process_sync (auth_session, session_data,
+                                              "mech2 mech3", NULL, &error);
+    fail_unless (reply == NULL);
+    fail_unless (g_error_matches (error, SIGNON_ERROR,
+                                  SIGNON_ERROR_METHOD_OR_MECHANISM_NOT_ALLOWED),
+                 "Wrong error: %s", error->message);
+    g_clear_error (&error);
+
+    g_variant_unref (session_data);
+    g_object_unref (auth_session);
+    fail_unless (signon_identity_remove_sync (identity, NULL, &error));
+    g_object_unref (identity);
+}
+END_TEST
+
+static void
+test_auth_session_process_failure_cb (GObject *source_object,
+                                      GAsyncResult *res,
+                                      gpointer user_data)
+{
+    SignonAuthSession *auth_session = SIGNON_AUTH_SESSION (source_object);
+    GVariant *v_reply;
+    GError **error = user_data;
+
+    fail_unless (SIGNON_IS_AUTH_SESSION (source_object));
+
+    v_reply = signon_auth_session_process_finish (auth_session, res, error);
+    fail_unless (v_reply == NULL);
+
+    g_main_loop_quit (main_loop);
+}
+
+START_TEST(test_auth_session_process_failure)
+{
+    SignonAuthSession *auth_session;
+    GVariantBuilder builder;
+    GVariant *session_data;
+    GError *error = NULL;
+
+    g_debug("%s", G_STRFUNC);
+
+    auth_session = signon_auth_session_new (0, "nonexisting-method", &error);
+    fail_unless (auth_session != NULL, "Cannot create AuthSession object");
+    fail_unless (error == NULL);
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&builder, "{sv}",
+                           "key", g_variant_new_string ("value"));
+
+    session_data = g_variant_builder_end (&builder);
+
+    signon_auth_session_process (auth_session,
+                                 session_data,
+                                 "mech1",
+                                 NULL,
+                                 test_auth_session_process_failure_cb,
+                                 &error);
+
+    main_loop = g_main_loop_new (NULL, FALSE);
+    g_main_loop_run (main_loop);
+    fail_unless (error != NULL);
+    fail_unless (error->domain == SIGNON_ERROR);
+    fail_unless (error->code == SIGNON_ERROR_METHOD_NOT_KNOWN);
+
+    g_error_free (error);
+    g_object_unref (auth_session);
+
+    end_test ();
+}
+END_TEST
+
+START_TEST(test_auth_session_process_cancel)
+{
+    SignonAuthSession *auth_session;
+    GVariantBuilder builder;
+    GVariant *session_data;
+    GError *error = NULL;
+
+    g_debug("%s", G_STRFUNC);
+
+    auth_session = signon_auth_session_new (0, "nonexisting-method", &error);
+    fail_unless (auth_session != NULL, "Cannot create AuthSession object");
+    fail_unless (error == NULL);
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&builder, "{sv}",
+                           "key", g_variant_new_string ("value"));
+
+    session_data = g_variant_builder_end (&builder);
+
+    signon_auth_session_process (auth_session,
+                                 session_data,
+                                 "mech1",
+                                 NULL,
+                                 test_auth_session_process_failure_cb,
+                                 &error);
+    signon_auth_session_cancel (auth_session);
+
+    main_loop = g_main_loop_new (NULL, FALSE);
+    g_main_loop_run (main_loop);
+    fail_unless (error != NULL);
+    fail_unless (error->domain == SIGNON_ERROR);
+    fail_unless (error->code == SIGNON_ERROR_METHOD_NOT_KNOWN);
+
+    g_error_free (error);
+    g_object_unref (auth_session);
+
+    end_test ();
+}
+END_TEST
+
+static void
+test_auth_session_process_after_store_cb (GObject *source_object,
+                                          GAsyncResult *res,
+                                          gpointer user_data)
+{
+    gchar *v_username;
+    GError *error = NULL;
+    GVariantDict *dict = NULL;
+    GVariant *reply = signon_auth_session_process_finish ((SignonAuthSession *)source_object, res, &error);
+
+    if (error != NULL)
+    {
+        fail("Got error: %s", error->message);
+        g_main_loop_quit (main_loop);
+        return;
+    }
+
+    fail_unless (reply != NULL, "The result is empty");
+
+    dict = g_variant_dict_new (reply);
+    g_variant_dict_lookup (dict, SIGNON_SESSION_DATA_USERNAME, "s", &v_username);
+    fail_unless (g_strcmp0 (v_username, "Nice user") == 0,
+                 "Wrong value of username");
+    g_variant_dict_unref (dict);
+    g_free (v_username);
+
+    g_main_loop_quit (main_loop);
+}
+
+static void
+test_auth_session_process_after_store_start_session (GObject *source_object,
+                                                     GAsyncResult *res,
+                                                     gpointer user_data)
+{
+    SignonIdentity *self = (SignonIdentity *)source_object;
+    GError *error = NULL;
+    GVariant *session_data = NULL;
+    guint32 id;
+    SignonAuthSession *auth_session = (SignonAuthSession *)user_data;
+
+    fail_unless (auth_session != NULL);
+    fail_unless (SIGNON_IS_AUTH_SESSION (auth_session));
+
+    if (!signon_identity_store_info_finish (self, res, &error)) {
+        g_warning ("%s %d: %s", G_STRFUNC, __LINE__, error->message);
+        fail();
+        g_main_loop_quit (main_loop);
+        return;
+    }
+
+    id = signon_identity_get_id (self);
+    fail_unless (id > 0);
+
+    session_data = g_variant_new (g_variant_type_peek_string (G_VARIANT_TYPE_VARDICT), NULL);
+
+    signon_auth_session_process (auth_session,
+                                 session_data,
+                                 "mech1",
+                                 NULL,
+                                 test_auth_session_process_after_store_cb,
+                                 NULL);
+}
+
+START_TEST(test_auth_session_process_after_store)
+{
+    SignonIdentityInfo *info = NULL;
+    SignonIdentity *identity = NULL;
+    GList *acl = g_list_append (NULL, signon_security_context_new_from_values ("*", "*"));
+    SignonAuthSession *auth_session = NULL;
+    GError *error = NULL;
+
+    g_debug("%s", G_STRFUNC);
+
+    main_loop = g_main_loop_new (NULL, FALSE);
+
+    identity = signon_identity_new ();
+    fail_unless (SIGNON_IS_IDENTITY (identity),
+                 "Failed to initialize the Identity.");
+
+    info = signon_identity_info_new ();
+    signon_identity_info_set_username (info, "Nice user");
+    signon_identity_info_set_access_control_list (info, acl);
+
+    g_list_free_full (acl, (GDestroyNotify)signon_security_context_free);
+
+    /*
+     * This auth session will get an updated Identity ID when the identity
+     * get created.
+     */
+    auth_session = signon_identity_create_session(identity,
+                                                  "ssotest",
+                                                  &error);
+
+    fail_unless (auth_session != NULL, "Cannot create AuthSession object");
+    if (error != NULL)
+    {
+        fail ("Got error: %s", error->message);
+        g_clear_error (&error);
+    }
+
+    signon_identity_store_info (identity,
+                                info,
+                                NULL,
+                                test_auth_session_process_after_store_start_session,
+                                auth_session);
+
+    g_main_loop_run (main_loop);
+
+    g_object_unref (identity);
+    g_object_unref (auth_session);
+    signon_identity_info_free (info);
+
+    end_test ();
+}
+END_TEST
+
+static void add_methods_to_identity_info (SignonIdentityInfo *info)
+{
+    const gchar *mechanisms[] = {
+            "mechanism1",
+            "mechanism2",
+            "mechanism3",
+            NULL
+    };
+
+    signon_identity_info_set_method (info, "method1", mechanisms);
+    signon_identity_info_set_method (info, "method2", mechanisms);
+    signon_identity_info_set_method (info, "method3", mechanisms);
+}
+
+static void new_identity_store_credentials_cb (GObject *source_object,
+                                               GAsyncResult *res,
+                                               gpointer user_data)
+{
+    SignonIdentity *self = (SignonIdentity *)source_object;
+    GError *error = NULL;
     gint *new_id = user_data;
     guint32 id;
 
-    if (!signon_identity_store_info_finish (self, res, &error)) {
-        g_warning ("%s %d: %s", G_STRFUNC, __LINE__, error->message);
-        fail();
-    }
+    if (!signon_identity_store_info_finish (self, res, &error)) {
+        g_warning ("%s %d: %s", G_STRFUNC, __LINE__, error->message);
+        fail();
+    }
+
+    id = signon_identity_get_id (self);
+    fail_unless (id > 0);
+
+    *new_id = id;
+
+    g_object_unref (self);
+    g_main_loop_quit (main_loop);
+}
+
+static guint
+new_identity()
+{
+    SignonIdentity *identity;
+    GList *acl = g_list_append (NULL, signon_security_context_new_from_values ("*", "*"));
+    guint id = 0;
+
+    identity = signon_identity_new(NULL, NULL);
+    fail_unless (SIGNON_IS_IDENTITY (identity));
+
+    SignonIdentityInfo *info = signon_identity_info_new ();
+    signon_identity_info_set_username (info, "James Bond");
+    signon_identity_info_set_secret (info, "007", TRUE);
+    signon_identity_info_set_caption (info, "caption");
+
+    signon_identity_info_set_access_control_list (info, acl);
+    g_list_free_full (acl, (GDestroyNotify)signon_security_context_free);
+
+    signon_identity_store_info (identity,
+                                info,
+                                NULL,
+                                new_identity_store_credentials_cb,
+                                &id);
+    signon_identity_info_free (info);
+
+    if (id == 0)
+        g_main_loop_run (main_loop);
+
+    return id;
+
+}
+
+static gboolean
+identity_registered_cb (gpointer data)
+{
+    g_main_loop_quit (main_loop);
+    return FALSE;
+}
+
+START_TEST(test_get_existing_identity)
+{
+    g_debug("%s", G_STRFUNC);
+
+    main_loop = g_main_loop_new (NULL, FALSE);
+    guint id = new_identity();
+
+    fail_unless (id != 0);
+
+    identity = signon_identity_new_from_db(id);
+
+    fail_unless (identity != NULL);
+    fail_unless (SIGNON_IS_IDENTITY (identity),
+                 "Failed to initialize the Identity.");
+
+    g_timeout_add (1000, identity_registered_cb, identity);
+    g_main_loop_run (main_loop);
+
+    end_test ();
+}
+END_TEST
+
+START_TEST(test_get_nonexisting_identity)
+{
+    g_debug("%s", G_STRFUNC);
+    identity = signon_identity_new_from_db(G_MAXINT);
+
+    fail_unless (identity != NULL);
+    fail_unless (SIGNON_IS_IDENTITY (identity),
+                 "Failed to initialize the Identity.");
+
+    g_timeout_add (1000, identity_registered_cb, identity);
+    main_loop = g_main_loop_new (NULL, FALSE);
+    g_main_loop_run (main_loop);
+
+    const GError *error = NULL;
+    error = signon_identity_get_last_error(identity);
+    fail_unless (error != NULL);
+
+    fail_unless (error->domain == SIGNON_ERROR);
+    fail_unless (error->code == SIGNON_ERROR_IDENTITY_NOT_FOUND ||
+                 error->code == SIGNON_ERROR_PERMISSION_DENIED);
+
+    end_test ();
+}
+END_TEST
+
+static void
+async_init_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+    GError **error = user_data;
+    gboolean ok;
+
+    ok = g_async_initable_init_finish (G_ASYNC_INITABLE (source_object),
+                                       res, error);
+    fail_unless (ok == (*error == NULL));
+    g_main_loop_quit (main_loop);
+}
+
+START_TEST(test_async_init)
+{
+    GCancellable *cancellable;
+    SignonAuthSession *auth_session;
+    GError *error = NULL;
+
+    g_debug("%s", G_STRFUNC);
+    main_loop = g_main_loop_new (NULL, FALSE);
+
+    identity = signon_identity_new_from_db (G_MAXINT);
+    fail_unless (G_IS_ASYNC_INITABLE (identity));
+    g_async_initable_init_async (G_ASYNC_INITABLE (identity),
+                                 G_PRIORITY_DEFAULT, NULL,
+                                 async_init_cb, &error);
+    g_main_loop_run (main_loop);
+    fail_unless (error != NULL);
+    fail_unless (error->domain == SIGNON_ERROR);
+    fail_unless (error->code == SIGNON_ERROR_IDENTITY_NOT_FOUND ||
+                 error->code == SIGNON_ERROR_PERMISSION_DENIED);
+    g_clear_error (&error);
+    g_clear_object (&identity);
+
+    /* A cancelled initialization doesn't wait for the registration */
+    identity = signon_identity_new (NULL, NULL);
+    cancellable = g_cancellable_new ();
+    g_async_initable_init_async (G_ASYNC_INITABLE (identity),
+                                 G_PRIORITY_DEFAULT, cancellable,
+                                 async_init_cb, &error);
+    g_cancellable_cancel (cancellable);
+    g_main_loop_run (main_loop);
+    fail_unless (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED));
+    g_clear_error (&error);
+    g_object_unref (cancellable);
+
+    g_async_initable_init_async (G_ASYNC_INITABLE (identity),
+                                 G_PRIORITY_DEFAULT, NULL,
+                                 async_init_cb, &error);
+    g_main_loop_run (main_loop);
+    fail_unless (error == NULL);
+
+    auth_session = signon_identity_create_session (identity, "ssotest",
+                                                   &error);
+    fail_unless (auth_session != NULL);
+    g_async_initable_init_async (G_ASYNC_INITABLE (auth_session),
+                                 G_PRIORITY_DEFAULT, NULL,
+                                 async_init_cb, &error);
+    g_main_loop_run (main_loop);
+    fail_unless (error == NULL);
+    g_object_unref (auth_session);
+
+    end_test ();
+}
+END_TEST
+
+static void store_credentials_identity_cb (GObject *source_object,
+                                           GAsyncResult *res,
+                                           gpointer user_data)
+{
+    SignonIdentity *self = (SignonIdentity *)source_object;
+    GError *error = NULL;
+    guint32 id;
+
+    if (!signon_identity_store_info_finish (self, res, &error)) {
+        g_warning ("%s %d: %s", G_STRFUNC, __LINE__, error->message);
+        fail();
+    }
+
+    id = signon_identity_get_id (self);
+    fail_unless (id > 0);
+
+    if (user_data != NULL)
+    {
+        gint *last_id = (gint *)user_data;
+        g_warning ("%s (prev_id vs new_id): %d vs %d", G_STRFUNC, *last_id, id);
+
+        fail_unless (id == (*last_id) + 1);
+        (*last_id) += 1;
+    }
+
+    /* Wait some time to ensure that the info-updated signals are
+     * processed
+     */
+    g_timeout_add_seconds (2, quit_loop, main_loop);
+}
+
+START_TEST(test_store_credentials_identity)
+{
+    g_debug("%s", G_STRFUNC);
+    SignonIdentity *idty = signon_identity_new(NULL, NULL);
+    fail_unless (idty != NULL);
+    fail_unless (SIGNON_IS_IDENTITY (idty),
+                 "Failed to initialize the Identity.");
+
+    main_loop = g_main_loop_new (NULL, FALSE);
+    gint last_id = new_identity();
+
+    SignonIdentityInfo *info = signon_identity_info_new ();
+    signon_identity_info_set_username (info, "James Bond");
+    signon_identity_info_set_secret (info, "007", TRUE);
+    signon_identity_info_set_caption (info, "caption");
+    add_methods_to_identity_info (info);
+
+    signon_identity_store_info (idty,
+                                info,
+                                NULL,
+                                store_credentials_identity_cb,
+                                &last_id);
+    signon_identity_info_free (info);
+
+    g_main_loop_run (main_loop);
+
+    g_object_unref(idty);
+    end_test ();
+}
+END_TEST
+
+static void identity_verify_secret_cb (GObject *source_object,
+                                       GAsyncResult *res,
+                                       gpointer user_data)
+{
+    SignonIdentity *self = (SignonIdentity *)source_object;
+    GError *error = NULL;
+    gboolean valid = signon_identity_verify_secret_finish (self, res, &error);
+
+    fail_unless (error == NULL, "The callback returned error for proper secret");
+    fail_unless (valid == TRUE, "The callback gives FALSE for proper secret");
+
+    g_main_loop_quit((GMainLoop *)user_data);
+}
+
+START_TEST(test_verify_secret_identity)
+{
+    GList *acl = g_list_append (NULL, signon_security_context_new_from_values ("*", "*"));
+
+    g_debug("%s", G_STRFUNC);
+    SignonIdentity *idty = signon_identity_new(NULL, NULL);
+    fail_unless (idty != NULL);
+    fail_unless (SIGNON_IS_IDENTITY (idty),
+                 "Failed to initialize the Identity.");
+
+    gchar secret[] = "007";
+    main_loop = g_main_loop_new (NULL, FALSE);
+
+    SignonIdentityInfo *info = signon_identity_info_new ();
+    signon_identity_info_set_username (info, "James Bond");
+    signon_identity_info_set_secret (info, secret, TRUE);
+    signon_identity_info_set_caption (info, "caption");
+
+    signon_identity_info_set_access_control_list (info, acl);
+    add_methods_to_identity_info (info);
+    g_list_free_full (acl, (GDestroyNotify)signon_security_context_free);
+
+    signon_identity_store_info (idty,
+                                info,
+                                NULL,
+                                store_credentials_identity_cb,
+                                NULL);
+    signon_identity_info_free (info);
+    g_main_loop_run (main_loop);
+
+    signon_identity_verify_secret (idty,
+                                   secret,
+                                   NULL,
+                                   identity_verify_secret_cb,
+                                   main_loop);
+
+    g_main_loop_run (main_loop);
+
+    g_object_unref (idty);
+    end_test ();
+}
+END_TEST
+
+static void identity_remove_cb (GObject *source_object,
+                                GAsyncResult *res,
+                                gpointer user_data)
+{
+    SignonIdentity *self = (SignonIdentity *)source_object;
+    GError *error = NULL;
+
+    g_warning (" %s ", __func__);
+    if (signon_identity_remove_finish (self, res, &error)) {
+        g_warning ("No error");
+        fail_if (user_data != NULL, "The callback must return an error");
+    }
+    else
+    {
+        g_warning ("Error: %s ", error->message);
+        g_error_free (error);
+        fail_if (user_data == NULL, "There should be no error in callback");
+    }
+
+    g_main_loop_quit(main_loop);
+}
+
+START_TEST(test_remove_identity)
+{
+    g_debug("%s", G_STRFUNC);
+    SignonIdentity *idty = signon_identity_new();
+    fail_unless (idty != NULL);
+    fail_unless (SIGNON_IS_IDENTITY (idty),
+                 "Failed to initialize the Identity.");
+
+    main_loop = g_main_loop_new (NULL, FALSE);
+    /*
+     * Try to remove non-stored idetnity
+     * */
+    signon_identity_remove(idty, NULL, identity_remove_cb, NULL);
+    g_main_loop_run (main_loop);
+
+    /*
+     * Try to remove existing identy
+     * */
+
+    gint id = new_identity();
+    SignonIdentity *idty2 = signon_identity_new_from_db (id);
+
+    signon_identity_remove(idty2, NULL, identity_remove_cb, NULL);
+    g_main_loop_run (main_loop);
+
+    /*
+     * Try to remove already removed
+     * */
+
+    signon_identity_remove(idty2, NULL, identity_remove_cb, GINT_TO_POINTER(TRUE));
+
+    g_object_unref (idty);
+    g_object_unref (idty2);
+    end_test ();
+}
+END_TEST
+
+static void identity_info_cb (GObject *source_object,
+                              GAsyncResult *res,
+                              gpointer user_data)
+{
+    SignonIdentity *self = (SignonIdentity *)source_object;
+    GError *error = NULL;
+    SignonIdentityInfo *info = signon_identity_query_info_finish (self, res, &error);
+
+    if (error)
+    {
+        g_warning ("%s: Error: %s ", __func__, error->message);
+        fail_if (info != NULL, "Error: %s ", error->message);
+        g_main_loop_quit(main_loop);
+        return;
+    }
+
+    g_warning ("No error");
+
+    SignonIdentityInfo **pattern_ptr = (SignonIdentityInfo **)user_data;
+    SignonIdentityInfo *pattern = NULL;
+
+     if (pattern_ptr)
+         pattern = (*pattern_ptr);
+
+     if (pattern == NULL)
+         fail_unless (info == NULL, "The info must be NULL");
+     else
+     {
+         fail_unless (info != NULL, "The info must be non-null");
+         fail_unless (g_strcmp0 (signon_identity_info_get_username(info),
+                                 signon_identity_info_get_username(pattern)) == 0, "The info has wrong username");
+         fail_unless (g_strcmp0 (signon_identity_info_get_caption(info),
+                                 signon_identity_info_get_caption(pattern)) == 0, "The info has wrong caption");
+
+         GHashTable *methods = (GHashTable *)signon_identity_info_get_methods (info);
+         gchar **mechs1 = g_hash_table_lookup (methods, "method1");
+         gchar **mechs2 = g_hash_table_lookup (methods, "method2");
+         gchar **mechs3 = g_hash_table_lookup (methods, "method3");
+
+         fail_unless (g_strv_length (mechs1) == 3);
+         fail_unless (g_strv_length (mechs2) == 3);
+         fail_unless (g_strv_length (mechs3) == 3);
 
-    id = signon_identity_get_id (self);
-    fail_unless (id > 0);
+         fail_unless (_contains(mechs1, "mechanism1"));
+         fail_unless (_contains(mechs1, "mechanism2"));
+         fail_unless (_contains(mechs1, "mechanism3"));
 
-    *new_id = id;
+         fail_unless (_contains(mechs2, "mechanism1"));
+         fail_unless (_contains(mechs2, "mechanism2"));
+         fail_unless (_contains(mechs2, "mechanism3"));
 
-    g_object_unref (self);
-    g_main_loop_quit (main_loop);
+         fail_unless (_contains(mechs3, "mechanism1"));
+         fail_unless (_contains(mechs3, "mechanism2"));
+         fail_unless (_contains(mechs3, "mechanism3"));
+     }
+
+     if (info && pattern_ptr)
+     {
+         signon_identity_info_free (pattern);
+         *pattern_ptr = signon_identity_info_copy (info);
+     }
+
+     g_main_loop_quit(main_loop);
 }
 
-static guint
-new_identity()
+static SignonIdentityInfo *create_standard_info()
+{
+    g_debug("%s", G_STRFUNC);
+    SignonIdentityInfo *info = signon_identity_info_new ();
+    signon_identity_info_set_username (info, "James Bond");
+    signon_identity_info_set_secret (info, "007", TRUE);
+    signon_identity_info_set_caption (info, "caption");
+    signon_identity_info_add_access_control (info, "*", "*");
+
+    gchar *mechanisms[] = {
+            "mechanism1",
+            "mechanism2",
+            "mechanism3",
+            NULL
+    };
+
+    signon_identity_info_set_method (info, "method1", (const gchar **)mechanisms);
+    signon_identity_info_set_method (info, "method2", (const gchar **)mechanisms);
+    signon_identity_info_set_method (info, "method3", (const gchar **)mechanisms);
+
+    return info;
+}
+
+START_TEST(test_info_identity)
 {
-    SignonIdentity *identity;
     GList *acl = g_list_append (NULL, signon_security_context_new_from_values ("*", "*"));
-    guint id = 0;
+    g_debug("%s", G_STRFUNC);
+    SignonIdentity *idty = signon_identity_new();
+    fail_unless (idty != NULL);
+    fail_unless (SIGNON_IS_IDENTITY (idty),
+                 "Failed to initialize the Identity.");
 
-    identity = signon_identity_new(NULL, NULL);
-    fail_unless (SIGNON_IS_IDENTITY (identity));
+    SignonIdentityInfo *info = NULL;
 
-    SignonIdentityInfo *info = signon_identity_info_new ();
+    main_loop = g_main_loop_new (NULL, FALSE);
+    /*
+     * Try to get_info for non-stored idetnity
+     * */
+    signon_identity_query_info (idty, NULL, identity_info_cb, &info);
+    g_main_loop_run (main_loop);
+
+    info = signon_identity_info_new ();
     signon_identity_info_set_username (info, "James Bond");
     signon_identity_info_set_secret (info, "007", TRUE);
     signon_identity_info_set_caption (info, "caption");
 
     signon_identity_info_set_access_control_list (info, acl);
+    add_methods_to_identity_info (info);
     g_list_free_full (acl, (GDestroyNotify)signon_security_context_free);
 
-    signon_identity_store_info (identity,
+    signon_identity_store_info (idty,
                                 info,
                                 NULL,
-                                new_identity_store_credentials_cb,
-                                &id);
+                                store_credentials_identity_cb,
+                                NULL);
     signon_identity_info_free (info);
 
-    if (id == 0)
-        g_main_loop_run (main_loop);
+    g_main_loop_run (main_loop);
 
-    return id;
+    info = signon_identity_info_new ();
+    signon_identity_info_set_username (info, "James Bond");
+    signon_identity_info_set_secret (info, "007", TRUE);
+    signon_identity_info_set_caption (info, "caption");
+    add_methods_to_identity_info (info);
+
+    signon_identity_query_info (idty, NULL, identity_info_cb, &info);
+    g_main_loop_run (main_loop);
+
+    gint id = signon_identity_info_get_id (info);
+    fail_unless (id != 0);
+    SignonIdentity *idty2 = signon_identity_new_from_db (id);
+
+    signon_identity_query_info (idty2, NULL, identity_info_cb, &info);
+    g_main_loop_run (main_loop);
+
+    /*
+     * Try to update one identity and
+     * have a look what will happen
+     * */
+    signon_identity_info_set_username (info, "James Bond_2nd version");
+    signon_identity_info_set_caption (info, "caption_2nd version");
+
+    signon_identity_store_info (idty2,
+                                info,
+                                NULL,
+                                store_credentials_identity_cb,
+                                NULL);
+    g_main_loop_run (main_loop);
+
+    signon_identity_query_info (idty, NULL, identity_info_cb, &info);
+    g_main_loop_run (main_loop);
+    /*
+     * Try to remove existing identity and
+     * have a look what will happen
+     * */
+    signon_identity_remove(idty2, NULL, identity_remove_cb, NULL);
+    g_main_loop_run (main_loop);
+
+    signon_identity_query_info (idty2, NULL, identity_info_cb, NULL);
+    g_main_loop_run (main_loop);
+    signon_identity_query_info (idty, NULL, identity_info_cb, NULL);
+    g_main_loop_run (main_loop);
 
+    signon_identity_info_free (info);
+    g_object_unref (idty);
+    g_object_unref (idty2);
+    end_test ();
 }
+END_TEST
 
 static gboolean
-identity_registered_cb (gpointer data)
+id_array_contains (GArray *ids, guint32 id)
 {
-    g_main_loop_quit (main_loop);
+    for (guint i = 0; i < ids->len; i++)
+        if (g_array_index (ids, guint32, i) == id)
+            return TRUE;
     return FALSE;
 }
 
-START_TEST(test_get_existing_identity)
+/* The stock signond doesn't implement the "update" method: storing a
+ * changed info of the same identity must fall back to storing it in full */
+START_TEST(test_store_update_fallback)
 {
-    g_debug("%s", G_STRFUNC);
+    SignonIdentity *idty;
+    SignonIdentityInfo *info, *stored;
+    GError *error = NULL;
 
+    g_debug("%s", G_STRFUNC);
     main_loop = g_main_loop_new (NULL, FALSE);
-    guint id = new_identity();
-
-    fail_unless (id != 0);
 
-    identity = signon_identity_new_from_db(id);
+    idty = signon_identity_new ();
+    info = create_standard_info ();
+    fail_unless (signon_identity_store_info_sync (idty, info, NULL, &error));
+    signon_identity_info_free (info);
 
-    fail_unless (identity != NULL);
-    fail_unless (SIGNON_IS_IDENTITY (identity),
-                 "Failed to initialize the Identity.");
+    for (guint i = 0; i < 2; i++)
+    {
+        gchar *caption = g_strdup_printf ("caption %u", i);
+
+        info = signon_identity_query_info_sync (idty, NULL, &error);
+        fail_unless (info != NULL, "Cannot query info: %s",
+                     error ? error->message : "");
+        signon_identity_info_set_caption (info, caption);
+
+        /* The first time it's rejected by signond, then it's not tried */
+        fail_unless (signon_identity_store_info_sync (idty, info, NULL,
+                                                      &error),
+                     "Cannot store info: %s", error ? error->message : "");
+
+        stored = signon_identity_query_info_sync (idty, NULL, &error);
+        fail_unless (stored != NULL);
+        ck_assert_str_eq (signon_identity_info_get_caption (stored), caption);
+        ck_assert_str_eq (signon_identity_info_get_username (stored),
+                          signon_identity_info_get_username (info));
+        fail_unless (g_hash_table_size ((GHashTable *)
+                                        signon_identity_info_get_methods (stored)) == 3);
+
+        signon_identity_info_free (stored);
+        signon_identity_info_free (info);
+        g_free (caption);
+    }
 
-    g_timeout_add (1000, identity_registered_cb, identity);
+    signon_identity_remove (idty, NULL, identity_remove_cb, NULL);
     g_main_loop_run (main_loop);
 
+    g_object_unref (idty);
     end_test ();
 }
 END_TEST
 
-START_TEST(test_get_nonexisting_identity)
+START_TEST(test_lookup_identities_for_realm)
 {
+    const gchar *realms[] = { "*.realmtest.example", NULL };
+    GError *error = NULL;
+    GArray *ids;
+    guint32 id;
+
     g_debug("%s", G_STRFUNC);
-    identity = signon_identity_new_from_db(G_MAXINT);
+    auth_service = signon_auth_service_new ();
+    main_loop = g_main_loop_new (NULL, FALSE);
 
-    fail_unless (identity != NULL);
-    fail_unless (SIGNON_IS_IDENTITY (identity),
-                 "Failed to initialize the Identity.");
+    /* Load the index; the daemon might not allow listing the identities */
+    ids = signon_auth_service_lookup_identities_for_realm_sync (auth_service,
+                                                                "www.realmtest.example",
+                                                                NULL, &error);
+    if (ids == NULL)
+    {
+        fail_unless (g_error_matches (error, SIGNON_ERROR,
+                                      SIGNON_ERROR_PERMISSION_DENIED),
+                     "Unexpected error: %s", error->message);
+        g_error_free (error);
+        end_test ();
+        return;
+    }
+    g_array_unref (ids);
 
-    g_timeout_add (1000, identity_registered_cb, identity);
-    main_loop = g_main_loop_new (NULL, FALSE);
+    SignonIdentity *idty = signon_identity_new ();
+    SignonIdentityInfo *info = create_standard_info ();
+    signon_identity_info_set_realms (info, realms);
+    signon_identity_store_info (idty, info, NULL,
+                                store_credentials_identity_cb, NULL);
+    signon_identity_info_free (info);
     g_main_loop_run (main_loop);
 
-    const GError *error = NULL;
-    error = signon_identity_get_last_error(identity);
-    fail_unless (error != NULL);
+    id = signon_identity_get_id (idty);
+
+    /* Host names are matched case-insensitively */
+    ids = signon_auth_service_lookup_identities_for_realm_sync (auth_service,
+                                                                "WWW.RealmTest.Example.",
+                                                                NULL, &error);
+    fail_unless (ids != NULL);
+    fail_unless (id_array_contains (ids, id));
+    g_array_unref (ids);
+
+    /* The wildcard doesn't match the domain itself */
+    ids = signon_auth_service_lookup_identities_for_realm_sync (auth_service,
+                                                                "realmtest.example",
+                                                                NULL, &error);
+    fail_unless (ids != NULL);
+    fail_unless (!id_array_contains (ids, id));
+    g_array_unref (ids);
+
+    signon_identity_remove (idty, NULL, identity_remove_cb, NULL);
+    g_main_loop_run (main_loop);
 
-    fail_unless (error->domain == SIGNON_ERROR);
-    fail_unless (error->code == SIGNON_ERROR_IDENTITY_NOT_FOUND ||
-                 error->code == SIGNON_ERROR_PERMISSION_DENIED);
+    ids = signon_auth_service_lookup_identities_for_realm_sync (auth_service,
+                                                                "www.realmtest.example",
+                                                                NULL, &error);
+    fail_unless (ids != NULL);
+    fail_unless (!id_array_contains (ids, id));
+    g_array_unref (ids);
 
+    g_object_unref (idty);
     end_test ();
 }
 END_TEST
 
-static void store_credentials_identity_cb (GObject *source_object,
-                                           GAsyncResult *res,
-                                           gpointer user_data)
+static void
+identity_monitor_changed_cb (SignonIdentityMonitor *monitor,
+                             GArray *events,
+                             gpointer user_data)
 {
-    SignonIdentity *self = (SignonIdentity *)source_object;
-    GError *error = NULL;
-    guint32 id;
+    GArray *received = user_data;
 
-    if (!signon_identity_store_info_finish (self, res, &error)) {
-        g_warning ("%s %d: %s", G_STRFUNC, __LINE__, error->message);
-        fail();
+    fail_unless (events->len > 0);
+    g_array_append_vals (received, events->data, events->len);
+}
+
+static gboolean
+identity_events_contain (GArray *events, guint32 id,
+                         SignonIdentityChange change)
+{
+    for (guint i = 0; i < events->len; i++)
+    {
+        SignonIdentityEvent *event =
+            &g_array_index (events, SignonIdentityEvent, i);
+        if (event->id == id && event->change == change)
+            return TRUE;
     }
+    return FALSE;
+}
 
-    id = signon_identity_get_id (self);
-    fail_unless (id > 0);
+START_TEST(test_identity_monitor)
+{
+    GArray *events = g_array_new (FALSE, FALSE, sizeof (SignonIdentityEvent));
+    SignonIdentityMonitor *monitor;
+    SignonIdentityInfo *info;
+    guint32 id;
 
-    if (user_data != NULL)
-    {
-        gint *last_id = (gint *)user_data;
-        g_warning ("%s (prev_id vs new_id): %d vs %d", G_STRFUNC, *last_id, id);
+    g_debug("%s", G_STRFUNC);
+    main_loop = g_main_loop_new (NULL, FALSE);
 
-        fail_unless (id == (*last_id) + 1);
-        (*last_id) += 1;
-    }
+    SignonIdentity *idty = signon_identity_new ();
+    info = create_standard_info ();
+    signon_identity_store_info (idty, info, NULL,
+                                store_credentials_identity_cb, NULL);
+    g_main_loop_run (main_loop);
+    id = signon_identity_get_id (idty);
+
+    monitor = signon_identity_monitor_new ();
+    g_signal_connect (monitor, "changed",
+                      G_CALLBACK (identity_monitor_changed_cb), events);
+    signon_identity_monitor_add (monitor, id);
+    /* A non existing identity is reported as removed */
+    signon_identity_monitor_add (monitor, G_MAXINT32);
+    run_main_loop_for_n_seconds (1);
+
+    fail_unless (identity_events_contain (events, G_MAXINT32,
+                                          SIGNON_IDENTITY_CHANGE_REMOVED));
+    fail_unless (!identity_events_contain (events, id,
+                                           SIGNON_IDENTITY_CHANGE_UPDATED));
+
+    signon_identity_info_set_caption (info, "new caption");
+    signon_identity_store_info (idty, info, NULL,
+                                store_credentials_identity_cb, NULL);
+    signon_identity_info_free (info);
+    g_main_loop_run (main_loop);
 
-    /* Wait some time to ensure that the info-updated signals are
-     * processed
-     */
-    g_timeout_add_seconds (2, quit_loop, main_loop);
+    fail_unless (identity_events_contain (events, id,
+                                          SIGNON_IDENTITY_CHANGE_UPDATED));
+
+    signon_identity_remove (idty, NULL, identity_remove_cb, NULL);
+    g_main_loop_run (main_loop);
+    run_main_loop_for_n_seconds (1);
+
+    fail_unless (identity_events_contain (events, id,
+                                          SIGNON_IDENTITY_CHANGE_REMOVED));
+
+    g_object_unref (monitor);
+    g_object_unref (idty);
+    g_array_unref (events);
+    end_test ();
 }
+END_TEST
 
-START_TEST(test_store_credentials_identity)
+static void
+identity_monitor_failed_cb (SignonIdentityMonitor *monitor,
+                            guint id,
+                            const GError *error,
+                            gpointer user_data)
 {
-    g_debug("%s", G_STRFUNC);
-    SignonIdentity *idty = signon_identity_new(NULL, NULL);
-    fail_unless (idty != NULL);
-    fail_unless (SIGNON_IS_IDENTITY (idty),
-                 "Failed to initialize the Identity.");
+    fail ("Identity %u not monitored: %s", id, error->message);
+}
 
-    main_loop = g_main_loop_new (NULL, FALSE);
-    gint last_id = new_identity();
+static void
+kill_signond (void)
+{
+    GDBusConnection *connection;
+    GVariant *reply;
+    GError *error = NULL;
+    guint32 pid;
+
+    connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
+    fail_unless (connection != NULL, "No bus: %s",
+                 error ? error->message : "");
+    reply = g_dbus_connection_call_sync (connection,
+                                         "org.freedesktop.DBus",
+                                         "/org/freedesktop/DBus",
+                                         "org.freedesktop.DBus",
+                                         "GetConnectionUnixProcessID",
+                                         g_variant_new ("(s)",
+                                                        "com.google.code.AccountsSSO.SingleSignOn"),
+                                         G_VARIANT_TYPE ("(u)"),
+                                         G_DBUS_CALL_FLAGS_NONE, -1,
+                                         NULL, &error);
+    fail_unless (reply != NULL, "signond not running: %s",
+                 error ? error->message : "");
+    g_variant_get (reply, "(u)", &pid);
+    g_variant_unref (reply);
+    g_object_unref (connection);
 
-    SignonIdentityInfo *info = signon_identity_info_new ();
-    signon_identity_info_set_username (info, "James Bond");
-    signon_identity_info_set_secret (info, "007", TRUE);
-    signon_identity_info_set_caption (info, "caption");
-    add_methods_to_identity_info (info);
+    fail_unless (kill (pid, SIGTERM) == 0);
+}
 
-    signon_identity_store_info (idty,
-                                info,
-                                NULL,
-                                store_credentials_identity_cb,
-                                &last_id);
+START_TEST(test_identity_monitor_restart)
+{
+    GArray *events = g_array_new (FALSE, FALSE, sizeof (SignonIdentityEvent));
+    SignonIdentityMonitor *monitor;
+    SignonIdentityInfo *info;
+    SignonIdentity *other;
+    guint32 id;
+
+    g_debug("%s", G_STRFUNC);
+    main_loop = g_main_loop_new (NULL, FALSE);
+
+    SignonIdentity *idty = signon_identity_new ();
+    info = create_standard_info ();
+    signon_identity_store_info (idty, info, NULL,
+                                store_credentials_identity_cb, NULL);
+    g_main_loop_run (main_loop);
+    id = signon_identity_get_id (idty);
+
+    monitor = signon_identity_monitor_new ();
+    g_signal_connect (monitor, "changed",
+                      G_CALLBACK (identity_monitor_changed_cb), events);
+    g_signal_connect (monitor, "failed",
+                      G_CALLBACK (identity_monitor_failed_cb), NULL);
+    signon_identity_monitor_add (monitor, id);
+    run_main_loop_for_n_seconds (1);
+
+    kill_signond ();
+    run_main_loop_for_n_seconds (1);
+
+    /* Using another identity brings signond back */
+    other = signon_identity_new_from_db (id);
+    signon_identity_query_info (other, NULL, identity_info_cb, &info);
+    g_main_loop_run (main_loop);
+    run_main_loop_for_n_seconds (1);
+
+    fail_unless (identity_events_contain (events, id,
+                                          SIGNON_IDENTITY_CHANGE_RESYNC),
+                 "The restart of signond was not reported");
+
+    /* ...and the identity is monitored again */
+    g_array_set_size (events, 0);
+    signon_identity_info_set_caption (info, "new caption");
+    signon_identity_store_info (other, info, NULL,
+                                store_credentials_identity_cb, NULL);
     signon_identity_info_free (info);
+    g_main_loop_run (main_loop);
+    run_main_loop_for_n_seconds (1);
+
+    fail_unless (identity_events_contain (events, id,
+                                          SIGNON_IDENTITY_CHANGE_UPDATED));
 
+    signon_identity_remove (other, NULL, identity_remove_cb, NULL);
     g_main_loop_run (main_loop);
 
-    g_object_unref(idty);
+    g_object_unref (monitor);
+    g_object_unref (other);
+    g_object_unref (idty);
+    g_array_unref (events);
     end_test ();
 }
 END_TEST
 
-static void identity_verify_secret_cb (GObject *source_object,
-                                       GAsyncResult *res,
-                                       gpointer user_data)
+static void identity_signout_cb (GObject *source_object,
+                                 GAsyncResult *res,
+                                 gpointer user_data)
 {
     SignonIdentity *self = (SignonIdentity *)source_object;
     GError *error = NULL;
-    gboolean valid = signon_identity_verify_secret_finish (self, res, &error);
-
-    fail_unless (error == NULL, "The callback returned error for proper secret");
-    fail_unless (valid == TRUE, "The callback gives FALSE for proper secret");
+    if (signon_identity_sign_out_finish (self, res, &error))
+        g_warning ("%s: No error", G_STRFUNC);
+    else
+    {
+        g_warning ("%s: %s", G_STRFUNC, error->message);
+        fail_unless (error == NULL, "There should be no error in callback");
+        g_error_free (error);
+    }
 
-    g_main_loop_quit((GMainLoop *)user_data);
+    g_main_loop_quit (main_loop);
 }
 
-START_TEST(test_verify_secret_identity)
+static void identity_signout_signal_cb (gpointer instance, gpointer user_data)
 {
-    GList *acl = g_list_append (NULL, signon_security_context_new_from_values ("*", "*"));
+    gint *incr = (gint *)user_data;
+    (*incr) = (*incr) + 1;
+    g_warning ("%s: %d", G_STRFUNC, *incr);
+}
 
+START_TEST(test_identity_idle_timeout)
+{
     g_debug("%s", G_STRFUNC);
-    SignonIdentity *idty = signon_identity_new(NULL, NULL);
-    fail_unless (idty != NULL);
-    fail_unless (SIGNON_IS_IDENTITY (idty),
-                 "Failed to initialize the Identity.");
+    SignonIdentity *idty = signon_identity_new ();
+    SignonIdentity *other;
+    SignonIdentityInfo *info = create_standard_info ();
+    GError *error = NULL;
+    gint signouts = 0;
+    guint32 id;
 
-    gchar secret[] = "007";
     main_loop = g_main_loop_new (NULL, FALSE);
 
-    SignonIdentityInfo *info = signon_identity_info_new ();
-    signon_identity_info_set_username (info, "James Bond");
-    signon_identity_info_set_secret (info, secret, TRUE);
-    signon_identity_info_set_caption (info, "caption");
+    signon_identity_set_idle_timeout (idty, 1);
+    fail_unless (signon_identity_get_idle_timeout (idty) == 1);
 
-    signon_identity_info_set_access_control_list (info, acl);
-    add_methods_to_identity_info (info);
-    g_list_free_full (acl, (GDestroyNotify)signon_security_context_free);
+    /* The callback waits long enough for the identity to be released */
+    signon_identity_store_info (idty, info, NULL,
+                                store_credentials_identity_cb, NULL);
+    g_main_loop_run (main_loop);
+    id = signon_identity_get_id (idty);
+    fail_unless (id != 0);
 
-    signon_identity_store_info (idty,
-                                info,
-                                NULL,
-                                store_credentials_identity_cb,
-                                NULL);
-    signon_identity_info_free (info);
+    /* Another client of the same identity */
+    other = signon_identity_new_from_db (id);
+    run_main_loop_for_n_seconds (2);
+    g_signal_connect (idty, "signed-out",
+                      G_CALLBACK (identity_signout_signal_cb), &signouts);
+
+    /* Once released, the identity doesn't get the signals of its remote
+     * object anymore */
+    fail_unless (signon_identity_sign_out_sync (other, NULL, &error));
+    run_main_loop_for_n_seconds (1);
+    fail_unless (signouts == 0, "The idle identity was not released");
+
+    /* The identity is registered again when it's used */
+    signon_identity_query_info (idty, NULL, identity_info_cb, &info);
     g_main_loop_run (main_loop);
 
-    signon_identity_verify_secret (idty,
-                                   secret,
-                                   NULL,
-                                   identity_verify_secret_cb,
-                                   main_loop);
+    /* ...and from then on gets the signals again */
+    signon_identity_set_idle_timeout (idty, 0);
+    fail_unless (signon_identity_sign_out_sync (other, NULL, &error));
+    run_main_loop_for_n_seconds (1);
+    fail_unless (signouts == 1, "The identity was not registered again");
 
+    signon_identity_remove (idty, NULL, identity_remove_cb, NULL);
     g_main_loop_run (main_loop);
 
+    signon_identity_info_free (info);
+    g_object_unref (other);
     g_object_unref (idty);
     end_test ();
 }
 END_TEST
 
-static void identity_remove_cb (GObject *source_object,
-                                GAsyncResult *res,
-                                gpointer user_data)
+/* The idle timeout started by a synchronous call must run in the main
+ * loop, not in the context of the call */
+START_TEST(test_identity_idle_timeout_sync)
+{
+    g_debug("%s", G_STRFUNC);
+    SignonIdentity *idty = signon_identity_new ();
+    SignonIdentity *other;
+    SignonIdentityInfo *info = create_standard_info ();
+    GError *error = NULL;
+    gint signouts = 0;
+
+    main_loop = g_main_loop_new (NULL, FALSE);
+
+    signon_identity_set_idle_timeout (idty, 1);
+    fail_unless (signon_identity_store_info_sync (idty, info, NULL, &error));
+    signon_identity_info_free (info);
+
+    other = signon_identity_new_from_db (signon_identity_get_id (idty));
+    run_main_loop_for_n_seconds (2);
+    g_signal_connect (idty, "signed-out",
+                      G_CALLBACK (identity_signout_signal_cb), &signouts);
+
+    signon_identity_sign_out (other, NULL, identity_signout_cb, NULL);
+    g_main_loop_run (main_loop);
+    run_main_loop_for_n_seconds (1);
+    fail_unless (signouts == 0, "The idle identity was not released");
+
+    signon_identity_remove (idty, NULL, identity_remove_cb, NULL);
+    g_main_loop_run (main_loop);
+
+    g_object_unref (other);
+    g_object_unref (idty);
+    end_test ();
+}
+END_TEST
+
+static void
+identity_reference_cb (GObject *source_object,
+                       GAsyncResult *res,
+                       gpointer user_data)
 {
     SignonIdentity *self = (SignonIdentity *)source_object;
+    gboolean add = GPOINTER_TO_INT (user_data);
     GError *error = NULL;
+    gboolean ok;
 
-    g_warning (" %s ", __func__);
-    if (signon_identity_remove_finish (self, res, &error)) {
-        g_warning ("No error");
-        fail_if (user_data != NULL, "The callback must return an error");
-    }
+    if (add)
+        ok = signon_identity_add_reference_finish (self, res, &error);
     else
+        ok = signon_identity_remove_reference_finish (self, res, &error);
+
+    if (!ok)
     {
-        g_warning ("Error: %s ", error->message);
+        g_warning ("%s: %s", G_STRFUNC, error->message);
         g_error_free (error);
-        fail_if (user_data == NULL, "There should be no error in callback");
+        fail();
     }
 
-    g_main_loop_quit(main_loop);
+    g_main_loop_quit (main_loop);
 }
 
-START_TEST(test_remove_identity)
+START_TEST(test_identity_reference)
 {
     g_debug("%s", G_STRFUNC);
-    SignonIdentity *idty = signon_identity_new();
-    fail_unless (idty != NULL);
-    fail_unless (SIGNON_IS_IDENTITY (idty),
-                 "Failed to initialize the Identity.");
+    SignonIdentity *idty = signon_identity_new ();
+    SignonIdentity *other;
+    SignonIdentityInfo *info = create_standard_info ();
 
     main_loop = g_main_loop_new (NULL, FALSE);
-    /*
-     * Try to remove non-stored idetnity
-     * */
-    signon_identity_remove(idty, NULL, identity_remove_cb, NULL);
-    g_main_loop_run (main_loop);
 
-    /*
-     * Try to remove existing identy
-     * */
-
-    gint id = new_identity();
-    SignonIdentity *idty2 = signon_identity_new_from_db (id);
+    signon_identity_store_info (idty, info, NULL,
+                                store_credentials_identity_cb, NULL);
+    g_main_loop_run (main_loop);
 
-    signon_identity_remove(idty2, NULL, identity_remove_cb, NULL);
+    signon_identity_add_reference (idty, "in-use", NULL,
+                                   identity_reference_cb,
+                                   GINT_TO_POINTER (TRUE));
     g_main_loop_run (main_loop);
 
-    /*
-     * Try to remove already removed
-     * */
+    /* The reference is stored by signond, not by the object: another
+     * object can remove it */
+    other = signon_identity_new_from_db (signon_identity_get_id (idty));
+    signon_identity_remove_reference (other, "in-use", NULL,
+                                      identity_reference_cb,
+                                      GINT_TO_POINTER (FALSE));
+    g_main_loop_run (main_loop);
 
-    signon_identity_remove(idty2, NULL, identity_remove_cb, GINT_TO_POINTER(TRUE));
+    signon_identity_remove (idty, NULL, identity_remove_cb, NULL);
+    g_main_loop_run (main_loop);
 
+    signon_identity_info_free (info);
+    g_object_unref (other);
     g_object_unref (idty);
-    g_object_unref (idty2);
     end_test ();
 }
 END_TEST
 
-static void identity_info_cb (GObject *source_object,
-                              GAsyncResult *res,
-                              gpointer user_data)
+START_TEST(test_identity_keep_alive)
 {
-    SignonIdentity *self = (SignonIdentity *)source_object;
-    GError *error = NULL;
-    SignonIdentityInfo *info = signon_identity_query_info_finish (self, res, &error);
-
-    if (error)
-    {
-        g_warning ("%s: Error: %s ", __func__, error->message);
-        fail_if (info != NULL, "Error: %s ", error->message);
-        g_main_loop_quit(main_loop);
-        return;
-    }
-
-    g_warning ("No error");
-
-    SignonIdentityInfo **pattern_ptr = (SignonIdentityInfo **)user_data;
-    SignonIdentityInfo *pattern = NULL;
+    g_debug("%s", G_STRFUNC);
+    SignonIdentity *idty = signon_identity_new ();
+    SignonIdentity *other;
+    SignonIdentityInfo *info = create_standard_info ();
+    gint signouts = 0;
 
-     if (pattern_ptr)
-         pattern = (*pattern_ptr);
+    main_loop = g_main_loop_new (NULL, FALSE);
 
-     if (pattern == NULL)
-         fail_unless (info == NULL, "The info must be NULL");
-     else
-     {
-         fail_unless (info != NULL, "The info must be non-null");
-         fail_unless (g_strcmp0 (signon_identity_info_get_username(info),
-                                 signon_identity_info_get_username(pattern)) == 0, "The info has wrong username");
-         fail_unless (g_strcmp0 (signon_identity_info_get_caption(info),
-                                 signon_identity_info_get_caption(pattern)) == 0, "The info has wrong caption");
+    signon_identity_store_info (idty, info, NULL,
+                                store_credentials_identity_cb, NULL);
+    g_main_loop_run (main_loop);
 
-         GHashTable *methods = (GHashTable *)signon_identity_info_get_methods (info);
-         gchar **mechs1 = g_hash_table_lookup (methods, "method1");
-         gchar **mechs2 = g_hash_table_lookup (methods, "method2");
-         gchar **mechs3 = g_hash_table_lookup (methods, "method3");
+    signon_identity_set_keep_alive (idty, TRUE);
+    fail_unless (signon_identity_get_keep_alive (idty));
+    g_signal_connect (idty, "signed-out",
+                      G_CALLBACK (identity_signout_signal_cb), &signouts);
 
-         fail_unless (g_strv_length (mechs1) == 3);
-         fail_unless (g_strv_length (mechs2) == 3);
-         fail_unless (g_strv_length (mechs3) == 3);
+    /* Long enough for signond to release the remote objects: without the
+     * keep-alive, the identity would miss the signals from then on */
+    run_main_loop_for_n_seconds (SIGNOND_IDLE_TIMEOUT);
 
-         fail_unless (_contains(mechs1, "mechanism1"));
-         fail_unless (_contains(mechs1, "mechanism2"));
-         fail_unless (_contains(mechs1, "mechanism3"));
+    other = signon_identity_new_from_db (signon_identity_get_id (idty));
+    signon_identity_sign_out (other, NULL, identity_signout_cb, NULL);
+    g_main_loop_run (main_loop);
+    run_main_loop_for_n_seconds (1);
+    fail_unless (signouts == 1, "The identity was not kept alive");
 
-         fail_unless (_contains(mechs2, "mechanism1"));
-         fail_unless (_contains(mechs2, "mechanism2"));
-         fail_unless (_contains(mechs2, "mechanism3"));
+    signon_identity_set_keep_alive (idty, FALSE);
+    signon_identity_remove (idty, NULL, identity_remove_cb, NULL);
+    g_main_loop_run (main_loop);
 
-         fail_unless (_contains(mechs3, "mechanism1"));
-         fail_unless (_contains(mechs3, "mechanism2"));
-         fail_unless (_contains(mechs3, "mechanism3"));
-     }
+    signon_identity_info_free (info);
+    g_object_unref (other);
+    g_object_unref (idty);
+    end_test ();
+}
+END_TEST
 
-     if (info && pattern_ptr)
-     {
-         signon_identity_info_free (pattern);
-         *pattern_ptr = signon_identity_info_copy (info);
-     }
+static void
+store_identities_progress_cb (guint n_done, guint n_total,
+                              gpointer user_data)
+{
+    guint *last_done = user_data;
 
-     g_main_loop_quit(main_loop);
+    fail_unless (n_done == *last_done + 1);
+    fail_unless (n_done <= n_total);
+    *last_done = n_done;
 }
 
-static SignonIdentityInfo *create_standard_info()
+static void
+store_identities_cb (GObject *source_object,
+                     GAsyncResult *res,
+                     gpointer user_data)
 {
-    g_debug("%s", G_STRFUNC);
-    SignonIdentityInfo *info = signon_identity_info_new ();
-    signon_identity_info_set_username (info, "James Bond");
-    signon_identity_info_set_secret (info, "007", TRUE);
-    signon_identity_info_set_caption (info, "caption");
-    signon_identity_info_add_access_control (info, "*", "*");
+    SignonAuthService *service = SIGNON_AUTH_SERVICE (source_object);
+    GError *error = NULL;
+    GArray *ids = NULL;
+    GPtrArray *errors = NULL;
+
+    fail_unless (signon_auth_service_store_identities_finish (service, res,
+                                                              &ids, &errors,
+                                                              &error));
+    fail_unless (ids->len == 5);
+    fail_unless (errors->len == 5);
+    for (guint i = 0; i < ids->len; i++)
+    {
+        fail_unless (g_ptr_array_index (errors, i) == NULL);
+        fail_unless (g_array_index (ids, guint32, i) != 0);
+    }
 
-    gchar *mechanisms[] = {
-            "mechanism1",
-            "mechanism2",
-            "mechanism3",
-            NULL
-    };
+    *(GArray **)user_data = ids;
+    g_ptr_array_unref (errors);
+    g_main_loop_quit (main_loop);
+}
 
-    signon_identity_info_set_method (info, "method1", (const gchar **)mechanisms);
-    signon_identity_info_set_method (info, "method2", (const gchar **)mechanisms);
-    signon_identity_info_set_method (info, "method3", (const gchar **)mechanisms);
+static void
+identities_bulk_cb (GObject *source_object,
+                    GAsyncResult *res,
+                    gpointer user_data)
+{
+    SignonAuthService *service = SIGNON_AUTH_SERVICE (source_object);
+    GError *error = NULL;
+    GPtrArray *errors = NULL;
+    gboolean ok;
 
-    return info;
+    if (user_data != NULL)
+        ok = signon_auth_service_remove_identities_finish (service, res,
+                                                           &errors, &error);
+    else
+        ok = signon_auth_service_sign_out_identities_finish (service, res,
+                                                             &errors, &error);
+    fail_unless (ok);
+    fail_unless (errors->len == 5);
+    for (guint i = 0; i < errors->len; i++)
+        fail_unless (g_ptr_array_index (errors, i) == NULL);
+
+    g_ptr_array_unref (errors);
+    g_main_loop_quit (main_loop);
 }
 
-START_TEST(test_info_identity)
+START_TEST(test_store_identities)
 {
-    GList *acl = g_list_append (NULL, signon_security_context_new_from_values ("*", "*"));
-    g_debug("%s", G_STRFUNC);
-    SignonIdentity *idty = signon_identity_new();
-    fail_unless (idty != NULL);
-    fail_unless (SIGNON_IS_IDENTITY (idty),
-                 "Failed to initialize the Identity.");
-
-    SignonIdentityInfo *info = NULL;
+    GPtrArray *infos;
+    SignonIdentityInfo *template;
+    GArray *ids = NULL;
+    guint last_done = 0;
 
+    g_debug("%s", G_STRFUNC);
+    auth_service = signon_auth_service_new ();
     main_loop = g_main_loop_new (NULL, FALSE);
-    /*
-     * Try to get_info for non-stored idetnity
-     * */
-    signon_identity_query_info (idty, NULL, identity_info_cb, &info);
-    g_main_loop_run (main_loop);
-
-    info = signon_identity_info_new ();
-    signon_identity_info_set_username (info, "James Bond");
-    signon_identity_info_set_secret (info, "007", TRUE);
-    signon_identity_info_set_caption (info, "caption");
 
-    signon_identity_info_set_access_control_list (info, acl);
-    add_methods_to_identity_info (info);
-    g_list_free_full (acl, (GDestroyNotify)signon_security_context_free);
+    template = create_standard_info ();
+    infos = g_ptr_array_new_with_free_func ((GDestroyNotify)signon_identity_info_free);
+    for (guint i = 0; i < 5; i++)
+    {
+        SignonIdentityInfo *info = signon_identity_info_copy (template);
+        gchar *username = g_strdup_printf ("user%u", i);
 
-    signon_identity_store_info (idty,
-                                info,
-                                NULL,
-                                store_credentials_identity_cb,
-                                NULL);
-    signon_identity_info_free (info);
+        signon_identity_info_set_username (info, username);
+        g_ptr_array_add (infos, info);
+        g_free (username);
+    }
+    signon_identity_info_free (template);
 
+    signon_auth_service_store_identities (auth_service, infos, 2,
+                                          store_identities_progress_cb,
+                                          &last_done, NULL,
+                                          NULL, store_identities_cb, &ids);
+    g_ptr_array_unref (infos);
     g_main_loop_run (main_loop);
 
-    info = signon_identity_info_new ();
-    signon_identity_info_set_username (info, "James Bond");
-    signon_identity_info_set_secret (info, "007", TRUE);
-    signon_identity_info_set_caption (info, "caption");
-    add_methods_to_identity_info (info);
+    fail_unless (last_done == 5);
+    fail_unless (ids != NULL);
 
-    signon_identity_query_info (idty, NULL, identity_info_cb, &info);
+    signon_auth_service_sign_out_identities (auth_service, ids, 2, NULL,
+                                             identities_bulk_cb, NULL);
     g_main_loop_run (main_loop);
 
-    gint id = signon_identity_info_get_id (info);
-    fail_unless (id != 0);
-    SignonIdentity *idty2 = signon_identity_new_from_db (id);
-
-    signon_identity_query_info (idty2, NULL, identity_info_cb, &info);
+    signon_auth_service_remove_identities (auth_service, ids, 0, NULL,
+                                           identities_bulk_cb,
+                                           GINT_TO_POINTER (TRUE));
     g_main_loop_run (main_loop);
 
-    /*
-     * Try to update one identity and
-     * have a look what will happen
-     * */
-    signon_identity_info_set_username (info, "James Bond_2nd version");
-    signon_identity_info_set_caption (info, "caption_2nd version");
+    g_array_unref (ids);
+    end_test ();
+}
+END_TEST
 
-    signon_identity_store_info (idty2,
-                                info,
-                                NULL,
-                                store_credentials_identity_cb,
-                                NULL);
-    g_main_loop_run (main_loop);
+static void
+store_identities_cancel_cb (guint n_done, guint n_total,
+                            gpointer user_data)
+{
+    /* Cancel as soon as the first identity has been stored */
+    g_cancellable_cancel (G_CANCELLABLE (user_data));
+}
 
-    signon_identity_query_info (idty, NULL, identity_info_cb, &info);
-    g_main_loop_run (main_loop);
-    /*
-     * Try to remove existing identity and
-     * have a look what will happen
-     * */
-    signon_identity_remove(idty2, NULL, identity_remove_cb, NULL);
-    g_main_loop_run (main_loop);
+static void
+store_identities_cancelled_cb (GObject *source_object,
+                               GAsyncResult *res,
+                               gpointer user_data)
+{
+    SignonAuthService *service = SIGNON_AUTH_SERVICE (source_object);
+    GError *error = NULL;
+    GArray *ids = NULL;
+    GPtrArray *errors = NULL;
 
-    signon_identity_query_info (idty2, NULL, identity_info_cb, NULL);
+    fail_unless (!signon_auth_service_store_identities_finish (service, res,
+                                                               &ids, &errors,
+                                                               &error));
+    fail_unless (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED));
+    g_error_free (error);
+
+    /* The identity stored before the cancellation is not lost */
+    fail_unless (ids != NULL && errors != NULL);
+    fail_unless (ids->len == 5);
+    fail_unless (errors->len == 5);
+    fail_unless (g_ptr_array_index (errors, 0) == NULL);
+    fail_unless (g_array_index (ids, guint32, 0) != 0);
+    for (guint i = 1; i < ids->len; i++)
+    {
+        fail_unless (g_error_matches (g_ptr_array_index (errors, i),
+                                      G_IO_ERROR, G_IO_ERROR_CANCELLED));
+        fail_unless (g_array_index (ids, guint32, i) == 0);
+    }
+
+    *(GArray **)user_data = ids;
+    g_ptr_array_unref (errors);
+    g_main_loop_quit (main_loop);
+}
+
+START_TEST(test_store_identities_cancel)
+{
+    GPtrArray *infos;
+    GCancellable *cancellable;
+    SignonIdentity *idty;
+    GArray *ids = NULL;
+
+    g_debug("%s", G_STRFUNC);
+    auth_service = signon_auth_service_new ();
+    main_loop = g_main_loop_new (NULL, FALSE);
+
+    infos = g_ptr_array_new_with_free_func ((GDestroyNotify)signon_identity_info_free);
+    for (guint i = 0; i < 5; i++)
+        g_ptr_array_add (infos, create_standard_info ());
+
+    /* The cancellable is released when the operation is over */
+    cancellable = g_cancellable_new ();
+    signon_auth_service_store_identities (auth_service, infos, 1,
+                                          store_identities_cancel_cb,
+                                          g_object_ref (cancellable),
+                                          g_object_unref,
+                                          cancellable,
+                                          store_identities_cancelled_cb,
+                                          &ids);
+    g_ptr_array_unref (infos);
     g_main_loop_run (main_loop);
-    signon_identity_query_info (idty, NULL, identity_info_cb, NULL);
+
+    fail_unless (ids != NULL);
+    idty = signon_identity_new_from_db (g_array_index (ids, guint32, 0));
+    signon_identity_remove (idty, NULL, identity_remove_cb, NULL);
     g_main_loop_run (main_loop);
 
-    signon_identity_info_free (info);
     g_object_unref (idty);
-    g_object_unref (idty2);
+    g_array_unref (ids);
+    fail_unless (G_OBJECT (cancellable)->ref_count == 1);
+    g_object_unref (cancellable);
     end_test ();
 }
 END_TEST
 
-static void identity_signout_cb (GObject *source_object,
-                                 GAsyncResult *res,
-                                 gpointer user_data)
+/* Held by the test until all the threads have been created */
+static GMutex sync_api_gate;
+
+static SignonIdentityInfo *
+create_sync_api_info ()
 {
-    SignonIdentity *self = (SignonIdentity *)source_object;
+    SignonIdentityInfo *info = create_standard_info ();
+    const gchar *any_mechanism[] = { NULL };
+
+    signon_identity_info_set_method (info, "ssotest", any_mechanism);
+    return info;
+}
+
+/* Authenticates with an auth session of @idty; returns NULL on success, or a
+ * description of the failure. */
+static gchar *
+sync_api_process (SignonIdentity *idty)
+{
+    SignonAuthSession *auth_session;
+    GVariantBuilder builder;
+    GVariant *reply;
     GError *error = NULL;
-    if (signon_identity_sign_out_finish (self, res, &error))
-        g_warning ("%s: No error", G_STRFUNC);
-    else
+    gchar *failure = NULL;
+
+    auth_session = signon_identity_create_session (idty, "ssotest", &error);
+    if (auth_session == NULL)
     {
-        g_warning ("%s: %s", G_STRFUNC, error->message);
-        fail_unless (error == NULL, "There should be no error in callback");
+        failure = g_strdup_printf ("create_session: %s", error->message);
         g_error_free (error);
+        return failure;
     }
 
-    g_main_loop_quit (main_loop);
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&builder, "{sv}", SIGNON_SESSION_DATA_USERNAME,
+                           g_variant_new_string ("test_username"));
+    g_variant_builder_add (&builder, "{sv}", SIGNON_SESSION_DATA_SECRET,
+                           g_variant_new_string ("test_pw"));
+    reply = signon_auth_session_process_sync (auth_session,
+                                              g_variant_builder_end (&builder),
+                                              "mech1", NULL, &error);
+    g_object_unref (auth_session);
+    if (reply == NULL)
+    {
+        failure = g_strdup_printf ("process: %s", error->message);
+        g_error_free (error);
+        return failure;
+    }
+
+    g_variant_unref (reply);
+    return NULL;
 }
 
-static void identity_signout_signal_cb (gpointer instance, gpointer user_data)
+/* Runs the synchronous API in a thread with no main loop, on its own
+ * identity and on its own client of the identity shared by all the threads;
+ * returns NULL on success, or a description of the first failure. */
+static gpointer
+sync_api_thread (gpointer user_data)
 {
-    gint *incr = (gint *)user_data;
-    (*incr) = (*incr) + 1;
-    g_warning ("%s: %d", G_STRFUNC, *incr);
+    guint32 shared_id = GPOINTER_TO_UINT (user_data);
+    SignonIdentity *idty, *shared;
+    SignonIdentityInfo *info = NULL;
+    GError *error = NULL;
+    gchar *failure = NULL;
+
+    /* Start all together */
+    g_mutex_lock (&sync_api_gate);
+    g_mutex_unlock (&sync_api_gate);
+
+    shared = signon_identity_new_from_db (shared_id);
+    idty = signon_identity_new ();
+
+    info = signon_identity_query_info_sync (shared, NULL, &error);
+    if (info == NULL)
+    {
+        failure = g_strdup_printf ("query_info (shared): %s", error->message);
+        goto out;
+    }
+    if (signon_identity_info_get_id (info) != (gint)shared_id)
+    {
+        failure = g_strdup ("query_info (shared): wrong ID");
+        goto out;
+    }
+    g_clear_pointer (&info, signon_identity_info_free);
+
+    failure = sync_api_process (shared);
+    if (failure != NULL)
+        goto out;
+
+    info = create_sync_api_info ();
+    if (!signon_identity_store_info_sync (idty, info, NULL, &error))
+    {
+        failure = g_strdup_printf ("store_info: %s", error->message);
+        goto out;
+    }
+    g_clear_pointer (&info, signon_identity_info_free);
+
+    info = signon_identity_query_info_sync (idty, NULL, &error);
+    if (info == NULL)
+    {
+        failure = g_strdup_printf ("query_info: %s", error->message);
+        goto out;
+    }
+    if (signon_identity_info_get_id (info) != (gint)signon_identity_get_id (idty))
+    {
+        failure = g_strdup ("query_info: wrong ID");
+        goto out;
+    }
+
+    failure = sync_api_process (idty);
+    if (failure != NULL)
+        goto out;
+
+    if (!signon_identity_sign_out_sync (idty, NULL, &error))
+    {
+        failure = g_strdup_printf ("sign_out: %s", error->message);
+        goto out;
+    }
+
+    if (!signon_identity_remove_sync (idty, NULL, &error))
+        failure = g_strdup_printf ("remove: %s", error->message);
+
+out:
+    g_clear_pointer (&info, signon_identity_info_free);
+    g_clear_error (&error);
+    g_object_unref (idty);
+    g_object_unref (shared);
+    return failure;
+}
+
+/* Several threads run synchronous calls at the same time, each one on its
+ * own objects, also for the same identity */
+START_TEST(test_sync_api_threads)
+{
+    SignonIdentity *shared;
+    SignonIdentityInfo *info;
+    GThread *threads[8];
+    GError *error = NULL;
+    guint32 shared_id;
+    guint i;
+
+    g_debug("%s", G_STRFUNC);
+
+    shared = signon_identity_new ();
+    info = create_sync_api_info ();
+    fail_unless (signon_identity_store_info_sync (shared, info, NULL, &error));
+    signon_identity_info_free (info);
+    shared_id = signon_identity_get_id (shared);
+
+    g_mutex_lock (&sync_api_gate);
+    for (i = 0; i < G_N_ELEMENTS (threads); i++)
+        threads[i] = g_thread_new ("sync-api", sync_api_thread,
+                                   GUINT_TO_POINTER (shared_id));
+    g_mutex_unlock (&sync_api_gate);
+
+    for (i = 0; i < G_N_ELEMENTS (threads); i++)
+    {
+        gchar *failure = g_thread_join (threads[i]);
+        fail_unless (failure == NULL, "Thread %u failed: %s", i, failure);
+    }
+
+    fail_unless (signon_identity_remove_sync (shared, NULL, &error));
+    g_object_unref (shared);
 }
+END_TEST
 
 START_TEST(test_signout_identity)
 {
@@ -1273,6 +2679,147 @@ START_TEST(test_signout_identity)
 }
 END_TEST
 
+/* The signals of signond are dispatched by object path: each one must reach
+ * its own objects, and only those, when several of them are alive. */
+START_TEST(test_signal_routing)
+{
+    SignonIdentity *idty1, *idty1_copy, *idty2;
+    SignonIdentityInfo *info;
+    SignonAuthSession *as1, *as2;
+    const gchar *any_mechanism[] = { NULL };
+    gint signouts1 = 0, signouts2 = 0;
+    gint states1 = 0, states2 = 0;
+    GVariantBuilder builder;
+    GVariant *reply = NULL;
+    GError *error = NULL;
+    guint32 id1, id2;
+
+    g_debug("%s", G_STRFUNC);
+    main_loop = g_main_loop_new (NULL, FALSE);
+
+    info = create_standard_info ();
+    signon_identity_info_set_method (info, "ssotest", any_mechanism);
+
+    idty1 = signon_identity_new ();
+    fail_unless (signon_identity_store_info_sync (idty1, info, NULL, &error));
+    idty2 = signon_identity_new ();
+    fail_unless (signon_identity_store_info_sync (idty2, info, NULL, &error));
+    signon_identity_info_free (info);
+
+    id1 = signon_identity_get_id (idty1);
+    id2 = signon_identity_get_id (idty2);
+    fail_unless (id1 != id2);
+
+    /* A second client of the first identity */
+    idty1_copy = signon_identity_new_from_db (id1);
+    run_main_loop_for_n_seconds (2);
+
+    /* stateChanged */
+    as1 = signon_identity_create_session (idty1, "ssotest", &error);
+    fail_unless (as1 != NULL, "cannot create AuthSession");
+    as2 = signon_identity_create_session (idty2, "ssotest", &error);
+    fail_unless (as2 != NULL, "cannot create AuthSession");
+    g_signal_connect (as1, "state-changed",
+                      G_CALLBACK (test_auth_session_states_cb), &states1);
+    g_signal_connect (as2, "state-changed",
+                      G_CALLBACK (test_auth_session_states_cb), &states2);
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&builder, "{sv}", SIGNON_SESSION_DATA_USERNAME,
+                           g_variant_new_string ("test_username"));
+    signon_auth_session_process (as2, g_variant_builder_end (&builder),
+                                 "mech1", NULL,
+                                 test_auth_session_process_async_cb,
+                                 &reply);
+    g_main_loop_run (main_loop);
+    fail_unless (reply != NULL);
+    g_variant_unref (reply);
+
+    fail_unless (states2 > 0, "No state changes received");
+    fail_unless (states1 == 0, "Got %d state changes of another session",
+                 states1);
+
+    /* infoUpdated */
+    g_signal_connect (idty1, "signed-out",
+                      G_CALLBACK (identity_signout_signal_cb), &signouts1);
+    g_signal_connect (idty1_copy, "signed-out",
+                      G_CALLBACK (identity_signout_signal_cb), &signouts1);
+    g_signal_connect (idty2, "signed-out",
+                      G_CALLBACK (identity_signout_signal_cb), &signouts2);
+
+    fail_unless (signon_identity_sign_out_sync (idty1, NULL, &error));
+    run_main_loop_for_n_seconds (1);
+
+    fail_unless (signouts1 == 2, "Lost some of the signed-out signals: %d",
+                 signouts1);
+    fail_unless (signouts2 == 0, "Got the signed-out signal of another identity");
+
+    /* unregistered: once signond has dropped the idle objects, each
+     * identity registers again with its own ID */
+    sleep (SIGNOND_IDLE_TIMEOUT);
+    run_main_loop_for_n_seconds (1);
+
+    info = signon_identity_query_info_sync (idty2, NULL, &error);
+    fail_unless (info != NULL, "query_info failed: %s",
+                 error != NULL ? error->message : "");
+    fail_unless (signon_identity_info_get_id (info) == (gint)id2);
+    signon_identity_info_free (info);
+
+    info = signon_identity_query_info_sync (idty1_copy, NULL, &error);
+    fail_unless (info != NULL, "query_info failed: %s",
+                 error != NULL ? error->message : "");
+    fail_unless (signon_identity_info_get_id (info) == (gint)id1);
+    signon_identity_info_free (info);
+
+    g_object_unref (as1);
+    g_object_unref (as2);
+    fail_unless (signon_identity_remove_sync (idty1, NULL, &error));
+    fail_unless (signon_identity_remove_sync (idty2, NULL, &error));
+    g_object_unref (idty1_copy);
+    g_object_unref (idty1);
+    g_object_unref (idty2);
+
+    end_test ();
+}
+END_TEST
+
+/* The first object of a thread can be registered by a synchronous call:
+ * the signals must still be delivered by the main loop afterwards. */
+START_TEST(test_signals_after_sync_call)
+{
+    SignonIdentity *idty, *other;
+    SignonIdentityInfo *info;
+    GError *error = NULL;
+    gint signouts = 0;
+
+    g_debug("%s", G_STRFUNC);
+    main_loop = g_main_loop_new (NULL, FALSE);
+
+    info = create_standard_info ();
+    idty = signon_identity_new ();
+    fail_unless (signon_identity_store_info_sync (idty, info, NULL, &error));
+    signon_identity_info_free (info);
+
+    g_signal_connect (idty, "signed-out",
+                      G_CALLBACK (identity_signout_signal_cb), &signouts);
+
+    other = signon_identity_new_from_db (signon_identity_get_id (idty));
+    signon_identity_sign_out (other, NULL, identity_signout_cb, NULL);
+    g_main_loop_run (main_loop);
+    run_main_loop_for_n_seconds (1);
+
+    fail_unless (signouts == 1, "The signal was not delivered after a "
+                 "synchronous call");
+
+    signon_identity_remove (idty, NULL, identity_remove_cb, NULL);
+    g_main_loop_run (main_loop);
+
+    g_object_unref (other);
+    g_object_unref (idty);
+    end_test ();
+}
+END_TEST
+
 START_TEST(test_unregistered_identity)
 {
     g_debug("%s", G_STRFUNC);
@@ -1459,6 +3006,309 @@ START_TEST(test_regression_unref)
 }
 END_TEST
 
+START_TEST(test_identity_info_copy)
+{
+    SignonIdentityInfo *info, *copy;
+    const GHashTable *methods;
+    const gchar *mechanisms[] = { "mechanism1", NULL };
+
+    g_debug ("%s", G_STRFUNC);
+
+    info = create_standard_info ();
+    copy = signon_identity_info_copy (info);
+
+    /* The contents are shared until one of the two is modified */
+    fail_unless (signon_identity_info_get_username (copy) ==
+                 signon_identity_info_get_username (info));
+
+    signon_identity_info_set_username (copy, "Felix Leiter");
+    signon_identity_info_set_method (copy, "method4", mechanisms);
+    signon_identity_info_remove_method (copy, "method1");
+    ck_assert_str_eq (signon_identity_info_get_username (copy),
+                      "Felix Leiter");
+    ck_assert_str_eq (signon_identity_info_get_username (info),
+                      "James Bond");
+    ck_assert_str_eq (signon_identity_info_get_caption (copy), "caption");
+
+    methods = signon_identity_info_get_methods (info);
+    fail_unless (g_hash_table_size ((GHashTable *)methods) == 3);
+    fail_unless (g_hash_table_lookup ((GHashTable *)methods,
+                                      "method1") != NULL);
+    fail_unless (g_hash_table_lookup ((GHashTable *)methods,
+                                      "method4") == NULL);
+
+    methods = signon_identity_info_get_methods (copy);
+    fail_unless (g_hash_table_size ((GHashTable *)methods) == 3);
+    fail_unless (g_hash_table_lookup ((GHashTable *)methods,
+                                      "method1") == NULL);
+    fail_unless (g_hash_table_lookup ((GHashTable *)methods,
+                                      "method4") != NULL);
+
+    /* The original outlives the copy, and vice versa */
+    signon_identity_info_free (info);
+    ck_assert_str_eq (signon_identity_info_get_caption (copy), "caption");
+    info = signon_identity_info_copy (copy);
+    signon_identity_info_free (copy);
+    ck_assert_str_eq (signon_identity_info_get_username (info),
+                      "Felix Leiter");
+    signon_identity_info_free (info);
+}
+END_TEST
+
+START_TEST(test_identity_info_copy_methods_table)
+{
+    SignonIdentityInfo *info, *copy;
+    GHashTable *methods;
+    const gchar *mechanisms[] = { "mechanism1", NULL };
+    const gchar * const *value;
+
+    g_debug ("%s", G_STRFUNC);
+
+    info = create_standard_info ();
+    copy = signon_identity_info_copy (info);
+
+    /* The table of the copy must follow its changes, and must stay valid
+     * once the data it was built on is gone with the original */
+    methods = (GHashTable *)signon_identity_info_get_methods (copy);
+    signon_identity_info_set_method (copy, "method4", mechanisms);
+    signon_identity_info_free (info);
+
+    fail_unless (methods == signon_identity_info_get_methods (copy));
+    fail_unless (g_hash_table_size (methods) == 4);
+    value = g_hash_table_lookup (methods, "method4");
+    fail_unless (value != NULL);
+    ck_assert_str_eq (value[0], "mechanism1");
+    value = g_hash_table_lookup (methods, "method1");
+    fail_unless (value != NULL);
+    ck_assert_str_eq (value[0], "mechanism1");
+
+    signon_identity_info_free (copy);
+}
+END_TEST
+
+static gpointer
+identity_info_copy_thread (gpointer user_data)
+{
+    SignonIdentityInfo *copy = signon_identity_info_copy (user_data);
+    const gchar *mechanisms[] = { "mechanism1", NULL };
+    GHashTable *methods;
+    gboolean ok;
+
+    /* The copies share the data of the template: they read it at the same
+     * time, and copy it when they are modified */
+    methods = (GHashTable *)signon_identity_info_get_methods (copy);
+    ok = (g_hash_table_size (methods) == 3);
+    signon_identity_info_set_method (copy, "method4", mechanisms);
+    ok = ok && g_hash_table_size (methods) == 4 &&
+        g_hash_table_lookup (methods, "method1") != NULL;
+    signon_identity_info_free (copy);
+    return GINT_TO_POINTER (ok);
+}
+
+START_TEST(test_identity_info_copy_threads)
+{
+    SignonIdentityInfo *info;
+    GThread *threads[8];
+    guint i;
+
+    g_debug ("%s", G_STRFUNC);
+
+    info = create_standard_info ();
+
+    for (i = 0; i < G_N_ELEMENTS (threads); i++)
+        threads[i] = g_thread_new ("info-copy", identity_info_copy_thread,
+                                   info);
+    for (i = 0; i < G_N_ELEMENTS (threads); i++)
+        fail_unless (g_thread_join (threads[i]) != NULL,
+                     "Thread %u got a wrong table", i);
+
+    /* The template is untouched */
+    fail_unless (g_hash_table_size ((GHashTable *)
+                                    signon_identity_info_get_methods (info)) == 3);
+
+    signon_identity_info_free (info);
+}
+END_TEST
+
+START_TEST(test_identity_info_allows_mechanism)
+{
+    SignonIdentityInfo *info;
+    const gchar *oauth_mechanisms[] = { "web_server", "user_agent", NULL };
+    const gchar *any_mechanism[] = { "*", NULL };
+    const gchar *no_mechanisms[] = { NULL };
+
+    g_debug ("%s", G_STRFUNC);
+
+    /* No methods: everything is allowed */
+    info = signon_identity_info_new ();
+    fail_unless (signon_identity_info_allows_mechanism (info, "oauth2", NULL));
+    fail_unless (signon_identity_info_allows_mechanism (info, "oauth2",
+                                                        "web_server"));
+
+    signon_identity_info_set_method (info, "oauth2", oauth_mechanisms);
+    signon_identity_info_set_method (info, "password", no_mechanisms);
+    fail_unless (signon_identity_info_allows_mechanism (info, "oauth2",
+                                                        "web_server"));
+    fail_unless (signon_identity_info_allows_mechanism (info, "oauth2",
+                                                        "user_agent"));
+    fail_if (signon_identity_info_allows_mechanism (info, "oauth2", "HMAC"));
+    fail_unless (signon_identity_info_allows_mechanism (info, "password",
+                                                        "password"));
+    fail_unless (signon_identity_info_allows_mechanism (info, "oauth2", NULL));
+    fail_if (signon_identity_info_allows_mechanism (info, "sasl", NULL));
+    fail_if (signon_identity_info_allows_mechanism (info, "sasl", "PLAIN"));
+
+    /* Lists of mechanisms, as in SASL: any allowed one will do */
+    fail_unless (signon_identity_info_allows_mechanism (info, "oauth2",
+                                                        "HMAC user_agent"));
+    fail_unless (signon_identity_info_allows_mechanism (info, "oauth2",
+                                                        " web_server  "));
+    fail_if (signon_identity_info_allows_mechanism (info, "oauth2",
+                                                    "HMAC PLAIN"));
+    fail_if (signon_identity_info_allows_mechanism (info, "oauth2", " "));
+
+    /* Like for signond, "*" is not a wildcard */
+    signon_identity_info_set_method (info, "*", oauth_mechanisms);
+    fail_if (signon_identity_info_allows_mechanism (info, "sasl",
+                                                    "user_agent"));
+    signon_identity_info_set_method (info, "oauth2", any_mechanism);
+    fail_if (signon_identity_info_allows_mechanism (info, "oauth2", "HMAC"));
+    fail_unless (signon_identity_info_allows_mechanism (info, "oauth2", "*"));
+
+    /* The hash table view follows the changes */
+    fail_unless (g_hash_table_size ((GHashTable *)
+                                    signon_identity_info_get_methods (info)) == 3);
+    signon_identity_info_remove_method (info, "*");
+    signon_identity_info_remove_method (info, "oauth2");
+    signon_identity_info_remove_method (info, "password");
+    fail_unless (g_hash_table_size ((GHashTable *)
+                                    signon_identity_info_get_methods (info)) == 0);
+    fail_unless (signon_identity_info_allows_mechanism (info, "sasl", "PLAIN"));
+
+    signon_identity_info_free (info);
+}
+END_TEST
+
+START_TEST(test_session_data_template)
+{
+    SignonSessionData *template;
+    GVariant *session_data;
+    const gchar *string;
+    gint32 policy;
+
+    g_debug ("%s", G_STRFUNC);
+
+    template = signon_session_data_new ();
+    signon_session_data_set (template, "ClientId",
+                             g_variant_new_string ("my-client"));
+    signon_session_data_set (template, "Scope",
+                             g_variant_new_string ("default"));
+    signon_session_data_set (template, SIGNON_SESSION_DATA_UI_POLICY,
+                             g_variant_new_int32 (SIGNON_POLICY_DEFAULT));
+    fail_unless (signon_session_data_get_size (template) == 3);
+
+    /* Overridden keys replace the template values */
+    session_data = signon_session_data_build_with_values (template,
+        "Scope", g_variant_new_string ("email"),
+        "Extra", g_variant_new_string ("value"),
+        NULL);
+    g_variant_ref_sink (session_data);
+    fail_unless (g_variant_n_children (session_data) == 4);
+    fail_unless (g_variant_lookup (session_data, "Scope", "&s", &string));
+    ck_assert_str_eq (string, "email");
+    fail_unless (g_variant_lookup (session_data, "ClientId", "&s", &string));
+    ck_assert_str_eq (string, "my-client");
+    fail_unless (g_variant_lookup (session_data, "Extra", "&s", &string));
+    ck_assert_str_eq (string, "value");
+    g_variant_unref (session_data);
+
+    /* The template itself is unchanged */
+    session_data = g_variant_ref_sink (signon_session_data_build (template,
+                                                                  NULL));
+    fail_unless (g_variant_n_children (session_data) == 3);
+    fail_unless (g_variant_lookup (session_data, "Scope", "&s", &string));
+    ck_assert_str_eq (string, "default");
+    fail_unless (g_variant_lookup (session_data, SIGNON_SESSION_DATA_UI_POLICY,
+                                   "i", &policy));
+    fail_unless (policy == SIGNON_POLICY_DEFAULT);
+    g_variant_unref (session_data);
+
+    fail_unless (signon_session_data_remove (template, "ClientId"));
+    fail_if (signon_session_data_remove (template, "ClientId"));
+    signon_session_data_set (template, "Scope", NULL);
+    fail_unless (signon_session_data_get_size (template) == 1);
+
+    session_data = g_variant_ref_sink (signon_session_data_build (template,
+                                                                  NULL));
+    fail_unless (g_variant_n_children (session_data) == 1);
+    fail_if (g_variant_lookup (session_data, "Scope", "&s", &string));
+    g_variant_unref (session_data);
+
+    signon_session_data_unref (template);
+}
+END_TEST
+
+START_TEST(test_session_data_reply)
+{
+    SignonSessionData *data;
+    GVariantBuilder builder;
+    const gchar *scopes[] = { "email", "profile", NULL };
+    const gchar **strv;
+    const gchar *string;
+    gint32 expires_in;
+    guint32 uint_value;
+    gboolean boolean;
+
+    g_debug ("%s", G_STRFUNC);
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&builder, "{sv}", "AccessToken",
+                           g_variant_new_string ("t0k3n"));
+    g_variant_builder_add (&builder, "{sv}", "ExpiresIn",
+                           g_variant_new_int32 (3600));
+    g_variant_builder_add (&builder, "{sv}", "Scope",
+                           g_variant_new_strv (scopes, -1));
+    g_variant_builder_add (&builder, "{sv}", "Refreshed",
+                           g_variant_new_boolean (TRUE));
+
+    data = signon_session_data_new_from_variant (g_variant_builder_end (&builder));
+    fail_unless (data != NULL);
+    fail_unless (signon_session_data_get_size (data) == 4);
+
+    string = signon_session_data_get_string (data, "AccessToken");
+    ck_assert_str_eq (string, "t0k3n");
+    /* Strings are borrowed from the reply, not copied */
+    fail_unless (string == signon_session_data_get_string (data,
+                                                           "AccessToken"));
+
+    fail_unless (signon_session_data_get_int32 (data, "ExpiresIn",
+                                                &expires_in));
+    fail_unless (expires_in == 3600);
+    /* Type mismatches are reported, not converted */
+    fail_if (signon_session_data_get_uint32 (data, "ExpiresIn", &uint_value));
+    fail_unless (signon_session_data_get_string (data, "ExpiresIn") == NULL);
+
+    fail_unless (signon_session_data_get_boolean (data, "Refreshed",
+                                                  &boolean));
+    fail_unless (boolean);
+
+    strv = signon_session_data_get_strv (data, "Scope");
+    fail_unless (strv != NULL);
+    fail_unless (g_strv_length ((gchar **)strv) == 2);
+    ck_assert_str_eq (strv[0], "email");
+    ck_assert_str_eq (strv[1], "profile");
+    g_free (strv);
+
+    fail_unless (signon_session_data_contains (data, "Scope"));
+    fail_if (signon_session_data_contains (data, "RefreshToken"));
+    fail_unless (signon_session_data_get_string (data, "RefreshToken") == NULL);
+    fail_unless (signon_session_data_lookup_value (data, "ExpiresIn",
+                                                   G_VARIANT_TYPE_INT32) != NULL);
+
+    signon_session_data_unref (data);
+}
+END_TEST
+
 Suite *
 signon_suite(void)
 {
@@ -1478,9 +3328,18 @@ signon_suite(void)
     tcase_add_test (tc_core, test_query_mechanisms_sync);
     tcase_add_test (tc_core, test_get_existing_identity);
     tcase_add_test (tc_core, test_get_nonexisting_identity);
+    tcase_add_test (tc_core, test_async_init);
 
     tcase_add_test (tc_core, test_auth_session_creation);
+    tcase_add_test (tc_core, test_auth_session_reuse);
     tcase_add_test (tc_core, test_auth_session_process_async);
+    tcase_add_test (tc_core, test_auth_session_coalesce_states);
+    tcase_add_test (tc_core, test_auth_session_process_timings);
+    tcase_add_test (tc_core, test_auth_session_process_timings_overlap);
+    tcase_add_test (tc_core, test_auth_session_process_fd_fallback);
+    tcase_add_test (tc_core, test_auth_session_prepare);
+    tcase_add_test (tc_core, test_auth_session_query_mechanisms);
+    tcase_add_test (tc_core, test_auth_session_mechanism_list);
     tcase_add_test (tc_core, test_auth_session_process_failure);
     tcase_add_test (tc_core, test_auth_session_process_cancel);
     tcase_add_test (tc_core, test_auth_session_process_after_store);
@@ -1488,12 +3347,31 @@ signon_suite(void)
     tcase_add_test (tc_core, test_verify_secret_identity);
     tcase_add_test (tc_core, test_remove_identity);
     tcase_add_test (tc_core, test_info_identity);
-
+    tcase_add_test (tc_core, test_store_update_fallback);
+    tcase_add_test (tc_core, test_lookup_identities_for_realm);
+    tcase_add_test (tc_core, test_identity_monitor);
+    tcase_add_test (tc_core, test_identity_monitor_restart);
+    tcase_add_test (tc_core, test_identity_idle_timeout);
+    tcase_add_test (tc_core, test_identity_idle_timeout_sync);
+    tcase_add_test (tc_core, test_identity_reference);
+    tcase_add_test (tc_core, test_identity_keep_alive);
+    tcase_add_test (tc_core, test_store_identities);
+    tcase_add_test (tc_core, test_store_identities_cancel);
+
+    tcase_add_test (tc_core, test_sync_api_threads);
     tcase_add_test (tc_core, test_signout_identity);
+    tcase_add_test (tc_core, test_signal_routing);
+    tcase_add_test (tc_core, test_signals_after_sync_call);
     tcase_add_test (tc_core, test_unregistered_identity);
     tcase_add_test (tc_core, test_unregistered_auth_session);
 
     tcase_add_test (tc_core, test_regression_unref);
+    tcase_add_test (tc_core, test_identity_info_copy);
+    tcase_add_test (tc_core, test_identity_info_copy_methods_table);
+    tcase_add_test (tc_core, test_identity_info_copy_threads);
+    tcase_add_test (tc_core, test_identity_info_allows_mechanism);
+    tcase_add_test (tc_core, test_session_data_template);
+    tcase_add_test (tc_core, test_session_data_reply);
 
     suite_add_tcase (s, tc_core);
 